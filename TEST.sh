@@ -91,6 +91,24 @@ if [ "$FMT" == "" ] || [ "$FMT" == ".png" ] ; then
   fi
 fi
 
+### Date fractions (past microseconds, the date is padded with zeros)
+if [ "$FMT" == "" ] || [ "$FMT" == ".png" ] ; then
+  if [ $ISLOCAL == 1 ] ; then
+    echo ""
+    echo "##### Date Fraction Test"
+    for sf in date6:hex date7:hex date9:hex ; do
+      i=regression/test-unsigned.png
+      ka=rsa
+      sfname=${sf/:/_}
+      j=${i/regression/test}
+      out=${j/-unsigned/-signed-local-fraction-$ka-$sfname}
+      echo ""
+      bin/sealtool -s -k "test/sign-$ka.key" --ka "$ka" --sf "$sf" -o "$out" "$i"
+      bin/sealtool --ka "$ka" --dnsfile "test/sign-$ka.dns" "$out"
+    done
+  fi
+fi
+
 ### Append
 if [ 1 == 1 ] ; then
   if [ $ISLOCAL == 1 ] ; then
@@ -125,6 +143,42 @@ if [ 1 == 1 ] ; then
   fi
 fi
 
+### Offline key store
+if [ $ISLOCAL == 1 ] ; then
+  echo ""
+  echo "##### Keystore Test"
+  # One RSA-only record: no revoke, and the last entry in the index
+  ka=rsa
+  echo "localhost.localdomain \"$(cat test/sign-$ka.dns)\"" > test/keystore-$ka.zone
+  bin/sealtool --keystore test/keystore-$ka.zone --keystore-index test/keystore-$ka.idx
+  for ks in zone idx ; do
+    echo ""
+    echo "#### Verify Keystore $ka $ks"
+    bin/sealtool --keystore "test/keystore-$ka.$ks" test/test-*local-sha256-$ka-hex*
+  done
+fi
+
+### Manual stream
+if [ $ISLOCAL == 1 ] ; then
+  echo ""
+  echo "##### Manual Stream Test"
+  # Three digests signed in bulk; the last has no newline and arrives in its own read
+  ka=rsa
+  D=$(printf 'ab%.0s' {1..32})
+  n=$( (printf "$D\n$D\n" ; sleep 0.5 ; printf "$D") | bin/sealtool -m - -k "test/sign-$ka.key" --ka "$ka" --manual-jobs 2 | grep -c '<seal ')
+  echo "Manual stream records: $n (expected 3)"
+fi
+
+### Malformed files (must report, not crash)
+if [ "$FMT" == "" ] || [ "$FMT" == ".heic" ] ; then
+  echo ""
+  echo "##### Malformed File Test"
+  for i in regression/test-badsize*"$FMT" ; do
+    bin/sealtool "$i"
+    if [ $? -gt 128 ] ; then echo "ERROR: $i crashed"; fi
+  done
+fi
+
 ### Try manual fields
 if [ "$FMT" == "" ] || [ "$FMT" == ".jpg" ] ; then
   if [ $ISREMOTE == 1 ] ; then
@@ -0,0 +1,45 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Shared code for the benchmarks (sealbench).
+ ************************************************/
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "seal.hpp"
+#include "files.hpp"
+
+uint32_t	_PNGCrc32	(uint32_t DataLen, const byte *Data); // format-png.cpp
+size_t	_MaReadData	(mmapfile *Mmap, size_t *Offset); // format-matroska.cpp
+
+/*****
+ Each synthetic generator writes about Size bytes.
+ The Rng state makes the content deterministic.
+ *****/
+typedef void (*benchgen)(FILE *Fout, uint64_t Size, uint64_t *Rng);
+
+typedef struct
+  {
+  const char *Name; // for --formats
+  const char *Ext;
+  uint64_t MaxSize; // format limit
+  benchgen Gen;
+  } benchformat;
+
+extern const benchformat BenchFormats[]; // ends with a NULL Name
+extern FILE *BenchOut; // results (the real stdout)
+
+uint64_t	BenchRand	(uint64_t *Rng);
+void	BenchFill	(byte *Buf, size_t Len, uint64_t *Rng, bool Text);
+uint64_t	BenchSize	(const char *Str);
+bool	BenchInList	(const char *List, const char *Name);
+int	BenchMicro	(int argc, char *argv[]);
+
+#endif
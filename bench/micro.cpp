@@ -0,0 +1,948 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Microbenchmarks for the core primitives.
+ Run with: sealbench micro [options]
+
+ Each benchmark isolates one function on a fixed, deterministic
+ input: SealParse(), the sealfield chain (SealSearch, SealSetText),
+ SealDigest() with different b= shapes, the hex/base64 codecs,
+ _PNGCrc32(), _MaReadData(), the TIFF and EXIF IFD walkers,
+ and each Seal_is*() probe.
+
+ Every benchmark runs twice:
+   warm = repeated in a tight loop; the input stays in cache.
+   cold = the input is flushed from the cache before every call,
+          and each call is timed by itself (minus the clock overhead).
+ Cold approximates the first touch of an mmap'd file that is
+ already in the page cache.
+
+ Results are JSON lines: ns per operation and bytes per second.
+ Before timing, the codecs are checked against a reference
+ round trip (decode(encode(x)) == x) on random inputs.
+ ************************************************/
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#if defined(__x86_64__)
+  #include <immintrin.h> // _mm_clflush()
+#endif
+
+#include "seal.hpp"
+#include "seal-parse.hpp"
+#include "files.hpp"
+#include "formats.hpp"
+#include "sign.hpp"
+#include "stats.hpp"
+#include "process.hpp"
+#include "bench.hpp"
+
+#pragma GCC visibility push(hidden)
+
+typedef void (*microfunc)(void *Ctx);
+
+static uint64_t MicroMinNs=100000000; // per variant (--time)
+static uint64_t MicroClockNs=0; // cost of one StatNow() pair
+static const char *MicroFilter=NULL;
+static bool MicroCold=true;
+static volatile uint64_t MicroSink=0; // keeps results alive
+
+/*****
+ Every benchmark context begins with the data to flush for "cold".
+ A chain is not contiguous, so each of its nodes is flushed.
+ *****/
+typedef struct
+  {
+  const void *Data;
+  size_t DataLen;
+  sealfield *Chain;
+  } microbuf;
+
+/**************************************
+ MicroFlush(): Remove a buffer from every cache level.
+ Without clflush, evict it by streaming through a buffer
+ that is larger than any last-level cache.
+ **************************************/
+static void	MicroFlush	(const void *Data, size_t DataLen)
+{
+#if defined(__x86_64__)
+  const char *p = (const char*)Data;
+  size_t i;
+  for(i=0; i < DataLen; i+=64) { _mm_clflush(p+i); }
+  if (DataLen) { _mm_clflush(p+DataLen-1); }
+  _mm_mfence();
+#else
+  static byte *Evict=NULL;
+  const size_t EvictLen=64*1024*1024;
+  uint64_t Sum=0;
+  size_t i;
+  (void)Data; (void)DataLen;
+  if (!Evict) { Evict = (byte*)calloc(EvictLen,1); }
+  for(i=0; i < EvictLen; i+=64) { Evict[i]++; Sum += Evict[i]; }
+  MicroSink += Sum;
+#endif
+} /* MicroFlush() */
+
+/**************************************
+ MicroFlushChain(): Flush every node of a chain.
+ **************************************/
+static void	MicroFlushChain	(sealfield *Chain)
+{
+  for( ; Chain; Chain=Chain->Next)
+    {
+    MicroFlush(Chain,sizeof(sealfield));
+    MicroFlush(Chain->Field,Chain->FieldLen+1);
+    MicroFlush(Chain->Value,Chain->ValueLen+1);
+    }
+} /* MicroFlushChain() */
+
+/**************************************
+ MicroClock(): Measure the timing overhead (median of many).
+ **************************************/
+static uint64_t	MicroClock	()
+{
+  uint64_t Best[31];
+  int i,j;
+  for(i=0; i < 31; i++)
+    {
+    uint64_t t = StatNow();
+    Best[i] = StatNow()-t;
+    }
+  for(i=1; i < 31; i++) // insertion sort
+    {
+    uint64_t v = Best[i];
+    for(j=i; (j > 0) && (Best[j-1] > v); j--) { Best[j] = Best[j-1]; }
+    Best[j] = v;
+    }
+  return(Best[15]);
+} /* MicroClock() */
+
+/**************************************
+ MicroReport(): Write one result line.
+ **************************************/
+static void	MicroReport	(const char *Name, const char *Case, const char *Cache,
+			 uint64_t Ops, uint64_t Ns, uint64_t Bytes)
+{
+  double NsOp = Ops ? (double)Ns/(double)Ops : 0.0;
+  fprintf(BenchOut,"{\"bench\":\"micro\",\"name\":\"%s\",\"case\":\"%s\",\"cache\":\"%s\",\"ops\":%lu,\"ns_op\":%.1f,\"bytes_op\":%lu,\"bytes_s\":%.0f}\n",
+	Name,Case,Cache,(unsigned long)Ops,NsOp,(unsigned long)Bytes,
+	(NsOp > 0) ? (double)Bytes*1e9/NsOp : 0.0);
+  fflush(BenchOut);
+} /* MicroReport() */
+
+/**************************************
+ MicroRun(): Time Func(Ctx) warm and cold.
+ Bytes is the number of input bytes per call (0 if not meaningful).
+ Ctx must begin with a microbuf (the data to flush when cold).
+ **************************************/
+static void	MicroRun	(const char *Name, const char *Case, microfunc Func, void *Ctx, uint64_t Bytes)
+{
+  uint64_t Ops, Ns, Start, Batch=1;
+  microbuf *Buf = (microbuf*)Ctx;
+
+  if (MicroFilter && !strstr(Name,MicroFilter)) { return; }
+
+  // Untimed warm-up (caches, branch predictors, CPU clock)
+  Start = StatNow();
+  do { Func(Ctx); } while(StatNow()-Start < MicroMinNs/8);
+
+  // Warm: batches grow until the timer overhead does not matter
+  Ops=0;
+  Start = StatNow();
+  do
+    {
+    for(uint64_t i=0; i < Batch; i++) { Func(Ctx); }
+    Ops += Batch;
+    Ns = StatNow()-Start;
+    if ((Ns < MicroMinNs/16) && (Batch < (1ULL<<30))) { Batch *= 2; }
+    } while(Ns < MicroMinNs);
+  MicroReport(Name,Case,"warm",Ops,Ns,Bytes);
+
+  // Cold: one call at a time, after flushing the input
+  if (!MicroCold) { return; }
+  Ops=Ns=0;
+  Start = StatNow();
+  while(((StatNow()-Start < MicroMinNs) || (Ops < 16)) && (Ops < 100000))
+    {
+    uint64_t t;
+    MicroFlush(Buf->Data,Buf->DataLen);
+    MicroFlushChain(Buf->Chain);
+    t = StatNow();
+    Func(Ctx);
+    t = StatNow()-t;
+    Ns += t - Min(t,MicroClockNs);
+    Ops++;
+    }
+  MicroReport(Name,Case,"cold",Ops,Ns,Bytes);
+} /* MicroRun() */
+
+/*******************************************************/
+/** SealParse() ****************************************/
+/*******************************************************/
+
+typedef struct
+  {
+  microbuf Buf;
+  } microparse;
+
+/**************************************
+ MicroParse(): Find and tokenize the first record.
+ **************************************/
+static void	MicroParse	(void *Ctx)
+{
+  microparse *C = (microparse*)Ctx;
+  sealfield *Rec = SealParse(C->Buf.DataLen,(const byte*)C->Buf.Data,0,NULL);
+  MicroSink += (uintptr_t)Rec;
+  SealFree(Rec);
+} /* MicroParse() */
+
+/**************************************
+ MicroParseAll(): The SealParse() benchmarks.
+ Realistic records (plain and XMP-escaped) after some text,
+ and adversarial inputs that make the parser restart often.
+ **************************************/
+static void	MicroParseAll	(uint64_t *Rng)
+{
+  const size_t Len=64*1024;
+  byte *Text = (byte*)malloc(Len+1);
+  byte Sig[512];
+  char Rec[2048];
+  microparse C;
+  size_t i, RecLen;
+  sealfield *S;
+
+  memset(&C,0,sizeof(C));
+
+  // A real-looking RSA signature: 256 bytes as base64
+  BenchFill(Sig,256,Rng,false);
+  S = SealSetBin(NULL,"s",256,Sig);
+  SealBase64Encode(SealSearch(S,"s"));
+
+  // Plain record after 4K of text
+  BenchFill(Text,4096,Rng,true);
+  RecLen = snprintf(Rec,sizeof(Rec),"<seal seal=\"1\" kv=\"1\" ka=\"rsa\" da=\"sha256\" sf=\"date3:base64\" d=\"example.com\" b=\"F~S,s~f\" s=\"%s\"/>",SealGetText(S,"s"));
+  memcpy(Text+4096,Rec,RecLen);
+  C.Buf.Data = Text;
+  C.Buf.DataLen = 4096+RecLen;
+  MicroRun("SealParse","record",MicroParse,&C,C.Buf.DataLen);
+
+  // XMP-style escaped record
+  RecLen = snprintf(Rec,sizeof(Rec),"<seal:seal>&lt;seal seal=&quot;1&quot; kv=&quot;1&quot; ka=&quot;rsa&quot; da=&quot;sha256&quot; sf=&quot;date3:base64&quot; d=&quot;example.com&quot; b=&quot;F~S,s~f&quot; s=&quot;%s&quot;/&gt;</seal:seal>",SealGetText(S,"s"));
+  memcpy(Text+4096,Rec,RecLen);
+  C.Buf.DataLen = 4096+RecLen;
+  MicroRun("SealParse","xmp",MicroParse,&C,C.Buf.DataLen);
+  SealFree(S);
+
+  // Text without any record: a full scan
+  BenchFill(Text,Len,Rng,true);
+  C.Buf.DataLen = Len;
+  MicroRun("SealParse","none",MicroParse,&C,Len);
+
+  // Adversarial: every byte starts a tag
+  memset(Text,'<',Len);
+  MicroRun("SealParse","all-lt",MicroParse,&C,Len);
+
+  // Adversarial: repeated near-misses
+  for(i=0; i+5 <= Len; i+=5) { memcpy(Text+i,"<sea ",5); }
+  MicroRun("SealParse","near-miss",MicroParse,&C,Len);
+
+  // Adversarial: a record whose quote never ends
+  memset(Text,'a',Len);
+  memcpy(Text,"<seal seal=\"1\" s=\"",18);
+  MicroRun("SealParse","open-quote",MicroParse,&C,Len);
+
+  free(Text);
+} /* MicroParseAll() */
+
+/*******************************************************/
+/** sealfield chains ***********************************/
+/*******************************************************/
+
+typedef struct
+  {
+  microbuf Buf;
+  sealfield *Chain;
+  char Field[32];
+  const char *Value;
+  } microchain;
+
+/**************************************
+ MicroSearch(): Find a field.
+ **************************************/
+static void	MicroSearch	(void *Ctx)
+{
+  microchain *C = (microchain*)Ctx;
+  MicroSink += (uintptr_t)SealSearch(C->Chain,C->Field);
+} /* MicroSearch() */
+
+/**************************************
+ MicroSetText(): Replace a field's value.
+ **************************************/
+static void	MicroSetText	(void *Ctx)
+{
+  microchain *C = (microchain*)Ctx;
+  C->Chain = SealSetText(C->Chain,C->Field,C->Value);
+} /* MicroSetText() */
+
+/**************************************
+ MicroChainAll(): Search and replace on chains of different lengths.
+ Fields are prepended, so the first field added is the last one
+ found.
+ **************************************/
+static void	MicroChainAll	()
+{
+  static const int Lengths[] = { 8, 64, 512, 0 };
+  char Case[64];
+  int l,i;
+
+  for(l=0; Lengths[l]; l++)
+    {
+    microchain C;
+    memset(&C,0,sizeof(C));
+    for(i=0; i < Lengths[l]; i++)
+      {
+      char Field[32];
+      snprintf(Field,sizeof(Field),"@field%d",i);
+      C.Chain = SealSetText(C.Chain,Field,"0123456789abcdef");
+      }
+    C.Buf.Chain = C.Chain;
+
+    snprintf(C.Field,sizeof(C.Field),"@field%d",Lengths[l]-1);
+    snprintf(Case,sizeof(Case),"head-of-%d",Lengths[l]);
+    MicroRun("SealSearch",Case,MicroSearch,&C,0);
+
+    snprintf(C.Field,sizeof(C.Field),"@field0");
+    snprintf(Case,sizeof(Case),"tail-of-%d",Lengths[l]);
+    MicroRun("SealSearch",Case,MicroSearch,&C,0);
+
+    snprintf(C.Field,sizeof(C.Field),"@missing");
+    snprintf(Case,sizeof(Case),"miss-of-%d",Lengths[l]);
+    MicroRun("SealSearch",Case,MicroSearch,&C,0);
+
+    // Same length: reuses the allocation
+    snprintf(C.Field,sizeof(C.Field),"@field0");
+    C.Value = "fedcba9876543210";
+    snprintf(Case,sizeof(Case),"tail-of-%d",Lengths[l]);
+    MicroRun("SealSetText",Case,MicroSetText,&C,0);
+    SealFree(C.Chain);
+    C.Buf.Chain = NULL;
+    }
+} /* MicroChainAll() */
+
+/*******************************************************/
+/** SealDigest() ***************************************/
+/*******************************************************/
+
+typedef struct
+  {
+  microbuf Buf;
+  mmapfile Mmap;
+  sealfield *Rec;
+  } microdigest;
+
+/**************************************
+ MicroDigest(): Hash the b= ranges.
+ **************************************/
+static void	MicroDigest	(void *Ctx)
+{
+  microdigest *C = (microdigest*)Ctx;
+  C->Rec = SealDigest(C->Rec,&C->Mmap);
+} /* MicroDigest() */
+
+/**************************************
+ MicroDigestAll(): Digest 1M with different b= shapes.
+ The signature is in the middle of the file.
+ **************************************/
+static void	MicroDigestAll	(uint64_t *Rng)
+{
+  static const struct { const char *Case; const char *b; } Shapes[] =
+    {
+    { "whole", "F~f" },
+    { "two-ranges", "F~S,s~f" },
+    { "prev-sig", "P~S,s~f" },
+    { "offsets", "F+128~S-16,s+16~f-128" },
+    { NULL, NULL }
+    };
+  const size_t Len=1024*1024;
+  char Many[128*32];
+  microdigest C;
+  size_t *s;
+  int i;
+
+  memset(&C,0,sizeof(C));
+  C.Mmap.mem = (byte*)malloc(Len);
+  C.Mmap.memsize = Len;
+  BenchFill(C.Mmap.mem,Len,Rng,false);
+  C.Buf.Data = C.Mmap.mem;
+  C.Buf.DataLen = Len;
+
+  C.Rec = SealArgsInit();
+  C.Rec = SealSetText(C.Rec,"da","sha256");
+  s = SealGetIarray(C.Rec,"@s");
+  s[0] = Len/2; s[1] = Len/2+512;
+  C.Rec = SealSetIindex(C.Rec,"@p",0,4096);
+  C.Rec = SealSetIindex(C.Rec,"@p",1,4096+512);
+
+  for(i=0; Shapes[i].Case; i++)
+    {
+    C.Rec = SealSetText(C.Rec,"b",Shapes[i].b);
+    MicroDigest(&C);
+    if (SealSearch(C.Rec,"@error"))
+      {
+      fprintf(stderr,"ERROR: Digest benchmark '%s': %s. Aborting.\n",Shapes[i].b,SealGetText(C.Rec,"@error"));
+      exit(0x80);
+      }
+    MicroRun("SealDigest",Shapes[i].Case,MicroDigest,&C,Len);
+    }
+
+  // Many small ranges: 128 x 4K with 4K gaps (half the file)
+  Many[0]='\0';
+  for(i=0; i < 128; i++)
+    {
+    size_t n = strlen(Many);
+    snprintf(Many+n,sizeof(Many)-n,"%sF+%d~F+%d",i ? "," : "",i*8192,i*8192+4096);
+    }
+  C.Rec = SealSetText(C.Rec,"b",Many);
+  MicroRun("SealDigest","128-ranges",MicroDigest,&C,Len/2);
+
+  SealFree(C.Rec);
+  free(C.Mmap.mem);
+} /* MicroDigestAll() */
+
+/*******************************************************/
+/** hex and base64 *************************************/
+/*******************************************************/
+
+typedef struct
+  {
+  microbuf Buf;
+  sealfield *Rec;
+  } microcodec;
+
+/**************************************
+ MicroHexEncode(), MicroHexDecode(),
+ MicroB64Encode(), MicroB64Decode():
+ Load the input (one copy) and convert it.
+ **************************************/
+static void	MicroHexEncode	(void *Ctx)
+{
+  microcodec *C = (microcodec*)Ctx;
+  C->Rec = SealSetBin(C->Rec,"v",C->Buf.DataLen,(const byte*)C->Buf.Data);
+  SealHexEncode(C->Rec,false);
+} /* MicroHexEncode() */
+
+static void	MicroHexDecode	(void *Ctx)
+{
+  microcodec *C = (microcodec*)Ctx;
+  C->Rec = SealSetTextLen(C->Rec,"v",C->Buf.DataLen,(const char*)C->Buf.Data);
+  SealHexDecode(C->Rec);
+} /* MicroHexDecode() */
+
+static void	MicroB64Encode	(void *Ctx)
+{
+  microcodec *C = (microcodec*)Ctx;
+  C->Rec = SealSetBin(C->Rec,"v",C->Buf.DataLen,(const byte*)C->Buf.Data);
+  SealBase64Encode(C->Rec);
+} /* MicroB64Encode() */
+
+static void	MicroB64Decode	(void *Ctx)
+{
+  microcodec *C = (microcodec*)Ctx;
+  C->Rec = SealSetTextLen(C->Rec,"v",C->Buf.DataLen,(const char*)C->Buf.Data);
+  SealBase64Decode(C->Rec);
+} /* MicroB64Decode() */
+
+/**************************************
+ MicroCodecCheck(): Round-trip random inputs through each codec.
+ Also checks the encoding against a simple reference.
+ Returns the number of failures.
+ **************************************/
+static int	MicroCodecCheck	(uint64_t *Rng, int Cases)
+{
+  static const char B64[]="ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  byte In[1024];
+  char Ref[2048];
+  int c, Bad=0;
+
+  for(c=0; c < Cases; c++)
+    {
+    size_t Len = 1 + BenchRand(Rng) % sizeof(In);
+    size_t i,o;
+    sealfield *Rec;
+    BenchFill(In,Len,Rng,false);
+
+    // Hex
+    for(i=0; i < Len; i++) { snprintf(Ref+i*2,3,"%02x",In[i]); }
+    Rec = SealSetBin(NULL,"v",Len,In);
+    SealHexEncode(Rec,false);
+    if ((Rec->ValueLen != Len*2) || memcmp(Rec->Value,Ref,Len*2)) { Bad++; }
+    SealHexDecode(Rec);
+    if ((Rec->ValueLen != Len) || memcmp(Rec->Value,In,Len)) { Bad++; }
+
+    // Base64
+    for(i=o=0; i < Len; i+=3, o+=4)
+      {
+      uint32_t v = (uint32_t)In[i] << 16;
+      if (i+1 < Len) { v |= (uint32_t)In[i+1] << 8; }
+      if (i+2 < Len) { v |= In[i+2]; }
+      Ref[o] = B64[(v >> 18) & 0x3f];
+      Ref[o+1] = B64[(v >> 12) & 0x3f];
+      Ref[o+2] = (i+1 < Len) ? B64[(v >> 6) & 0x3f] : '=';
+      Ref[o+3] = (i+2 < Len) ? B64[v & 0x3f] : '=';
+      }
+    Rec = SealSetBin(Rec,"v",Len,In);
+    SealBase64Encode(Rec);
+    if ((Rec->ValueLen != o) || memcmp(Rec->Value,Ref,o)) { Bad++; }
+    SealBase64Decode(Rec);
+    if ((Rec->ValueLen != Len) || memcmp(Rec->Value,In,Len)) { Bad++; }
+    SealFree(Rec);
+    }
+  return(Bad);
+} /* MicroCodecCheck() */
+
+/**************************************
+ MicroCodecAll(): Codec benchmarks for a signature (256 bytes)
+ and a large block (64K). Bytes are the input bytes.
+ **************************************/
+static void	MicroCodecAll	(uint64_t *Rng)
+{
+  static const size_t Sizes[] = { 256, 64*1024, 0 };
+  const int Cases=2000;
+  char Case[32];
+  int s, Bad;
+
+  if (!MicroFilter || strstr("hex-encode,hex-decode,base64-encode,base64-decode",MicroFilter))
+    {
+    Bad = MicroCodecCheck(Rng,Cases);
+    fprintf(BenchOut,"{\"bench\":\"check\",\"name\":\"codec\",\"cases\":%d,\"failures\":%d,\"ok\":%s}\n",
+	Cases,Bad,Bad ? "false" : "true");
+    }
+
+  for(s=0; Sizes[s]; s++)
+    {
+    size_t Len = Sizes[s];
+    byte *Bin = (byte*)malloc(Len);
+    microcodec C;
+    sealfield *Enc;
+
+    BenchFill(Bin,Len,Rng,false);
+    snprintf(Case,sizeof(Case),"%lu",(unsigned long)Len);
+    memset(&C,0,sizeof(C));
+    C.Buf.Data = Bin;
+    C.Buf.DataLen = Len;
+    MicroRun("hex-encode",Case,MicroHexEncode,&C,Len);
+    MicroRun("base64-encode",Case,MicroB64Encode,&C,Len);
+
+    Enc = SealSetBin(NULL,"v",Len,Bin);
+    SealHexEncode(Enc,false);
+    C.Buf.Data = Enc->Value;
+    C.Buf.DataLen = Enc->ValueLen;
+    MicroRun("hex-decode",Case,MicroHexDecode,&C,Enc->ValueLen);
+
+    Enc = SealSetBin(Enc,"v",Len,Bin);
+    SealBase64Encode(Enc);
+    C.Buf.Data = Enc->Value;
+    C.Buf.DataLen = Enc->ValueLen;
+    MicroRun("base64-decode",Case,MicroB64Decode,&C,Enc->ValueLen);
+
+    SealFree(Enc);
+    SealFree(C.Rec);
+    free(Bin);
+    }
+} /* MicroCodecAll() */
+
+/*******************************************************/
+/** PNG CRC and Matroska vints *************************/
+/*******************************************************/
+
+/**************************************
+ MicroCrc(): CRC over the buffer.
+ **************************************/
+static void	MicroCrc	(void *Ctx)
+{
+  microbuf *C = (microbuf*)Ctx;
+  MicroSink += _PNGCrc32(C->DataLen,(const byte*)C->Data);
+} /* MicroCrc() */
+
+typedef struct
+  {
+  microbuf Buf;
+  mmapfile Mmap;
+  size_t Count;
+  } microvint;
+
+/**************************************
+ MicroVint(): Read every variable-length value.
+ **************************************/
+static void	MicroVint	(void *Ctx)
+{
+  microvint *C = (microvint*)Ctx;
+  size_t Offset=0, i, Sum=0;
+  for(i=0; i < C->Count; i++) { Sum += _MaReadData(&C->Mmap,&Offset); }
+  MicroSink += Sum;
+} /* MicroVint() */
+
+/**************************************
+ MicroBytesAll(): _PNGCrc32() and _MaReadData() benchmarks.
+ **************************************/
+static void	MicroBytesAll	(uint64_t *Rng)
+{
+  static const size_t Sizes[] = { 64, 4096, 1024*1024, 0 };
+  char Case[32];
+  byte *Buf;
+  int s;
+
+  Buf = (byte*)malloc(1024*1024);
+  BenchFill(Buf,1024*1024,Rng,false);
+  for(s=0; Sizes[s]; s++)
+    {
+    microbuf C = { Buf, Sizes[s], NULL };
+    snprintf(Case,sizeof(Case),"%lu",(unsigned long)Sizes[s]);
+    MicroRun("_PNGCrc32",Case,MicroCrc,&C,Sizes[s]);
+    }
+
+  // 4096 EBML values; each is 1 to 8 bytes long
+  {
+  microvint C;
+  size_t Len=0, Offset=0, i;
+  int b, n;
+  memset(&C,0,sizeof(C));
+  for(C.Count=0; C.Count < 4096; C.Count++)
+    {
+    n = 1 + BenchRand(Rng) % 8;
+    Buf[Len] = (0x80 >> (n-1)) | (BenchRand(Rng) & (0x7f >> (n-1)));
+    if (!Buf[Len]) { Buf[Len] = 0x80 >> (n-1); }
+    for(b=1; b < n; b++) { Buf[Len+b] = BenchRand(Rng) & 0xff; }
+    Len += n;
+    }
+  C.Mmap.mem = Buf;
+  C.Mmap.memsize = Len;
+  C.Buf.Data = Buf;
+  C.Buf.DataLen = Len;
+  // Sanity check: the values end at the end of the buffer
+  for(i=0; i < C.Count; i++) { _MaReadData(&C.Mmap,&Offset); }
+  if (Offset != Len)
+    {
+    fprintf(stderr,"ERROR: Matroska benchmark read %lu of %lu bytes. Aborting.\n",(unsigned long)Offset,(unsigned long)Len);
+    exit(0x80);
+    }
+  MicroRun("_MaReadData","4096-values",MicroVint,&C,Len);
+  }
+  free(Buf);
+} /* MicroBytesAll() */
+
+/*******************************************************/
+/** TIFF and EXIF IFD walkers **************************/
+/*******************************************************/
+
+typedef struct
+  {
+  microbuf Buf;
+  mmapfile Mmap;
+  sealfield *Args;
+  bool Exif;
+  } microwalk;
+
+/**************************************
+ MicroWalk(): Walk every IFD (no SEAL records are found).
+ **************************************/
+static void	MicroWalk	(void *Ctx)
+{
+  microwalk *C = (microwalk*)Ctx;
+  if (C->Exif) { C->Args = Seal_Exif(C->Args,&C->Mmap,0,C->Mmap.memsize); }
+  else { C->Args = Seal_TIFF(C->Args,&C->Mmap); }
+} /* MicroWalk() */
+
+/**************************************
+ MicroIFD(): Build a TIFF header and IFDs in Buf.
+ IFDs are chained (a multi-page TIFF). With Nested, IFD0 links
+ to IFD1, and IFD0's first entries point to the other IFDs
+ (like EXIF's Exif and GPS IFDs).
+ Every entry is a short (type 3) that is not a SEAL tag.
+ Returns: bytes used.
+ **************************************/
+static size_t	MicroIFD	(byte *Buf, int Endian, bool IsBig, int IFDs, int Entries, bool Nested)
+{
+  const size_t CountSize = (IsBig ? 8 : 2);
+  const size_t EntrySize = (IsBig ? 20 : 12);
+  const size_t ValueSize = (IsBig ? 8 : 4);
+  const size_t Header = (IsBig ? 16 : 8);
+  const size_t IFDSize = CountSize + Entries*EntrySize + ValueSize;
+  size_t Off;
+  int i,e;
+
+#define MicroW16(b,v) { if (Endian==1234) { writele16(b,v); } else { writebe16(b,v); } }
+#define MicroWV(b,v) { if (IsBig) { if (Endian==1234) { writele64(b,(uint64_t)(v)); } else { writebe64(b,(uint64_t)(v)); } } \
+		       else { if (Endian==1234) { writele32(b,v); } else { writebe32(b,v); } } }
+
+  memset(Buf,0,Header + IFDs*IFDSize);
+  memcpy(Buf,(Endian==1234) ? "II" : "MM",2);
+  MicroW16(Buf+2,IsBig ? 0x2b : 0x2a);
+  if (IsBig) { MicroW16(Buf+4,8); MicroWV(Buf+8,Header); }
+  else { MicroWV(Buf+4,Header); }
+
+  for(i=0; i < IFDs; i++)
+    {
+    Off = Header + i*IFDSize;
+    if (IsBig) { MicroWV(Buf+Off,Entries); }
+    else { MicroW16(Buf+Off,Entries); }
+    for(e=0; e < Entries; e++)
+      {
+      byte *E = Buf + Off + CountSize + e*EntrySize;
+      MicroW16(E,0x100+e); // tag
+      MicroW16(E+2,3); // short
+      if (IsBig) { MicroWV(E+4,1); MicroWV(E+12,e); }
+      else { MicroWV(E+4,1); MicroWV(E+8,e); }
+      // Nested: IFD0 points to IFD2, IFD3, ...
+      if (Nested && (i == 0) && (e+2 < IFDs) && !IsBig)
+	{
+	MicroW16(E,(e==0) ? 0x8769 : 0x8825);
+	MicroW16(E+2,4); // long
+	MicroWV(E+8,Header + (e+2)*IFDSize);
+	}
+      }
+    // Next IFD
+    if ((i+1 < IFDs) && (!Nested || (i == 0)))
+      {
+      MicroWV(Buf + Off + CountSize + Entries*EntrySize, Header + (i+1)*IFDSize);
+      }
+    }
+#undef MicroW16
+#undef MicroWV
+  return(Header + IFDs*IFDSize);
+} /* MicroIFD() */
+
+/**************************************
+ MicroWalkAll(): _TIFFwalk() (through Seal_TIFF) on classic and
+ BigTIFF in both byte orders, and _ExifWalk() (through Seal_Exif)
+ on an EXIF-shaped tree.
+ **************************************/
+static void	MicroWalkAll	()
+{
+  static const struct
+    {
+    const char *Name;
+    const char *Case;
+    int Endian;
+    bool IsBig, Exif;
+    int IFDs, Entries;
+    } Walks[] =
+    {
+    { "_TIFFwalk", "le-8x32", 1234, false, false, 8, 32 },
+    { "_TIFFwalk", "be-8x32", 4321, false, false, 8, 32 },
+    { "_TIFFwalk", "big-le-8x32", 1234, true, false, 8, 32 },
+    { "_TIFFwalk", "big-be-8x32", 4321, true, false, 8, 32 },
+    { "_TIFFwalk", "le-256x16", 1234, false, false, 256, 16 },
+    { "_ExifWalk", "le-4x24", 1234, false, true, 4, 24 },
+    { "_ExifWalk", "be-4x24", 4321, false, true, 4, 24 },
+    { NULL, NULL, 0, false, false, 0, 0 }
+    };
+  microwalk C;
+  byte *Buf;
+  int w;
+
+  Buf = (byte*)malloc(1024*1024);
+  for(w=0; Walks[w].Name; w++)
+    {
+    memset(&C,0,sizeof(C));
+    C.Mmap.mem = Buf;
+    C.Mmap.memsize = MicroIFD(Buf,Walks[w].Endian,Walks[w].IsBig,Walks[w].IFDs,Walks[w].Entries,Walks[w].Exif);
+    C.Buf.Data = Buf;
+    C.Buf.DataLen = C.Mmap.memsize;
+    C.Exif = Walks[w].Exif;
+    C.Args = SealArgsInit();
+    MicroRun(Walks[w].Name,Walks[w].Case,MicroWalk,&C,C.Mmap.memsize);
+    SealFree(C.Args);
+    }
+  free(Buf);
+} /* MicroWalkAll() */
+
+/*******************************************************/
+/** Seal_is*() probes **********************************/
+/*******************************************************/
+
+typedef struct
+  {
+  microbuf Buf;
+  mmapfile Mmap;
+  int Probe;
+  } microprobe;
+
+static const struct
+  {
+  const char *Name;
+  const char *Format; // matching synthetic format (or NULL)
+  } MicroProbes[] =
+  {
+  { "Seal_isPNG", "png" },
+  { "Seal_isJPEG", "jpeg" },
+  { "Seal_isGIF", NULL },
+  { "Seal_isRIFF", "wav" },
+  { "Seal_isMatroska", NULL },
+  { "Seal_isBMFF", "mp4" },
+  { "Seal_isPDF", NULL },
+  { "Seal_isTIFF", "tiff" },
+  { "Seal_isPPM", "ppm" },
+  { "Seal_isDICOM", NULL },
+  { "Seal_isMPEG", NULL },
+  { "Seal_isAAC", NULL },
+  { "Seal_isText", "text" },
+  { "SealFileFormat", NULL }, // the whole detection chain
+  { NULL, NULL }
+  };
+#define MicroDetect 13 // SealFileFormat
+
+/**************************************
+ MicroProbe(): Run one probe.
+ **************************************/
+static void	MicroProbe	(void *Ctx)
+{
+  microprobe *C = (microprobe*)Ctx;
+  mmapfile *M = &C->Mmap;
+  int r=0;
+  switch(C->Probe)
+    {
+    case 0: r = Seal_isPNG(M); break;
+    case 1: r = Seal_isJPEG(M); break;
+    case 2: r = Seal_isGIF(M); break;
+    case 3: r = Seal_isRIFF(M); break;
+    case 4: r = Seal_isMatroska(M); break;
+    case 5: r = Seal_isBMFF(M); break;
+    case 6: r = Seal_isPDF(M); break;
+    case 7: r = Seal_isTIFF(M); break;
+    case 8: r = Seal_isPPM(M); break;
+    case 9: r = Seal_isDICOM(M); break;
+    case 10: r = Seal_isMPEG(M); break;
+    case 11: r = Seal_isAAC(M); break;
+    case 12: r = Seal_isText(M); break;
+    case MicroDetect: r = SealFileFormat(M); break;
+    default: break;
+    }
+  MicroSink += r;
+} /* MicroProbe() */
+
+/**************************************
+ MicroProbeAll(): Each probe on random bytes (a miss) and
+ on its own synthetic format (a hit). The detection chain
+ runs on every synthetic format.
+ Most probes only read a header, so there is no byte count.
+ **************************************/
+static void	MicroProbeAll	()
+{
+  const size_t Len=64*1024;
+  microprobe C;
+  char Case[32];
+  char *Mem;
+  size_t MemLen;
+  int p,f;
+
+  memset(&C,0,sizeof(C));
+  C.Mmap.mem = (byte*)malloc(Len);
+  C.Mmap.memsize = Len;
+  C.Buf.Data = C.Mmap.mem;
+  C.Buf.DataLen = Len;
+  {
+  uint64_t Rng=0x5ea1; // random bytes that are not any format
+  BenchFill(C.Mmap.mem,Len,&Rng,false);
+  C.Mmap.mem[0]=0x01;
+  }
+  for(p=0; MicroProbes[p].Name; p++)
+    {
+    C.Probe=p;
+    MicroRun(MicroProbes[p].Name,"random",MicroProbe,&C,0);
+    }
+  free(C.Mmap.mem);
+
+  for(f=0; BenchFormats[f].Name; f++)
+    {
+    uint64_t Rng = (uint64_t)f << 56;
+    FILE *Fout = open_memstream(&Mem,&MemLen);
+    if (!Fout) { continue; }
+    BenchFormats[f].Gen(Fout,Len,&Rng);
+    fclose(Fout);
+    C.Mmap.mem = (byte*)Mem;
+    C.Mmap.memsize = MemLen;
+    C.Buf.Data = Mem;
+    C.Buf.DataLen = MemLen;
+    snprintf(Case,sizeof(Case),"%s",BenchFormats[f].Name);
+    for(p=0; MicroProbes[p].Name; p++)
+      {
+      if (MicroProbes[p].Format ? strcmp(MicroProbes[p].Format,BenchFormats[f].Name) : (p != MicroDetect)) { continue; }
+      C.Probe=p;
+      MicroRun(MicroProbes[p].Name,Case,MicroProbe,&C,0);
+      }
+    free(Mem);
+    }
+} /* MicroProbeAll() */
+
+/**************************************
+ MicroUsage()
+ **************************************/
+static void	MicroUsage	(const char *progname)
+{
+  printf("Usage: %s micro [options]\n",progname);
+  printf("  -h, --help          :: Show help; this usage\n");
+  printf("  --time ms           :: Minimum time per measurement (default: 100)\n");
+  printf("  --filter name       :: Only run benchmarks whose name contains this\n");
+  printf("  --warm              :: Skip the cold-cache measurements\n");
+  printf("\n");
+  printf("Output is JSON lines: one line per measurement.\n");
+} /* MicroUsage() */
+
+#pragma GCC visibility pop
+
+/**************************************
+ BenchMicro(): Run the microbenchmarks.
+ argv[0] is "micro".
+ **************************************/
+int	BenchMicro	(int argc, char *argv[])
+{
+  uint64_t Rng=0x5ea15ea1;
+  int c, long_option_index;
+
+  struct option long_options[] = {
+    {"help",      no_argument, NULL, 'h'},
+    {"time",      required_argument, NULL, 't'},
+    {"filter",    required_argument, NULL, 'f'},
+    {"warm",      no_argument, NULL, 'w'},
+    {NULL,0,NULL,0}
+    };
+  while ((c = getopt_long(argc,argv,"h?",long_options,&long_option_index)) != -1)
+    {
+    switch(c)
+      {
+      case 't': MicroMinNs = strtoull(optarg,NULL,10)*1000000ULL; break;
+      case 'f': MicroFilter=optarg; break;
+      case 'w': MicroCold=false; break;
+      case 'h': case '?': MicroUsage("sealbench"); exit(0);
+      default: MicroUsage("sealbench"); exit(0x80);
+      }
+    }
+  if (MicroMinNs < 1000000) { MicroMinNs=1000000; }
+
+  // Results go to stdout; warnings from the functions are discarded.
+  BenchOut = fdopen(dup(1),"w");
+  if (!BenchOut || !freopen("/dev/null","w",stdout))
+	{
+	fprintf(stderr,"ERROR: Cannot redirect microbenchmark output. Aborting.\n");
+	exit(0x80);
+	}
+  MicroClockNs = MicroClock();
+  fprintf(BenchOut,"{\"bench\":\"build\",\"version\":\"%s\",\"compiler\":\"%s\",\"clock_ns\":%lu,\"cold\":%s}\n",
+	SEAL_VERSION,__VERSION__,(unsigned long)MicroClockNs,MicroCold ? "true" : "false");
+
+  MicroParseAll(&Rng);
+  MicroChainAll();
+  MicroDigestAll(&Rng);
+  MicroCodecAll(&Rng);
+  MicroBytesAll(&Rng);
+  MicroWalkAll();
+  MicroProbeAll();
+
+  fclose(BenchOut);
+  return(0);
+} /* BenchMicro() */
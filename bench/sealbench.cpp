@@ -0,0 +1,564 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Benchmark for sealtool.
+ Build with: make bench
+
+ Generates deterministic synthetic files for each format, signs them
+ with a local key (0 to N signatures), and times verification with a
+ dnsfile (no network). Like real use, every record except the last is
+ signed with -O append, and the last one finalizes the file, so the
+ records cover the whole file. The same input always generates the same
+ files, so results from different builds can be compared.
+
+ With --dns, verification parses a synthesized DNS reply through
+ the replay resolver (see dns.cpp) instead of reading the dnsfile.
+ With --dns-replay, the replies come from a --dns-record file.
+ Either can add latency with --dns-latency; still no network.
+
+ Results are JSON lines on stdout; one object per measurement.
+ All times are the median over the iterations, in nanoseconds.
+ mb_s is the digested bytes (digest_bytes) per total time.
+
+ "sealbench micro" runs the microbenchmarks instead (see micro.cpp).
+ ************************************************/
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "seal.hpp"
+#include "files.hpp"
+#include "sign.hpp"
+#include "stats.hpp"
+#include "process.hpp"
+#include "dns.hpp"
+#include "bench.hpp"
+
+#define BENCHBUF (1024*1024)
+static byte BenchBuf[BENCHBUF+64];
+FILE *BenchOut=NULL;
+
+/**************************************
+ BenchRand(): splitmix64; deterministic and fast.
+ **************************************/
+uint64_t	BenchRand	(uint64_t *Rng)
+{
+  uint64_t z = (*Rng += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return(z ^ (z >> 31));
+} /* BenchRand() */
+
+/**************************************
+ BenchFill(): Fill a buffer with random bytes.
+ If Text, then use printable ASCII lines (no '<' since that
+ begins a SEAL record).
+ **************************************/
+void	BenchFill	(byte *Buf, size_t Len, uint64_t *Rng, bool Text)
+{
+  size_t i;
+  uint64_t r=0;
+  for(i=0; i < Len; i++)
+    {
+    if ((i % 8)==0) { r = BenchRand(Rng); }
+    Buf[i] = r & 0xff;
+    r >>= 8;
+    if (Text)
+      {
+      Buf[i] = ' ' + (Buf[i] % 95);
+      if (Buf[i]=='<') { Buf[i]='.'; }
+      if ((i % 80)==79) { Buf[i]='\n'; }
+      }
+    }
+} /* BenchFill() */
+
+/**************************************
+ BenchWriteRandom(): Write Len random bytes.
+ **************************************/
+static void	BenchWriteRandom	(FILE *Fout, uint64_t Len, uint64_t *Rng, bool Text)
+{
+  while(Len > 0)
+    {
+    size_t n = (Len > BENCHBUF) ? BENCHBUF : Len;
+    BenchFill(BenchBuf,n,Rng,Text);
+    SealFileWrite(Fout,n,BenchBuf);
+    Len -= n;
+    }
+} /* BenchWriteRandom() */
+
+/**************************************
+ BenchPNGchunk(): Write one PNG chunk with random data.
+ **************************************/
+static void	BenchPNGchunk	(FILE *Fout, const char *Type, uint32_t Len, const byte *Data, uint64_t *Rng)
+{
+  byte b[4];
+  writebe32(b,Len);
+  SealFileWrite(Fout,4,b);
+  memcpy(BenchBuf,Type,4);
+  if (Data) { memcpy(BenchBuf+4,Data,Len); }
+  else { BenchFill(BenchBuf+4,Len,Rng,false); }
+  SealFileWrite(Fout,Len+4,BenchBuf);
+  writebe32(b,_PNGCrc32(Len+4,BenchBuf));
+  SealFileWrite(Fout,4,b);
+} /* BenchPNGchunk() */
+
+/**************************************
+ BenchGenPNG(): Header, IHDR, IDAT chunks (up to 1M each), IEND.
+ **************************************/
+static void	BenchGenPNG	(FILE *Fout, uint64_t Size, uint64_t *Rng)
+{
+  const byte Ihdr[13] = {0,0,4,0, 0,0,4,0, 8,2,0,0,0}; // 1024x1024 RGB
+  uint64_t Left;
+  SealFileWrite(Fout,8,(byte*)"\x89PNG\r\n\x1a\n");
+  BenchPNGchunk(Fout,"IHDR",13,Ihdr,Rng);
+  Left = (Size > 57) ? Size-57 : 1;
+  while(Left > 0)
+    {
+    uint32_t n = (Left > BENCHBUF-12) ? BENCHBUF-12 : Left;
+    BenchPNGchunk(Fout,"IDAT",n,NULL,Rng);
+    Left -= (Left > (uint64_t)n+12) ? (uint64_t)n+12 : Left;
+    }
+  BenchPNGchunk(Fout,"IEND",0,NULL,Rng);
+} /* BenchGenPNG() */
+
+/**************************************
+ BenchGenJPEG(): SOI, APP0, SOS, entropy data, EOI.
+ The walker stops at SOS, so the entropy data is random
+ (without 0xff, so there are no markers).
+ **************************************/
+static void	BenchGenJPEG	(FILE *Fout, uint64_t Size, uint64_t *Rng)
+{
+  const byte Head[] = {
+	0xff,0xd8, // SOI
+	0xff,0xe0,0x00,0x10,'J','F','I','F',0,1,1,0,0,1,0,1,0,0, // APP0
+	0xff,0xda,0x00,0x08,0x01,0x01,0x00,0x00,0x3f,0x00 }; // SOS
+  uint64_t Left = (Size > sizeof(Head)+2) ? Size-sizeof(Head)-2 : 1;
+  SealFileWrite(Fout,sizeof(Head),(byte*)Head);
+  while(Left > 0)
+    {
+    size_t i, n = (Left > BENCHBUF) ? BENCHBUF : Left;
+    BenchFill(BenchBuf,n,Rng,false);
+    for(i=0; i < n; i++) { if (BenchBuf[i]==0xff) { BenchBuf[i]=0; } }
+    SealFileWrite(Fout,n,BenchBuf);
+    Left -= n;
+    }
+  SealFileWrite(Fout,2,(byte*)"\xff\xd9"); // EOI
+} /* BenchGenJPEG() */
+
+/**************************************
+ BenchGenWAV(): RIFF WAVE with fmt and data chunks.
+ **************************************/
+static void	BenchGenWAV	(FILE *Fout, uint64_t Size, uint64_t *Rng)
+{
+  byte Head[44];
+  uint32_t n = (Size > 44) ? (uint32_t)(Size-44) & ~1U : 2;
+  memcpy(Head,"RIFF",4); writele32(Head+4,n+36);
+  memcpy(Head+8,"WAVEfmt ",8); writele32(Head+16,16);
+  writele16(Head+20,1); writele16(Head+22,2); // PCM, stereo
+  writele32(Head+24,44100); writele32(Head+28,44100*4);
+  writele16(Head+32,4); writele16(Head+34,16);
+  memcpy(Head+36,"data",4); writele32(Head+40,n);
+  SealFileWrite(Fout,44,Head);
+  BenchWriteRandom(Fout,n,Rng,false);
+} /* BenchGenWAV() */
+
+/**************************************
+ BenchGenMP4(): ftyp and one mdat (64-bit size if needed).
+ **************************************/
+static void	BenchGenMP4	(FILE *Fout, uint64_t Size, uint64_t *Rng)
+{
+  byte Head[40];
+  uint64_t n = (Size > 36) ? Size-36 : 1;
+  writebe32(Head,20); memcpy(Head+4,"ftypisom",8);
+  writebe32(Head+12,0x200); memcpy(Head+16,"isom",4);
+  if (n+8 <= 0xffffffffULL)
+    {
+    writebe32(Head+20,n+8); memcpy(Head+24,"mdat",4);
+    SealFileWrite(Fout,28,Head);
+    }
+  else
+    {
+    writebe32(Head+20,1); memcpy(Head+24,"mdat",4);
+    writebe64(Head+28,n+16);
+    SealFileWrite(Fout,36,Head);
+    }
+  BenchWriteRandom(Fout,n,Rng,false);
+} /* BenchGenMP4() */
+
+/**************************************
+ BenchGenTIFF(): Little-endian TIFF; one IFD and one strip.
+ **************************************/
+static void	BenchGenTIFF	(FILE *Fout, uint64_t Size, uint64_t *Rng)
+{
+  const uint16_t Tags[6][2] = { {0x100,4}, {0x101,4}, {0x102,3}, {0x106,3}, {0x111,4}, {0x117,4} };
+  byte Head[86];
+  uint32_t n = (Size > 86) ? (uint32_t)(Size-86) : 1;
+  uint32_t Values[6] = { 1, n, 8, 1, 86, n }; // width, height, bits, photometric, offset, count
+  int i;
+  memcpy(Head,"II*\0",4); writele32(Head+4,8);
+  writele16(Head+8,6);
+  for(i=0; i < 6; i++)
+    {
+    byte *e = Head+10+i*12;
+    writele16(e,Tags[i][0]); writele16(e+2,Tags[i][1]);
+    writele32(e+4,1); writele32(e+8,Values[i]);
+    }
+  writele32(Head+82,0); // no next IFD
+  SealFileWrite(Fout,86,Head);
+  BenchWriteRandom(Fout,n,Rng,false);
+} /* BenchGenTIFF() */
+
+/**************************************
+ BenchGenPPM(): P6 with random pixels.
+ **************************************/
+static void	BenchGenPPM	(FILE *Fout, uint64_t Size, uint64_t *Rng)
+{
+  uint64_t W, H;
+  W = Size/3; if (W > 1024) { W=1024; } if (W < 1) { W=1; }
+  H = Size/(W*3); if (H < 1) { H=1; }
+  fprintf(Fout,"P6\n%lu %lu\n255\n",(unsigned long)W,(unsigned long)H);
+  BenchWriteRandom(Fout,W*H*3,Rng,false);
+} /* BenchGenPPM() */
+
+/**************************************
+ BenchGenText(): Printable ASCII lines.
+ **************************************/
+static void	BenchGenText	(FILE *Fout, uint64_t Size, uint64_t *Rng)
+{
+  BenchWriteRandom(Fout,Size,Rng,true);
+} /* BenchGenText() */
+
+const benchformat BenchFormats[] =
+  {
+  { "png", ".png", 0xffffffffffffULL, BenchGenPNG },
+  { "jpeg", ".jpg", 0xffffffffffffULL, BenchGenJPEG },
+  { "wav", ".wav", 0xfff00000ULL, BenchGenWAV },
+  { "mp4", ".mp4", 0xffffffffffffULL, BenchGenMP4 },
+  { "tiff", ".tif", 0xfff00000ULL, BenchGenTIFF },
+  { "ppm", ".ppm", 0xffffffffffffULL, BenchGenPPM },
+  { "text", ".txt", 0xffffffffffffULL, BenchGenText },
+  { NULL, NULL, 0, NULL }
+  };
+
+/**************************************
+ BenchSize(): Parse a size like "64K", "16M", "2G".
+ **************************************/
+uint64_t	BenchSize	(const char *Str)
+{
+  char *End;
+  uint64_t Size = strtoull(Str,&End,10);
+  switch(End[0])
+    {
+    case 'k': case 'K': Size <<= 10; break;
+    case 'm': case 'M': Size <<= 20; break;
+    case 'g': case 'G': Size <<= 30; break;
+    default: break;
+    }
+  return(Size);
+} /* BenchSize() */
+
+/**************************************
+ BenchInList(): Is Name a whole item in the comma-separated List?
+ **************************************/
+bool	BenchInList	(const char *List, const char *Name)
+{
+  const char *s = strstr(List,Name);
+  size_t Len = strlen(Name);
+  while(s && (((s > List) && (s[-1] != ',')) || (s[Len] && (s[Len] != ','))))
+    { s = strstr(s+1,Name); }
+  return(s != NULL);
+} /* BenchInList() */
+
+/**************************************
+ BenchCmp(): For sorting times.
+ **************************************/
+static int	BenchCmp	(const void *a, const void *b)
+{
+  uint64_t A = *(const uint64_t*)a, B = *(const uint64_t*)b;
+  return( (A < B) ? -1 : (A > B) );
+} /* BenchCmp() */
+
+/**************************************
+ BenchMedian(): Median of Len values (sorts in place).
+ **************************************/
+static uint64_t	BenchMedian	(uint64_t *Values, int Len)
+{
+  qsort(Values,Len,sizeof(uint64_t),BenchCmp);
+  return(Values[Len/2]);
+} /* BenchMedian() */
+
+/**************************************
+ BenchRun(): Process a file Iter times and report the median times.
+ **************************************/
+static bool	BenchRun	(const char *Bench, sealfield *Args, int Mode, const char *Filename,
+			 const char *Format, uint64_t Size, int Sigs, int Iter)
+{
+  static const char *Phase[StatPhases] =
+	{ "mmap", "detect", "walk", "parse", "dns", "digest", "verify", "sign", "write" };
+  uint64_t *Total, *PhaseNs[StatPhases], Bytes[StatPhases], Ns;
+  bool Ok=true;
+  int i,p;
+
+  Total = (uint64_t*)calloc(Iter,sizeof(uint64_t));
+  for(p=0; p < StatPhases; p++) { PhaseNs[p] = (uint64_t*)calloc(Iter,sizeof(uint64_t)); }
+  for(i=0; i < Iter; i++)
+    {
+    uint64_t One[StatPhases];
+    ReturnCode=0;
+    SealProcessFile(Args,Filename,Mode);
+    fflush(stdout);
+    // Verify: expect all valid; an unsigned file is only 0x02.
+    if (Mode=='v') { Ok = Ok && (ReturnCode == (Sigs ? 0 : 0x02)); }
+    else { Ok = Ok && !(ReturnCode & 0x01); }
+    if (!StatFileLast(&Ns,One,Bytes)) { Ok=false; break; }
+    Total[i] = Ns;
+    for(p=0; p < StatPhases; p++) { PhaseNs[p][i] = One[p]; }
+    }
+
+  Ns = BenchMedian(Total,Iter);
+  fprintf(BenchOut,"{\"bench\":\"%s\",\"format\":\"%s\",\"size\":%lu,\"sigs\":%d,\"iter\":%d,\"ok\":%s,\"total_ns\":%lu",
+	Bench,Format,(unsigned long)Size,Sigs,Iter,Ok?"true":"false",(unsigned long)Ns);
+  for(p=0; p < StatPhases; p++)
+    {
+    fprintf(BenchOut,",\"%s_ns\":%lu",Phase[p],(unsigned long)BenchMedian(PhaseNs[p],Iter));
+    free(PhaseNs[p]);
+    }
+  // Throughput is for the bytes that were hashed, not the file size.
+  // (Appended signatures only digest from the previous signature.)
+  fprintf(BenchOut,",\"digest_bytes\":%lu,\"mb_s\":%.1f}\n",
+	(unsigned long)Bytes[StatDigest],Ns ? (double)Bytes[StatDigest]*1000.0/(double)Ns : 0.0);
+  fflush(BenchOut);
+  free(Total);
+  return(Ok);
+} /* BenchRun() */
+
+/**************************************
+ BenchAppend(): Add an appending signature (not measured).
+ The next file's last record is signed from this one.
+ **************************************/
+static bool	BenchAppend	(sealfield *Args, const char *Infile, const char *Outfile)
+{
+  Args = SealSetText(Args,"outfile",Outfile);
+  ReturnCode=0;
+  SealProcessFile(Args,Infile,'s');
+  fflush(stdout);
+  return(!(ReturnCode & 0x01));
+} /* BenchAppend() */
+
+/**************************************
+ Usage()
+ **************************************/
+static void	Usage	(const char *progname)
+{
+  printf("Usage: %s [options]\n",progname);
+  printf("       %s micro [options]   (microbenchmarks; see: micro --help)\n",progname);
+  printf("  -h, --help          :: Show help; this usage\n");
+  printf("  --dir path          :: Work directory (default: new directory in /tmp)\n");
+  printf("  --keep              :: Keep the generated files\n");
+  printf("  --formats list      :: Comma-separated formats (default: all)\n");
+  printf("                         png, jpeg, wav, mp4, tiff, ppm, text\n");
+  printf("  --sizes list        :: Comma-separated sizes (default: 1K,64K,1M,16M)\n");
+  printf("                         Suffix K, M, or G. Several G needs disk space!\n");
+  printf("  --sigs N            :: Measure 0 to N signatures (default: 2)\n");
+  printf("  --iter N            :: Iterations per measurement (default: 5)\n");
+  printf("  -K, --keyalg alg    :: Key algorithm (rsa, ec; default: rsa)\n");
+  printf("  --dns               :: Verify through a synthesized DNS reply (default: dnsfile)\n");
+  printf("  --dns-replay file   :: Verify with DNS replies saved by: sealtool --dns-record\n");
+  printf("  --dns-latency ms    :: Delay each DNS reply; 'recorded' uses the saved times\n");
+  printf("\n");
+  printf("Output is JSON lines: one line per measurement.\n");
+} /* Usage() */
+
+/**************************************
+ main()
+ **************************************/
+int main (int argc, char *argv[])
+{
+  char DirTemplate[] = "/tmp/sealbench.XXXXXX";
+  const char *Dir=NULL, *Formats=NULL, *Sizes="1K,64K,1M,16M", *KeyAlg="rsa";
+  const char *DnsMode="dnsfile", *DnsReplay=NULL, *DnsLatency=NULL;
+  bool Keep=false, Ok=true;
+  int MaxSigs=2, Iter=5;
+  int c, long_option_index;
+  char Fname[PATH_MAX], Open[PATH_MAX], KeyFile[PATH_MAX], DnsFile[PATH_MAX];
+  sealfield *Args, *VerifyArgs, *SignArgs, *AppendArgs;
+
+  if ((argc > 1) && !strcmp(argv[1],"micro")) { return(BenchMicro(argc-1,argv+1)); }
+
+  struct option long_options[] = {
+    {"help",      no_argument, NULL, 'h'},
+    {"dir",       required_argument, NULL, 'd'},
+    {"keep",      no_argument, NULL, 'k'},
+    {"formats",   required_argument, NULL, 'f'},
+    {"sizes",     required_argument, NULL, 's'},
+    {"sigs",      required_argument, NULL, 'n'},
+    {"iter",      required_argument, NULL, 'i'},
+    {"keyalg",    required_argument, NULL, 'K'},
+    {"dns",       no_argument, NULL, 'D'},
+    {"dns-replay", required_argument, NULL, 'R'},
+    {"dns-latency", required_argument, NULL, 'L'},
+    {NULL,0,NULL,0}
+    };
+  while ((c = getopt_long(argc,argv,"hK:?",long_options,&long_option_index)) != -1)
+    {
+    switch(c)
+      {
+      case 'd': Dir=optarg; break;
+      case 'k': Keep=true; break;
+      case 'f': Formats=optarg; break;
+      case 's': Sizes=optarg; break;
+      case 'n': MaxSigs=atoi(optarg); break;
+      case 'i': Iter=atoi(optarg); break;
+      case 'K': KeyAlg=optarg; break;
+      case 'D': DnsMode="synthetic"; break;
+      case 'R': DnsMode="replay"; DnsReplay=optarg; break;
+      case 'L': DnsLatency=optarg; break;
+      case 'h': case '?': Usage(argv[0]); exit(0);
+      default: Usage(argv[0]); exit(0x80);
+      }
+    }
+  if (MaxSigs < 0) { MaxSigs=0; }
+  if (Iter < 1) { Iter=1; }
+
+  if (!Dir)
+    {
+    Dir = mkdtemp(DirTemplate);
+    if (!Dir)
+	{
+	fprintf(stderr,"ERROR: Cannot create work directory. Aborting.\n");
+	exit(0x80);
+	}
+    }
+  else { mkdir(Dir,0700); }
+
+  // Results go to stdout; everything sealtool prints is discarded.
+  BenchOut = fdopen(dup(1),"w");
+  if (!BenchOut || !freopen("/dev/null","w",stdout))
+	{
+	fprintf(stderr,"ERROR: Cannot redirect output. Aborting.\n");
+	exit(0x80);
+	}
+  StatsEnabled=true; // timing hooks; no report
+
+  // Generate keys
+  snprintf(KeyFile,PATH_MAX,"%s/bench-private.pem",Dir);
+  snprintf(DnsFile,PATH_MAX,"%s/bench-public.dns",Dir);
+  unlink(KeyFile);
+  unlink(DnsFile);
+  Args = SealArgsInit();
+  Args = SealSetText(Args,"keyalg",KeyAlg);
+  Args = SealSetText(Args,"keyfile",KeyFile);
+  Args = SealSetText(Args,"dnsfile",DnsFile);
+  Args = SealSetText(Args,"@genpass",""); // no password
+  Args = SealParmCheck(Args);
+  SealGenerateKeys(Args);
+
+  // Verify with the dnsfile; the last signature finalizes the file
+  VerifyArgs = SealClone(Args);
+  VerifyArgs = SealSetText(VerifyArgs,"Mode","verify");
+  SignArgs = SealClone(Args);
+  SignArgs = SealSignLocal(SignArgs); // sets @sigsize
+  SignArgs = SealSetCindex(SignArgs,"@mode",0,'s');
+  AppendArgs = SealClone(SignArgs);
+  AppendArgs = SealSetText(AppendArgs,"options","append");
+
+  // Verify through the replay resolver instead of the dnsfile
+  if (DnsReplay) { SealDNSReplayLoad(DnsReplay); }
+  else if (!strcmp(DnsMode,"synthetic"))
+    {
+    mmapfile *Mmap = MmapFile(DnsFile,PROT_READ);
+    byte Reply[16384];
+    int ReplyLen;
+    if (!Mmap)
+	{
+	fprintf(stderr,"ERROR: Cannot read the generated dnsfile. Aborting.\n");
+	exit(0x80);
+	}
+    sealfield *Txt = SealSetTextLen(NULL,"txt",Mmap->memsize,(const char*)Mmap->mem);
+    while((Txt->ValueLen > 0) && isspace(Txt->Value[Txt->ValueLen-1])) { Txt->ValueLen--; }
+    Txt->Value[Txt->ValueLen]='\0';
+    MmapFree(Mmap);
+    ReplyLen = SealDNSMakeTXT(SealGetText(Args,"domain"),(char*)Txt->Value,Reply,sizeof(Reply));
+    if (ReplyLen <= 0)
+	{
+	fprintf(stderr,"ERROR: Cannot synthesize the DNS reply. Aborting.\n");
+	exit(0x80);
+	}
+    SealDNSReplayAdd(SealGetText(Args,"domain"),Reply,ReplyLen,0);
+    SealFree(Txt);
+    }
+  if (DnsLatency) { SealDNSReplayLatency(DnsLatency); }
+  if (strcmp(DnsMode,"dnsfile")) { VerifyArgs = SealDel(VerifyArgs,"dnsfile"); }
+  SealFree(Args);
+
+  fprintf(BenchOut,"{\"bench\":\"build\",\"version\":\"%s\",\"compiler\":\"%s\",\"keyalg\":\"%s\",\"iter\":%d,\"dns\":\"%s\"}\n",
+	SEAL_VERSION,__VERSION__,KeyAlg,Iter,DnsMode);
+
+  for(int f=0; BenchFormats[f].Name; f++)
+    {
+    const benchformat *F = BenchFormats+f;
+    if (Formats && !BenchInList(Formats,F->Name)) { continue; }
+
+    for(const char *s=Sizes; s && *s; s=strchr(s,','), s=(s ? s+1 : NULL))
+      {
+      uint64_t Size = BenchSize(s);
+      uint64_t Rng = Size ^ ((uint64_t)f << 56); // deterministic per format and size
+      if (!Size) { continue; }
+      if (Size > F->MaxSize)
+	{
+	fprintf(stderr,"NOTE: %s does not support %lu bytes; skipped.\n",F->Name,(unsigned long)Size);
+	continue;
+	}
+
+      // Generate the unsigned file
+      snprintf(Fname,PATH_MAX,"%s/%s-%lu-s0%s",Dir,F->Name,(unsigned long)Size,F->Ext);
+      FILE *Fout = SealFileOpen(Fname,"wb");
+      F->Gen(Fout,Size,&Rng);
+      SealFileClose(Fout);
+
+      // Open has Sigs-1 appending signatures; Fname adds the final one
+      memcpy(Open,Fname,PATH_MAX);
+      for(int Sigs=0; Sigs <= MaxSigs; Sigs++)
+	{
+	if (Sigs > 0) // sign Open and finalize
+	  {
+	  snprintf(Fname,PATH_MAX,"%s/%s-%lu-s%d%s",Dir,F->Name,(unsigned long)Size,Sigs,F->Ext);
+	  SignArgs = SealSetText(SignArgs,"outfile",Fname);
+	  Ok &= BenchRun("sign",SignArgs,'s',Open,F->Name,Size,Sigs,1);
+	  }
+	Ok &= BenchRun("verify",VerifyArgs,'v',Fname,F->Name,Size,Sigs,Iter);
+	if (Sigs > 0 && !Keep) { unlink(Fname); }
+
+	if (Sigs < MaxSigs) // one more appending signature for the next file
+	  {
+	  char Prev[PATH_MAX];
+	  memcpy(Prev,Open,PATH_MAX);
+	  snprintf(Open,PATH_MAX,"%s/%s-%lu-a%d%s",Dir,F->Name,(unsigned long)Size,Sigs+1,F->Ext);
+	  Ok &= BenchAppend(AppendArgs,Prev,Open);
+	  if (!Keep) { unlink(Prev); }
+	  }
+	}
+      if (!Keep) { unlink(Open); }
+      }
+    }
+
+  if (!Keep)
+    {
+    unlink(KeyFile);
+    unlink(DnsFile);
+    rmdir(Dir);
+    }
+  SealFree(VerifyArgs);
+  SealFree(SignArgs);
+  SealFree(AppendArgs);
+  SealFreePrivateKey();
+  fclose(BenchOut);
+  return(Ok ? 0 : 1);
+} /* main() */
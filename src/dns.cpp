@@ -0,0 +1,611 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ DNS TXT resolvers.
+
+ SealGetDNS() asks SealDNSQuery() for the raw TXT reply.
+ The resolver that answers is pluggable:
+   system = res_nquery() (default)
+   record = another resolver, and every reply and its time
+            is appended to a file (--dns-record)
+   replay = replies from a recorded file; no network
+            (--dns-replay), with optional injected latency
+            (--dns-latency ms, or "recorded" for the recorded times)
+ Replay makes verification benchmarks repeatable offline.
+
+ Prefetch (--dns-prefetch N) resolves in the background with N
+ threads, using whichever resolver is selected. A scanner thread
+ reads ahead in the batch of files, runs SealParse() over each one,
+ and queues every d= that is not in the key store. By the time a
+ file is verified, its reply is usually waiting. Each domain is
+ queried once per run; SealDNSQuery() waits for a reply in flight,
+ or takes a queued domain and resolves it immediately.
+
+ The recorded file is text, one reply per line:
+   domain nanoseconds hex-reply
+ A failed query is recorded as "-" instead of hex.
+ If a domain is recorded more than once, the replies are
+ replayed in order; the last one repeats.
+ ************************************************/
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h> // strcasecmp
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <sys/stat.h>
+
+// DNS
+#include <netinet/in.h>
+#include <arpa/nameser.h>
+#include <resolv.h>
+
+#include "seal.hpp"
+#include "seal-parse.hpp"
+#include "files.hpp"
+#include "stats.hpp"
+#include "keystore.hpp"
+#include "dns.hpp"
+
+#if defined(__linux__) && !defined(__GLIBC__)
+static inline int res_ninit(res_state statp)
+{
+	int rc = res_init();
+	if (statp != &_res) { memcpy(statp, &_res, sizeof(*statp)); }
+	return rc;
+}
+
+static inline int res_nclose(res_state statp)
+{
+	if (!statp) { return -1; }
+	if (statp != &_res) { memset(statp, 0, sizeof(*statp)); }
+	return 0;
+}
+
+static inline int res_nquery(res_state statp,
+	          const char *dname, int nclass, int type,
+	          unsigned char *answer, int anslen)
+{
+	if (!statp) { return -1; }
+	return(res_query(dname, nclass, type, answer, anslen));
+}
+#endif
+
+#pragma GCC visibility push(hidden)
+
+static int	_DNSSystem	(const char *Domain, byte *Answer, int AnswerMax);
+static sealresolver DNSResolver = _DNSSystem;
+
+// Record
+static sealresolver DNSRecordNext=NULL; // the resolver being recorded
+static FILE *DNSRecordFout=NULL;
+static std::mutex DNSRecordLock;
+
+// Replay
+typedef struct
+  {
+  char *Domain;
+  byte *Answer;
+  int AnswerLen; // -1 = no reply
+  uint64_t Ns; // recorded time
+  bool Used;
+  } dnsreplay;
+static dnsreplay *DNSReplay=NULL;
+static size_t DNSReplayLen=0, DNSReplayMax=0;
+static int64_t DNSLatencyNs=0; // -1 = use the recorded time
+static std::mutex DNSReplayLock;
+
+// Prefetch
+#define DNS_SCAN_AHEAD 32 // files the scanner may read ahead
+typedef struct dnsprefetch
+  {
+  struct dnsprefetch *Next; // all domains
+  struct dnsprefetch *QNext; // queued domains
+  char *Domain;
+  byte *Answer;
+  int AnswerLen;
+  int State; // 0=queued, 1=resolving, 2=done
+  } dnsprefetch;
+static bool DNSPrefetchOn=false;
+static dnsprefetch *DNSPrefetch=NULL;
+static dnsprefetch *DNSQueueHead=NULL, *DNSQueueTail=NULL;
+static std::mutex DNSPrefetchLock;
+// Never destroyed: detached threads may still wait on them at exit.
+static std::condition_variable *DNSQueued = new std::condition_variable;
+static std::condition_variable *DNSResolved = new std::condition_variable;
+static std::condition_variable *DNSProgressed = new std::condition_variable;
+static std::atomic<int> DNSProgress(0); // file being verified
+
+/**************************************
+ _DNSSystem(): Query the system resolver.
+ **************************************/
+static int	_DNSSystem	(const char *Domain, byte *Answer, int AnswerMax)
+{
+  struct __res_state dnsstate;
+  int MsgMax;
+
+  memset(&dnsstate, 0, sizeof(dnsstate));
+  if (res_ninit(&dnsstate) < 0)
+    {
+    // Should never happen
+    fprintf(stderr," ERROR: Unable to initialize DNS lookup. Aborting.\n");
+    exit(0x80);
+    }
+  MsgMax = res_nquery(&dnsstate, Domain, C_IN, T_TXT, Answer, AnswerMax);
+  res_nclose(&dnsstate);
+  return( (MsgMax > 0) ? MsgMax : -1 );
+} /* _DNSSystem() */
+
+/**************************************
+ _DNSRecord(): Query the recorded resolver and save the reply.
+ **************************************/
+static int	_DNSRecord	(const char *Domain, byte *Answer, int AnswerMax)
+{
+  uint64_t Ns;
+  int Len, i;
+
+  Ns = StatNow();
+  Len = DNSRecordNext(Domain,Answer,AnswerMax);
+  Ns = StatNow() - Ns;
+
+  std::lock_guard<std::mutex> Lock(DNSRecordLock);
+  fprintf(DNSRecordFout,"%s %lu ",Domain,(unsigned long)Ns);
+  if (Len <= 0) { fputc('-',DNSRecordFout); }
+  for(i=0; i < Len; i++) { fprintf(DNSRecordFout,"%02x",Answer[i]); }
+  fputc('\n',DNSRecordFout);
+  fflush(DNSRecordFout);
+  return(Len);
+} /* _DNSRecord() */
+
+/**************************************
+ _DNSReplay(): Return a recorded reply.
+ **************************************/
+static int	_DNSReplay	(const char *Domain, byte *Answer, int AnswerMax)
+{
+  dnsreplay *R=NULL;
+  int64_t Ns;
+  size_t i;
+  int Len;
+
+  {
+  std::lock_guard<std::mutex> Lock(DNSReplayLock);
+  for(i=0; i < DNSReplayLen; i++)
+    {
+    if (strcasecmp(DNSReplay[i].Domain,Domain)) { continue; }
+    R = DNSReplay+i; // the last match repeats
+    if (!R->Used) { break; }
+    }
+  if (R) { R->Used=true; }
+  }
+
+  if (!R)
+    {
+    fprintf(stderr,"WARNING: No recorded DNS reply for '%s'.\n",Domain);
+    return(-1);
+    }
+
+  Ns = (DNSLatencyNs < 0) ? (int64_t)R->Ns : DNSLatencyNs;
+  if (Ns > 0)
+    {
+    struct timespec ts;
+    ts.tv_sec = Ns / 1000000000;
+    ts.tv_nsec = Ns % 1000000000;
+    while(nanosleep(&ts,&ts) && (errno == EINTR)) { ; }
+    }
+
+  if (R->AnswerLen <= 0) { return(-1); }
+  Len = Min(R->AnswerLen,AnswerMax);
+  memcpy(Answer,R->Answer,Len);
+  return(Len);
+} /* _DNSReplay() */
+
+/**************************************
+ _DNSPrefetchFind(): Find a prefetched domain.
+ Caller must hold DNSPrefetchLock.
+ **************************************/
+static dnsprefetch *	_DNSPrefetchFind	(const char *Domain)
+{
+  dnsprefetch *P;
+  for(P=DNSPrefetch; P; P=P->Next)
+    {
+    if (!strcasecmp(P->Domain,Domain)) { return(P); }
+    }
+  return(NULL);
+} /* _DNSPrefetchFind() */
+
+/**************************************
+ _DNSPrefetchResolve(): Resolve a domain and store the reply.
+ Caller must hold the lock (L); it is released while resolving.
+ **************************************/
+static void	_DNSPrefetchResolve	(dnsprefetch *P, std::unique_lock<std::mutex> &L)
+{
+  byte Buffer[16384];
+  int Len;
+
+  P->State=1;
+  L.unlock();
+  Len = DNSResolver(P->Domain,Buffer,sizeof(Buffer)-1);
+  L.lock();
+  if (Len > 0)
+    {
+    P->Answer = (byte*)malloc(Len);
+    memcpy(P->Answer,Buffer,Len);
+    }
+  P->AnswerLen = Len;
+  P->State=2;
+  DNSResolved->notify_all();
+} /* _DNSPrefetchResolve() */
+
+/**************************************
+ _DNSPrefetchWorker(): Resolve queued domains.
+ **************************************/
+static void	_DNSPrefetchWorker	()
+{
+  dnsprefetch *P;
+
+  StatThreadIgnore();
+  std::unique_lock<std::mutex> L(DNSPrefetchLock);
+  for(;;)
+    {
+    DNSQueued->wait(L,[]{ return(DNSQueueHead != NULL); });
+    P = DNSQueueHead;
+    DNSQueueHead = P->QNext;
+    if (!DNSQueueHead) { DNSQueueTail=NULL; }
+    _DNSPrefetchResolve(P,L);
+    }
+} /* _DNSPrefetchWorker() */
+
+/**************************************
+ _DNSPrefetchScan(): Read ahead in the files and queue every domain.
+ **************************************/
+static void	_DNSPrefetchScan	(int Count, char **Files)
+{
+  struct stat Stat;
+  mmapfile *Mmap;
+  sealfield *Rec, *Key;
+  size_t Start, RecEnd;
+  const char *d;
+  int i;
+
+  StatThreadIgnore();
+  for(i=0; i < Count; i++)
+    {
+    // Stay close to the file being verified
+    {
+    std::unique_lock<std::mutex> L(DNSPrefetchLock);
+    DNSProgressed->wait(L,[i]{ return(i < DNSProgress + DNS_SCAN_AHEAD); });
+    }
+
+    // Unreadable files are reported by the verifier, not here
+    if (access(Files[i],R_OK) || stat(Files[i],&Stat) || !S_ISREG(Stat.st_mode)) { continue; }
+    Mmap = MmapFile(Files[i],PROT_READ);
+    if (!Mmap) { continue; }
+    for(Start=0; Start < Mmap->memsize; Start += RecEnd)
+      {
+      Rec = SealParse(Mmap->memsize-Start,Mmap->mem+Start,Start,NULL);
+      if (!Rec) { break; }
+      RecEnd = SealGetIindex(Rec,"@RecEnd",0);
+      if (RecEnd <= 0) { RecEnd=1; }
+
+      // Same defaults as SealGetDNS()
+      if (!SealSearch(Rec,"uid")) { Rec=SealSetText(Rec,"uid",""); }
+      if (!SealSearch(Rec,"kv")) { Rec=SealSetText(Rec,"kv","1"); }
+      Key = SealKeystoreGet(Rec);
+      if (Key) { Rec=Key; } // no DNS needed
+      else
+	{
+	d = SealGetText(Rec,"d");
+	if (d && d[0]) { SealDNSPrefetch(d); }
+	}
+      SealFree(Rec);
+      }
+    MmapFree(Mmap);
+    }
+} /* _DNSPrefetchScan() */
+
+#pragma GCC visibility pop
+
+/**************************************
+ SealDNSSetResolver(): Change the resolver.
+ Returns the previous resolver (for wrapping it).
+ **************************************/
+sealresolver	SealDNSSetResolver	(sealresolver Resolver)
+{
+  sealresolver Old = DNSResolver;
+  DNSResolver = (Resolver ? Resolver : _DNSSystem);
+  return(Old);
+} /* SealDNSSetResolver() */
+
+/**************************************
+ SealDNSQuery(): Get the raw TXT reply for a domain.
+ Returns: reply length, or -1 if no reply.
+ **************************************/
+int	SealDNSQuery	(const char *Domain, byte *Answer, int AnswerMax)
+{
+  dnsprefetch *P, *Q;
+
+  if (!DNSPrefetchOn) { return(DNSResolver(Domain,Answer,AnswerMax)); }
+
+  std::unique_lock<std::mutex> L(DNSPrefetchLock);
+  P = _DNSPrefetchFind(Domain);
+  if (!P) // not seen by the scanner
+    {
+    P = (dnsprefetch*)calloc(1,sizeof(dnsprefetch));
+    P->Domain = strdup(Domain);
+    P->Next = DNSPrefetch;
+    DNSPrefetch = P;
+    _DNSPrefetchResolve(P,L);
+    }
+  else if (P->State==0) // queued: don't wait behind the others
+    {
+    if (DNSQueueHead==P) { DNSQueueHead=P->QNext; }
+    else
+      {
+      for(Q=DNSQueueHead; Q->QNext != P; Q=Q->QNext) { ; }
+      Q->QNext = P->QNext;
+      if (DNSQueueTail==P) { DNSQueueTail=Q; }
+      }
+    if (!DNSQueueHead) { DNSQueueTail=NULL; }
+    _DNSPrefetchResolve(P,L);
+    }
+  else { DNSResolved->wait(L,[P]{ return(P->State==2); }); }
+
+  if (P->AnswerLen <= 0) { return(-1); }
+  memcpy(Answer,P->Answer,Min(P->AnswerLen,AnswerMax));
+  return(Min(P->AnswerLen,AnswerMax));
+} /* SealDNSQuery() */
+
+/**************************************
+ SealDNSPrefetchStart(): Start the prefetch threads.
+ **************************************/
+void	SealDNSPrefetchStart	(int Threads)
+{
+  int i;
+  if (DNSPrefetchOn) { return; } // already started
+  DNSPrefetchOn=true;
+  for(i=0; i < Threads; i++) { std::thread(_DNSPrefetchWorker).detach(); }
+} /* SealDNSPrefetchStart() */
+
+/**************************************
+ SealDNSPrefetch(): Queue a domain for resolving.
+ Does nothing if prefetch is off or the domain was seen.
+ **************************************/
+void	SealDNSPrefetch	(const char *Domain)
+{
+  dnsprefetch *P;
+
+  if (!DNSPrefetchOn || !Domain || !Domain[0]) { return; }
+  std::lock_guard<std::mutex> L(DNSPrefetchLock);
+  if (_DNSPrefetchFind(Domain)) { return; }
+  P = (dnsprefetch*)calloc(1,sizeof(dnsprefetch));
+  P->Domain = strdup(Domain);
+  P->Next = DNSPrefetch;
+  DNSPrefetch = P;
+  if (DNSQueueTail) { DNSQueueTail->QNext = P; }
+  else { DNSQueueHead = P; }
+  DNSQueueTail = P;
+  DNSQueued->notify_one();
+} /* SealDNSPrefetch() */
+
+/**************************************
+ SealDNSPrefetchFiles(): Scan the batch of files in the background.
+ Files must remain allocated (e.g., argv).
+ **************************************/
+void	SealDNSPrefetchFiles	(int Count, char **Files)
+{
+  if (!DNSPrefetchOn || (Count < 1)) { return; }
+  std::thread(_DNSPrefetchScan,Count,Files).detach();
+} /* SealDNSPrefetchFiles() */
+
+/**************************************
+ SealDNSPrefetchProgress(): Tell the scanner which file is being verified.
+ **************************************/
+void	SealDNSPrefetchProgress	(int Index)
+{
+  if (!DNSPrefetchOn) { return; }
+  {
+  std::lock_guard<std::mutex> L(DNSPrefetchLock);
+  DNSProgress = Index;
+  }
+  DNSProgressed->notify_all();
+} /* SealDNSPrefetchProgress() */
+
+/**************************************
+ SealDNSReplayAdd(): Add a reply and use the replay resolver.
+ AnswerLen is -1 for no reply. Ns is the recorded time.
+ **************************************/
+void	SealDNSReplayAdd	(const char *Domain, const byte *Answer, int AnswerLen, uint64_t Ns)
+{
+  dnsreplay *R;
+
+  std::lock_guard<std::mutex> Lock(DNSReplayLock);
+  if (DNSReplayLen >= DNSReplayMax)
+    {
+    DNSReplayMax += 64;
+    DNSReplay = (dnsreplay*)realloc(DNSReplay,DNSReplayMax*sizeof(dnsreplay));
+    }
+  R = DNSReplay + DNSReplayLen;
+  DNSReplayLen++;
+  memset(R,0,sizeof(dnsreplay));
+  R->Domain = strdup(Domain);
+  R->AnswerLen = -1;
+  if (Answer && (AnswerLen > 0))
+    {
+    R->Answer = (byte*)malloc(AnswerLen);
+    memcpy(R->Answer,Answer,AnswerLen);
+    R->AnswerLen = AnswerLen;
+    }
+  R->Ns = Ns;
+  DNSResolver = _DNSReplay;
+} /* SealDNSReplayAdd() */
+
+/**************************************
+ SealDNSReplayLoad(): Load recorded replies and replay them.
+ The replay resolver is used even if the file has no replies,
+ so nothing falls back to the network.
+ **************************************/
+void	SealDNSReplayLoad	(const char *Filename)
+{
+  FILE *Fin;
+  char *Line=NULL;
+  size_t LineMax=0;
+  ssize_t LineLen;
+  int LineNum=0;
+
+  Fin = fopen(Filename,"rb");
+  if (!Fin)
+	{
+	fprintf(stderr,"ERROR: Cannot open DNS replay file (%s). Aborting.\n",Filename);
+	exit(0x80);
+	}
+
+  while((LineLen = getline(&Line,&LineMax,Fin)) >= 0)
+    {
+    char *Domain, *Ns, *Hex, *Save=NULL;
+    LineNum++;
+    if ((LineLen==0) || (Line[0]=='#') || (Line[0]=='\n')) { continue; }
+    Domain = strtok_r(Line," \t\r\n",&Save);
+    Ns = strtok_r(NULL," \t\r\n",&Save);
+    Hex = strtok_r(NULL," \t\r\n",&Save);
+    if (!Domain || !Ns || !Hex || !isdigit(Ns[0]))
+	{
+	fprintf(stderr,"ERROR: Invalid DNS replay file (%s), line %d. Aborting.\n",Filename,LineNum);
+	exit(0x80);
+	}
+
+    if (!strcmp(Hex,"-")) // no reply
+	{
+	SealDNSReplayAdd(Domain,NULL,-1,strtoull(Ns,NULL,10));
+	continue;
+	}
+
+    sealfield *Reply = SealSetText(NULL,"r",Hex);
+    SealHexDecode(Reply);
+    if (!Reply->ValueLen)
+	{
+	fprintf(stderr,"ERROR: Invalid DNS reply in replay file (%s), line %d. Aborting.\n",Filename,LineNum);
+	exit(0x80);
+	}
+    SealDNSReplayAdd(Domain,Reply->Value,Reply->ValueLen,strtoull(Ns,NULL,10));
+    SealFree(Reply);
+    }
+  free(Line);
+  fclose(Fin);
+
+  std::lock_guard<std::mutex> Lock(DNSReplayLock);
+  DNSResolver = _DNSReplay;
+} /* SealDNSReplayLoad() */
+
+/**************************************
+ SealDNSReplayLatency(): Set the injected latency for replays.
+ Latency is in milliseconds, or "recorded" for the recorded times.
+ **************************************/
+void	SealDNSReplayLatency	(const char *Latency)
+{
+  if (!Latency || !Latency[0]) { DNSLatencyNs=0; }
+  else if (!strcmp(Latency,"recorded")) { DNSLatencyNs=-1; }
+  else { DNSLatencyNs = (int64_t)(atof(Latency)*1000000.0); }
+  if (DNSLatencyNs < -1) { DNSLatencyNs=0; }
+} /* SealDNSReplayLatency() */
+
+/**************************************
+ SealDNSMakeTXT(): Build a DNS reply with one TXT answer.
+ For synthetic replays (e.g., benchmarks).
+ Returns: reply length, or -1 if it does not fit.
+ **************************************/
+int	SealDNSMakeTXT	(const char *Domain, const char *Txt, byte *Answer, int AnswerMax)
+{
+  const byte Header[12] = { 0x5e,0xa1, 0x81,0x80, 0,1, 0,1, 0,0, 0,0 }; // 1 question, 1 answer
+  size_t TxtLen = strlen(Txt);
+  size_t Need = 12 + strlen(Domain)+2 + 4 + 12 + TxtLen + TxtLen/255 + 1;
+  const char *s, *Dot;
+  int n, RdLen;
+
+  if (Need > (size_t)AnswerMax) { return(-1); }
+  memcpy(Answer,Header,12);
+  n=12;
+
+  // Question: labels, type TXT, class IN
+  for(s=Domain; *s; s = (*Dot ? Dot+1 : Dot))
+    {
+    Dot = strchr(s,'.');
+    if (!Dot) { Dot = s+strlen(s); }
+    if ((Dot-s < 1) || (Dot-s > 63)) { return(-1); } // invalid label
+    Answer[n++] = Dot-s;
+    memcpy(Answer+n,s,Dot-s);
+    n += Dot-s;
+    }
+  Answer[n++]=0;
+  writebe16(Answer+n,ns_t_txt); n+=2;
+  writebe16(Answer+n,ns_c_in); n+=2;
+
+  // Answer: pointer to the question's name, TXT, IN, TTL, data
+  Answer[n++]=0xc0; Answer[n++]=12;
+  writebe16(Answer+n,ns_t_txt); n+=2;
+  writebe16(Answer+n,ns_c_in); n+=2;
+  writebe32(Answer+n,300); n+=4;
+  RdLen = TxtLen + TxtLen/255 + 1; // 255-byte strings
+  writebe16(Answer+n,RdLen); n+=2;
+  for(s=Txt; ; )
+    {
+    size_t Len = Min(strlen(s),(size_t)255);
+    Answer[n++] = Len;
+    memcpy(Answer+n,s,Len);
+    n += Len; s += Len;
+    if (Len < 255) { break; }
+    }
+  return(n);
+} /* SealDNSMakeTXT() */
+
+/**************************************
+ SealDNSInit(): Select the resolver from the arguments.
+ **************************************/
+void	SealDNSInit	(sealfield *Args)
+{
+  const char *Record = SealGetText(Args,"dns-record");
+  const char *Replay = SealGetText(Args,"dns-replay");
+
+  if (Record && Replay)
+	{
+	fprintf(stderr,"ERROR: Use --dns-record or --dns-replay, not both. Aborting.\n");
+	exit(0x80);
+	}
+
+  if (Replay) { SealDNSReplayLoad(Replay); }
+  if (SealSearch(Args,"dns-latency"))
+	{
+	if (!Replay) { printf(" WARNING: --dns-latency only applies to --dns-replay.\n"); }
+	SealDNSReplayLatency(SealGetText(Args,"dns-latency"));
+	}
+
+  if (Record)
+	{
+	DNSRecordFout = fopen(Record,"wb");
+	if (!DNSRecordFout)
+	  {
+	  fprintf(stderr,"ERROR: Cannot create DNS record file (%s). Aborting.\n",Record);
+	  exit(0x80);
+	  }
+	fprintf(DNSRecordFout,"# SEAL DNS replies: domain nanoseconds hex-reply\n");
+	fflush(DNSRecordFout);
+	DNSRecordNext = SealDNSSetResolver(_DNSRecord);
+	}
+
+  if (SealSearch(Args,"dns-prefetch"))
+	{
+	int Threads = atoi(SealGetText(Args,"dns-prefetch"));
+	if (Threads < 1) { Threads=1; }
+	if (Threads > 64) { Threads=64; }
+	const char *DnsFile = SealGetText(Args,"dnsfile");
+	if (DnsFile && DnsFile[0]) { printf(" WARNING: --dns-prefetch is not used with --dnsfile.\n"); }
+	else { SealDNSPrefetchStart(Threads); }
+	}
+} /* SealDNSInit() */
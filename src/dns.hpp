@@ -0,0 +1,41 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ DNS TXT resolvers: system, record, and replay.
+ ************************************************/
+#ifndef DNS_HPP
+#define DNS_HPP
+
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "seal.hpp"
+
+/*****
+ A resolver returns the raw DNS reply (wire format) for a TXT
+ query, like res_nquery(). Returns the reply length, or -1 if
+ there is no reply.
+ *****/
+typedef int (*sealresolver)(const char *Domain, byte *Answer, int AnswerMax);
+
+void	SealDNSInit	(sealfield *Args);
+sealresolver	SealDNSSetResolver	(sealresolver Resolver);
+int	SealDNSQuery	(const char *Domain, byte *Answer, int AnswerMax);
+
+// Prefetch
+void	SealDNSPrefetchStart	(int Threads);
+void	SealDNSPrefetch	(const char *Domain);
+void	SealDNSPrefetchFiles	(int Count, char **Files);
+void	SealDNSPrefetchProgress	(int Index);
+
+// Replay
+void	SealDNSReplayLoad	(const char *Filename);
+void	SealDNSReplayAdd	(const char *Domain, const byte *Answer, int AnswerLen, uint64_t Ns);
+void	SealDNSReplayLatency	(const char *Latency);
+int	SealDNSMakeTXT	(const char *Domain, const char *Txt, byte *Answer, int AnswerMax);
+
+#endif
@@ -224,6 +224,45 @@ void	SealFileWrite   (FILE *Fout, size_t Len, byte *Data)
     }
 } /* SealFileWrite() */
 
+/**************************************
+ SealFileWritev(): Write a list of buffers to a file.
+ Uses one writev() for all buffers instead of one write per buffer.
+ Iov is modified (consumed) as data is written.
+ Abort on failure.
+ **************************************/
+void	SealFileWritev   (FILE *Fout, int IovCount, struct iovec *Iov)
+{
+  ssize_t w;
+  int fd;
+
+  fflush(Fout); // don't mix stdio buffers and direct writes
+  fd = fileno(Fout);
+  while(IovCount > 0)
+    {
+    // Skip empty buffers
+    if (Iov[0].iov_len == 0) { Iov++; IovCount--; continue; }
+
+    w = writev(fd, Iov, Min(IovCount,IOV_MAX));
+    if (w <= 0)
+      {
+      fprintf(stderr," ERROR: Failed to write vector to file. Aborting.\n");
+      exit(0x80);
+      }
+
+    // Consume what was written (partial writes are permitted)
+    while((IovCount > 0) && ((size_t)w >= Iov[0].iov_len))
+      {
+      w -= Iov[0].iov_len;
+      Iov++; IovCount--;
+      }
+    if (IovCount > 0)
+      {
+      Iov[0].iov_base = (byte*)Iov[0].iov_base + w;
+      Iov[0].iov_len -= w;
+      }
+    }
+} /* SealFileWritev() */
+
 /**************************************
  MmapFile(): memory map the file for quick access.
  Used for rapidly computing checksums, scanning, and
@@ -292,13 +331,37 @@ mmapfile *	MmapFile	(const char *Filename, int Prot)
 } /* MmapFile() */
 
 /**************************************
- MmapFree(): Free memory map from MmapFile.
+ MmapMem(): Wrap memory as a writable mmapfile.
+ Used for signing in memory (no file).
+ The memory is borrowed; MmapFree() does not release it.
+ Returns: mmapfile*.
+ **************************************/
+mmapfile *	MmapMem	(byte *Mem, size_t MemSize)
+{
+  mmapfile *Mmap;
+
+  Mmap = (mmapfile*)calloc(sizeof(mmapfile),1);
+  if (!Mmap) // should never happen
+    {
+    fprintf(stderr," ERROR: Cannot allocate memory mmap structure\n");
+    exit(0x80);
+    }
+  Mmap->mem = Mem;
+  Mmap->memsize = MemSize;
+  return(Mmap);
+} /* MmapMem() */
+
+/**************************************
+ MmapFree(): Free memory map from MmapFile or MmapMem.
  **************************************/
 void	MmapFree	(mmapfile *Mmap)
 {
   if (!Mmap) { return; }
-  munmap(Mmap->mem,Mmap->memsize);
-  fclose(Mmap->fp);
+  if (Mmap->fp) // MmapMem has no file and does not own the memory
+    {
+    munmap(Mmap->mem,Mmap->memsize);
+    fclose(Mmap->fp);
+    }
   free(Mmap);
 } /* MmapFree() */
 
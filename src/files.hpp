@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <sys/uio.h> // struct iovec
 
 #include "seal.hpp"
 
@@ -37,6 +38,7 @@ bool	CopyFile	(const char *dst, const char *src);
 FILE *	SealFileOpen	(const char *fname, const char *mode);
 #define SealFileClose(x)	fclose(x)
 void	SealFileWrite	(FILE *Fout, size_t Len, byte *Data);
+void	SealFileWritev	(FILE *Fout, int IovCount, struct iovec *Iov);
 
 #ifndef PROT_NONE
 #define PROT_NONE       0
@@ -44,6 +46,7 @@ void	SealFileWrite	(FILE *Fout, size_t Len, byte *Data);
 #define PROT_WRITE      2
 #endif
 mmapfile *	MmapFile	(const char *Filename, int Prot);
+mmapfile *	MmapMem	(byte *Mem, size_t MemSize);
 void	MmapFree	(mmapfile *Mmap);
 
 #endif
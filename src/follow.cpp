@@ -0,0 +1,701 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Rolling signatures for growing files (--follow).
+
+ This is option (C) in NOTES.txt: compute as you go and append
+ the signature. It is for live recordings and logs that are still
+ being written: Text, MPEG, AAC, and Matroska.
+
+ The input file is never modified; another program owns it.
+ The new bytes are copied to the output file (-o) as they arrive,
+ and hashed once as they are written. Every --follow-seconds
+ (or --follow-bytes), a SEAL record is appended to the output.
+ Each record covers from the previous signature to its own:
+   First record: b=F~S,s~s+3
+   Next records: b=P~S,s~s+3
+   Last record:  b=P~S,s~f  (when following stops)
+ The records overlap at the previous signature, like -O append,
+ so every record stays valid as the file grows and the last one
+ finalizes it. The digest context stays open between records;
+ the CPU cost per byte is constant, no matter how long it runs.
+
+ Records are only inserted where the format permits them:
+   Text: after a complete line.
+   MPEG: program streams (starting with a pack header) are walked
+     by pack and PES lengths; records go before a pack header.
+     Raw MP3 is walked by frame lengths; records go between frames.
+     (A start code or frame sync inside a packet is only data.)
+     Other MPEG streams (e.g., elementary video) have no safe
+     point inside; they are only signed when following stops.
+   AAC: after a complete ADTS frame.
+   Matroska: after a complete element. Live recordings use an
+     unknown-sized Segment and Clusters; records go between their
+     children. (A known-sized element cannot grow.)
+ Bytes after the last safe point wait for the next read.
+ When following stops, an incomplete AAC frame or Matroska element
+ is written after the last record (covered by its s~f range).
+
+ Following stops on SIGINT/SIGTERM, when the file is moved or
+ deleted (e.g., log rotation), when it shrinks, or after
+ --follow-idle seconds without new data.
+ Changes are seen with inotify (where available), otherwise by
+ polling once a second.
+ ************************************************/
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef __linux__
+  #include <sys/inotify.h>
+#endif
+
+#include "seal.hpp"
+#include "files.hpp"
+#include "sign.hpp"
+#include "process.hpp"
+#include "follow.hpp"
+
+// For openssl 3.x
+#include <openssl/evp.h>
+
+#pragma GCC visibility push(hidden)
+
+#define FOLLOW_READ (4*1024*1024) // most bytes to read before writing
+
+static volatile sig_atomic_t FollowStop=0;
+
+typedef struct
+  {
+  int Format; // file format code: 'x', 'a', 'A', or 'M'
+  int Mpeg; // MPEG kind: 'P'=program stream, 'm'=MP3 frames, 'e'=other (no safe point)
+  const char *Eol; // text: "\n" or "\r\n"
+  byte *Pending; // read from the input but not yet written
+  size_t PendingLen, PendingMax;
+  uint64_t InOffset; // bytes read from the input
+  uint64_t OutOffset; // bytes written to the output
+  uint64_t Since; // bytes written since the last record
+  byte Last; // last byte written
+  FILE *Fout;
+  EVP_MD_CTX *Ctx; // digest from the start of the current range
+  const EVP_MD *Md;
+  } followfile;
+
+/**************************************
+ _FollowSignal(): Stop following.
+ **************************************/
+static void	_FollowSignal	(int Sig)
+{
+  (void)Sig;
+  FollowStop=1;
+} /* _FollowSignal() */
+
+/**************************************
+ _FollowNow(): Monotonic time in milliseconds.
+ **************************************/
+static uint64_t	_FollowNow	()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return((uint64_t)ts.tv_sec*1000 + ts.tv_nsec/1000000);
+} /* _FollowNow() */
+
+/**************************************
+ _FollowMP3frame(): Return the length of the MP3 frame, or 0.
+ Same header checks as Seal_isMPEG() (layer 3 only).
+ **************************************/
+static size_t	_FollowMP3frame	(uint32_t u32)
+{
+  // Layer 3 bitrates (kbps) and sample rates (Hz)
+  static const int Rate1[16] = { 0,32,40,48,56,64,80,96,112,128,160,192,224,256,320,0 }; // MPEG-1
+  static const int Rate2[16] = { 0,8,16,24,32,40,48,56,64,80,96,112,128,144,160,0 }; // MPEG-2 and 2.5
+  static const int Freq[4][3] =
+	{
+	{ 11025,12000,8000 }, // MPEG-2.5
+	{ 0,0,0 }, // reserved
+	{ 22050,24000,16000 }, // MPEG-2
+	{ 44100,48000,32000 } // MPEG-1
+	};
+  int Version, Bitrate, Hz, Pad;
+
+  if ((u32&0xffe00000)!=0xffe00000) { return(0); }
+  if (((u32 & 0x180000) == 0x080000) || // 01 is a reserved version ID
+      ((u32 & 0x060000) == 0x000000) || // 00 is a reserved layer description
+      ((u32 & 0x00f000) == 0x000000) || // 0000 is the "free" bitrate index
+      ((u32 & 0x00f000) == 0x00f000) || // 1111 is a bad bitrate index
+      ((u32 & 0x000c00) == 0x000c00) || // 11 is a reserved sampling frequency
+      ((u32 & 0x000003) == 0x000002) || // 10 is a reserved emphasis
+      ((u32 & 0x060000) != 0x020000))   // layer 3 for mp3
+	{ return(0); }
+
+  Version = (u32 >> 19) & 0x03;
+  Bitrate = ((Version==3) ? Rate1 : Rate2)[(u32 >> 12) & 0x0f] * 1000;
+  Hz = Freq[Version][(u32 >> 10) & 0x03];
+  Pad = (u32 >> 9) & 0x01;
+  return(((Version==3) ? 144 : 72) * Bitrate / Hz + Pad);
+} /* _FollowMP3frame() */
+
+/**************************************
+ _FollowMPEGkind(): Which kind of MPEG stream is this?
+ The first pack header, MP3 frame (or ID3), or start code decides.
+ Returns: 'P' (program stream), 'm' (MP3), or 'e' (other).
+ **************************************/
+static int	_FollowMPEGkind	(const byte *Data, size_t Len)
+{
+  size_t i;
+  for(i=0; i+4 <= Len; i++)
+    {
+    uint32_t u32 = (uint32_t)readbe32(Data+i);
+    if (u32 == 0x000001ba) { return('P'); }
+    if (!memcmp(Data+i,"ID3",3) || _FollowMP3frame(u32)) { return('m'); }
+    if ((u32 & 0xffffff00) == 0x00000100) { return('e'); }
+    }
+  return('e');
+} /* _FollowMPEGkind() */
+
+/**************************************
+ _FollowMPEGcut(): How many pending MPEG bytes can be written?
+ Pending always starts where the last write stopped (a safe point).
+ Program streams: before the last pack header.
+ MP3: after the last complete frame (or ID3 tag).
+ Unknown bytes are skipped one at a time until the stream resyncs.
+ **************************************/
+static size_t	_FollowMPEGcut	(followfile *F)
+{
+  const byte *Data = F->Pending;
+  size_t Len = F->PendingLen;
+  size_t i=0, Size, Cut=0;
+  uint32_t u32;
+
+  switch(F->Mpeg)
+    {
+    case 'P': // pack header, system header, and PES packets
+      while(i+4 <= Len)
+	{
+	u32 = (uint32_t)readbe32(Data+i);
+	if (u32 == 0x000001ba) // pack header
+	  {
+	  if (i+5 > Len) { Cut=i; break; }
+	  if ((Data[i+4] & 0xc0) == 0x40) // MPEG-2: 14 bytes + stuffing
+	    {
+	    if (i+14 > Len) { Cut=i; break; }
+	    Size = 14 + (Data[i+13] & 0x07);
+	    }
+	  else if ((Data[i+4] & 0xf0) == 0x20) { Size = 12; } // MPEG-1
+	  else { i++; continue; } // not a pack header
+	  Cut = i; // everything before it is complete
+	  i += Size;
+	  }
+	else if (u32 == 0x000001b9) { i += 4; } // end code
+	else if ((u32 >= 0x000001bb) && (u32 <= 0x000001ff)) // system header or PES
+	  {
+	  if (i+6 > Len) { break; }
+	  i += 6 + readbe16(Data+i+4);
+	  }
+	else { i++; } // not a start code; resync
+	}
+      break;
+
+    case 'm': // MP3 frames
+      while(i+4 <= Len)
+	{
+	if (!memcmp(Data+i,"ID3",3)) // ID3v2 tag; size is 4x7 bits
+	  {
+	  if (i+10 > Len) { break; }
+	  if ((Data[i+6] | Data[i+7] | Data[i+8] | Data[i+9]) & 0x80) { i++; continue; } // invalid
+	  Size = 10 + (((size_t)Data[i+6]<<21) | ((size_t)Data[i+7]<<14) | ((size_t)Data[i+8]<<7) | Data[i+9]);
+	  if (Data[i+5] & 0x10) { Size += 10; } // footer
+	  }
+	else
+	  {
+	  Size = _FollowMP3frame((uint32_t)readbe32(Data+i));
+	  if (!Size) { i++; continue; } // not a frame; resync
+	  }
+	if (i+Size > Len) { break; } // incomplete
+	i += Size;
+	Cut = i;
+	}
+      break;
+
+    default: // no safe point inside; write it all and sign at the end
+      Cut = Len;
+      break;
+    }
+  return(Cut);
+} /* _FollowMPEGcut() */
+
+/**************************************
+ _FollowAACframe(): Return the length of the ADTS frame, or 0.
+ Same checks as _SealIsAACframe().
+ **************************************/
+static size_t	_FollowAACframe	(const byte *Data)
+{
+  uint16_t u16;
+  u16 = readbe16(Data+0);
+  if ((u16 != 0xfff0) && (u16 != 0xfff1)) { return(0); }
+  u16 = readbe16(Data+2);
+  if ((u16 & 0xc000) == 0xc000) { return(0); } // P cannot be 3
+  if ((u16 & 0x3c00) > (12<<10)) { return(0); } // R cannot be > 12
+  u16 = (Data[3]&0x03);
+  u16 = (u16<<8) | Data[4];
+  u16 = (u16<<3) | ((Data[5]>>5)&0x07);
+  if (u16 < 7) { return(0); }
+  return(u16);
+} /* _FollowAACframe() */
+
+/**************************************
+ _FollowVint(): Read a Matroska (EBML) variable-length value.
+ Updates Offset. Sets Unknown if every value bit is set
+ (an unknown size).
+ Returns the value, or (uint64_t)(-1) if incomplete or invalid.
+ **************************************/
+static uint64_t	_FollowVint	(const byte *Data, size_t Len, size_t *Offset, bool *Unknown)
+{
+  uint64_t Val;
+  int w,b;
+
+  if ((*Offset >= Len) || !Data[*Offset]) { return((uint64_t)(-1)); }
+  for(w=1; !(Data[*Offset] & (0x100>>w)); w++) { ; } // width: 1 to 8 bytes
+  if (*Offset + w > Len) { return((uint64_t)(-1)); }
+  Val = Data[*Offset] & ((0x100>>w)-1); // remove the length marker
+  for(b=1; b < w; b++) { Val = (Val<<8) | Data[*Offset+b]; }
+  *Offset += w;
+  if (Unknown) { *Unknown = (Val == ((uint64_t)1<<(7*w))-1); }
+  return(Val);
+} /* _FollowVint() */
+
+/**************************************
+ _FollowCut(): How many pending bytes can be written?
+ Only stops where a SEAL record can be inserted.
+ **************************************/
+static size_t	_FollowCut	(followfile *F)
+{
+  const byte *Data = F->Pending;
+  size_t Len = F->PendingLen;
+  size_t i, Cut=0;
+
+  switch(F->Format)
+    {
+    case 'x': // Text: after the last newline
+      for(i=Len; i > 0; i--)
+	{
+	if (Data[i-1]=='\n') { return(i); }
+	}
+      break;
+
+    case 'a': // MPEG: see _FollowMPEGcut()
+      return(_FollowMPEGcut(F));
+
+    case 'A': // AAC: after the last complete frame
+      for(i=0; i+7 <= Len; )
+	{
+	size_t FrameLen = _FollowAACframe(Data+i);
+	if (!FrameLen) { i++; continue; } // skip garbage
+	if (i+FrameLen > Len) { break; } // incomplete
+	i += FrameLen;
+	Cut = i;
+	}
+      break;
+
+    case 'M': // Matroska: after the last complete element
+      for(i=0; ; )
+	{
+	size_t Offset=i;
+	uint64_t Tag, Size;
+	bool Unknown=false;
+	Tag = _FollowVint(Data,Len,&Offset,NULL);
+	if (Tag == (uint64_t)(-1)) { break; }
+	Size = _FollowVint(Data,Len,&Offset,&Unknown);
+	if (Size == (uint64_t)(-1)) { break; }
+	if (Unknown && ((Tag == 0x8538067) || (Tag == 0xf43b675))) // live Segment or Cluster
+	  {
+	  i = Cut = Offset; // walk the children
+	  continue;
+	  }
+	if (Unknown || (Size > Len-Offset)) { break; } // incomplete
+	i = Cut = Offset+Size;
+	}
+      break;
+
+    default: break;
+    }
+  return(Cut);
+} /* _FollowCut() */
+
+/**************************************
+ _FollowWrite(): Write and hash the first Len pending bytes.
+ **************************************/
+static void	_FollowWrite	(followfile *F, size_t Len)
+{
+  if (!Len) { return; }
+  SealFileWrite(F->Fout, Len, F->Pending);
+  EVP_DigestUpdate(F->Ctx, F->Pending, Len);
+  F->Last = F->Pending[Len-1];
+  F->OutOffset += Len;
+  F->Since += Len;
+  memmove(F->Pending, F->Pending+Len, F->PendingLen-Len);
+  F->PendingLen -= Len;
+} /* _FollowWrite() */
+
+/**************************************
+ _FollowRead(): Read new bytes from the input.
+ Returns the number of bytes read (at most FOLLOW_READ).
+ Sets Shrank if the file is now smaller than what was read.
+ **************************************/
+static size_t	_FollowRead	(int Fd, followfile *F, bool *Shrank)
+{
+  size_t Total=0;
+  ssize_t rc;
+  struct stat st;
+
+  while(Total < FOLLOW_READ)
+    {
+    if (F->PendingMax - F->PendingLen < 65536)
+      {
+      F->PendingMax = F->PendingMax*2 + 65536;
+      F->Pending = (byte*)realloc(F->Pending,F->PendingMax);
+      }
+    rc = pread(Fd, F->Pending+F->PendingLen, Min(F->PendingMax-F->PendingLen,(size_t)FOLLOW_READ-Total), F->InOffset);
+    if ((rc < 0) && (errno == EINTR)) { continue; }
+    if (rc <= 0) { break; }
+    F->PendingLen += rc;
+    F->InOffset += rc;
+    Total += rc;
+    }
+
+  if (!Total && !fstat(Fd,&st) && ((uint64_t)st.st_size < F->InOffset)) { *Shrank=true; }
+  return(Total);
+} /* _FollowRead() */
+
+/**************************************
+ _FollowBlock(): Wrap '@record' in the format's block.
+ Same blocks as each format's signing function.
+ Sets '@BLOCK' and makes '@s' relative to it.
+ **************************************/
+static sealfield *	_FollowBlock	(sealfield *Args, followfile *F)
+{
+  sealfield *rec;
+  size_t Pre;
+
+  Args = SealSetText(Args,"@BLOCK","");
+  switch(F->Format)
+    {
+    case 'x': // must start on a new line
+      if (F->OutOffset && (F->Last != '\n')) { Args = SealSetText(Args,"@BLOCK",F->Eol); }
+      break;
+    case 'a': Args = SealSetBin(Args,"@BLOCK",4,(const byte*)"\x00\x00\x00\x00"); break;
+    case 'A': Args = SealSetBin(Args,"@BLOCK",1,(const byte*)"\x00"); break;
+    case 'M':
+      {
+      // "SEAL" tag and an 8-byte length
+      byte Head[13];
+      uint64_t Len = SealGetSize(Args,"@record");
+      memcpy(Head,"\x08\x53\x45\x41\x4c\x01",6);
+      for(int i=0; i < 7; i++) { Head[12-i] = (Len >> (8*i)) & 0xff; }
+      Args = SealSetBin(Args,"@BLOCK",13,Head);
+      }
+      break;
+    default: break;
+    }
+
+  // Make '@s' relative to block
+  Pre = SealGetSize(Args,"@BLOCK");
+  SealIncIindex(Args, "@s", 0, Pre);
+  SealIncIindex(Args, "@s", 1, Pre);
+
+  // Add record
+  rec = SealSearch(Args,"@record");
+  Args = SealAddBin(Args,"@BLOCK",rec->ValueLen,rec->Value);
+  switch(F->Format)
+    {
+    case 'x': Args = SealAddText(Args,"@BLOCK",F->Eol); break;
+    case 'a':
+      Args = SealAddText(Args,"@BLOCK","\n");
+      Args = SealAddBin(Args,"@BLOCK",4,(const byte*)"\x00\x00\x00\x00");
+      break;
+    case 'A':
+      Args = SealAddText(Args,"@BLOCK","\n");
+      Args = SealAddBin(Args,"@BLOCK",1,(const byte*)"\x00");
+      break;
+    default: break;
+    }
+  SealSetType(Args,"@BLOCK",'x');
+  return(Args);
+} /* _FollowBlock() */
+
+/**************************************
+ _FollowSeal(): Append a signed SEAL record to the output.
+ The digest context covers the range up to the new block.
+ Final records end at the end of the file.
+ **************************************/
+static sealfield *	_FollowSeal	(sealfield *Args, followfile *F, bool Final)
+{
+  sealfield *block, *sig, *sigparm;
+  size_t *s, *p;
+  size_t SigStart, SigEnd, Tail;
+  EVP_MD_CTX *Fin;
+  unsigned char Digest[EVP_MAX_MD_SIZE];
+  unsigned int DigestLen=0;
+
+  // First record starts at the file; the rest overlap the previous signature
+  Args = SealSetText(Args,"b",SealGetIindex(Args,"@s",2) ? "P~S" : "F~S");
+  Args = SealAddText(Args,"b",Final ? ",s~f" : ",s~s+3"); // +3 for '"/>'
+  Args = SealDel(Args,"@signatureenc");
+  Args = SealRecord(Args); // get placeholder
+  Args = _FollowBlock(Args,F);
+  block = SealSearch(Args,"@BLOCK");
+  s = SealGetIarray(Args,"@s");
+  SigStart = s[0];
+  SigEnd = s[1];
+  Tail = Final ? block->ValueLen - SigEnd : 3;
+
+  // Finish this range: up to the signature, then after it
+  EVP_DigestUpdate(F->Ctx, block->Value, SigStart);
+  Fin = EVP_MD_CTX_new();
+  EVP_MD_CTX_copy_ex(Fin, F->Ctx);
+  EVP_DigestUpdate(Fin, block->Value+SigEnd, Tail);
+  if (Final) { EVP_DigestUpdate(Fin, F->Pending, F->PendingLen); } // after the record
+  EVP_DigestFinal_ex(Fin, Digest, &DigestLen);
+  EVP_MD_CTX_free(Fin);
+
+  // Sign it (this creates '@signatureenc')
+  sigparm = SealClone(Args);
+  sigparm = SealSetBin(sigparm,"@digest1",DigestLen,Digest);
+  switch(SealGetCindex(sigparm,"@mode",0))
+    {
+    case 'S': sigparm = SealSignURL(sigparm); break;
+    case 's': sigparm = SealSignLocal(sigparm); break;
+    default: break; // never happens
+    }
+  sig = SealSearch(sigparm,"@signatureenc");
+  if (!sig || (sig->ValueLen + SigStart != SigEnd))
+	{
+	fprintf(stderr," ERROR: signature size changed while following. Aborting.\n");
+	exit(0x80);
+	}
+  memcpy(block->Value+SigStart, sig->Value, sig->ValueLen);
+  SealFree(sigparm);
+
+  // Write it; readers only see complete records
+  SealFileWrite(F->Fout, block->ValueLen, block->Value);
+  fflush(F->Fout);
+
+  // The next range starts at this signature
+  EVP_DigestInit_ex(F->Ctx, F->Md, NULL);
+  EVP_DigestUpdate(F->Ctx, block->Value+SigStart, block->ValueLen-SigStart);
+  F->Last = block->Value[block->ValueLen-1];
+
+  // Offsets relative to the output file
+  s[0] += F->OutOffset;
+  s[1] += F->OutOffset;
+  p = SealGetIarray(Args,"@p");
+  p[0] = s[0]; // rotate positions
+  p[1] = s[1];
+  Args = SealIncIindex(Args,"@s",2,1); // increase number of signatures
+  F->OutOffset += block->ValueLen;
+  F->Since = 0;
+  Args = SealDel(Args,"@BLOCK");
+
+  // The final record can be followed by an incomplete tail
+  if (Final && F->PendingLen)
+    {
+    SealFileWrite(F->Fout, F->PendingLen, F->Pending);
+    F->OutOffset += F->PendingLen;
+    F->PendingLen = 0;
+    }
+
+  printf(" Signature record #%ld added: %s (%llu bytes)\n",
+    (long)SealGetIindex(Args,"@s",2), SealGetText(Args,"@FilenameOut"),
+    (unsigned long long)F->OutOffset);
+  fflush(stdout);
+  return(Args);
+} /* _FollowSeal() */
+
+#pragma GCC visibility pop
+
+/**************************************
+ SealFollow(): Sign a growing file until told to stop.
+ Args must be ready for signing ('@mode' and '@sigsize').
+ Writes '-o' (outfile) with rolling SEAL records.
+ **************************************/
+void	SealFollow	(sealfield *CleanArgs, const char *Filename)
+{
+  sealfield *Args;
+  followfile F;
+  int Fd, Ifd=-1;
+  char *Outname, *da;
+  uint64_t Seconds=10, Bytes=0, Idle=0;
+  uint64_t Now, LastSeal, LastGrowth;
+  bool Shrank=false, Gone=false;
+  struct stat stIn, stOut;
+  struct sigaction sa;
+
+  if (SealSearch(CleanArgs,"follow-seconds")) { Seconds = strtoull(SealGetText(CleanArgs,"follow-seconds"),NULL,10); }
+  if (SealSearch(CleanArgs,"follow-bytes")) { Bytes = strtoull(SealGetText(CleanArgs,"follow-bytes"),NULL,10); }
+  if (SealSearch(CleanArgs,"follow-idle")) { Idle = strtoull(SealGetText(CleanArgs,"follow-idle"),NULL,10); }
+  if (!Seconds && !Bytes)
+	{
+	fprintf(stderr,"ERROR: --follow needs --follow-seconds or --follow-bytes. Aborting.\n");
+	exit(0x80);
+	}
+
+  Fd = open(Filename,O_RDONLY);
+  if (Fd < 0)
+	{
+	fprintf(stderr,"ERROR: Cannot open file to follow (%s). Aborting.\n",Filename);
+	exit(0x80);
+	}
+
+  memset(&F,0,sizeof(F));
+  Args = SealClone(CleanArgs);
+
+  // Stop cleanly on a signal; the last record finalizes the file
+  memset(&sa,0,sizeof(sa));
+  sa.sa_handler = _FollowSignal;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT,&sa,NULL);
+  sigaction(SIGTERM,&sa,NULL);
+
+#ifdef __linux__
+  Ifd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+  if ((Ifd >= 0) && (inotify_add_watch(Ifd,Filename,IN_MODIFY|IN_CLOSE_WRITE|IN_DELETE_SELF|IN_MOVE_SELF) < 0))
+    {
+    close(Ifd);
+    Ifd = -1;
+    }
+#endif
+
+  // Wait for enough data to identify the format
+  LastGrowth = _FollowNow();
+  while(1)
+    {
+    if (_FollowRead(Fd,&F,&Shrank))
+      {
+      mmapfile Mmap;
+      Mmap.fp = NULL;
+      Mmap.mem = F.Pending;
+      Mmap.memsize = F.PendingLen;
+      F.Format = SealFileFormat(&Mmap);
+      if ((F.Format && strchr("xaAM",F.Format)) || (F.PendingLen >= 1024)) { break; }
+      LastGrowth = _FollowNow();
+      continue;
+      }
+    if (FollowStop || Shrank) { break; }
+    if (Idle && (_FollowNow()-LastGrowth >= Idle*1000)) { break; }
+    poll(NULL,0,250);
+    }
+  if (!F.Format || !strchr("xaAM",F.Format))
+	{
+	fprintf(stderr,"ERROR: Cannot follow %s files (%s); only Text, MPEG, AAC, and Matroska. Aborting.\n",FormatName(F.Format),Filename);
+	exit(0x80);
+	}
+  F.Eol = "\n";
+  if (F.Format=='x')
+    {
+    byte *Nl = (byte*)memchr(F.Pending,'\n',F.PendingLen);
+    if (Nl && (Nl > F.Pending) && (Nl[-1]=='\r')) { F.Eol = "\r\n"; }
+    }
+  if (F.Format=='a') { F.Mpeg = _FollowMPEGkind(F.Pending,F.PendingLen); }
+
+  // Create the output; never the file being followed
+  Outname = MakeFilename((char*)(SealSearch(Args,"outfile")->Value),Filename);
+  if (!Outname) { exit(0x80); }
+  if (!fstat(Fd,&stIn) && !stat(Outname,&stOut) &&
+      (stIn.st_dev == stOut.st_dev) && (stIn.st_ino == stOut.st_ino))
+	{
+	fprintf(stderr,"ERROR: The output file is the file being followed (%s). Aborting.\n",Outname);
+	exit(0x80);
+	}
+  Args = SealSetText(Args,"@FilenameOut",Outname);
+  free(Outname);
+  F.Fout = SealFileOpen(SealGetText(Args,"@FilenameOut"),"wb");
+
+  // The digest context stays open between records
+  da = SealGetText(Args,"da");
+  if (!da || !strcmp(da,"sha256")) { F.Md = EVP_sha256(); }
+  else if (!strcmp(da,"sha224")) { F.Md = EVP_sha224(); }
+  else if (!strcmp(da,"sha384")) { F.Md = EVP_sha384(); }
+  else if (!strcmp(da,"sha512")) { F.Md = EVP_sha512(); }
+  else
+	{
+	fprintf(stderr,"ERROR: Unknown digest algorithm for --follow (da=%s). Aborting.\n",da);
+	exit(0x80);
+	}
+  F.Ctx = EVP_MD_CTX_new();
+  EVP_DigestInit_ex(F.Ctx, F.Md, NULL);
+
+  printf(" Following %s file: %s\n",FormatName(F.Format),Filename);
+  fflush(stdout);
+
+  LastSeal = _FollowNow();
+  while(!FollowStop && !Shrank && !Gone)
+    {
+    size_t Got;
+    int Wait;
+
+    Got = _FollowRead(Fd,&F,&Shrank);
+    Now = _FollowNow();
+    if (Got) { LastGrowth = Now; }
+    _FollowWrite(&F,_FollowCut(&F));
+
+    // Time for a record? (Not inside an MPEG stream without safe points.)
+    if (F.Since && (F.Mpeg != 'e') && ((Seconds && (Now-LastSeal >= Seconds*1000)) || (Bytes && (F.Since >= Bytes))))
+      {
+      Args = _FollowSeal(Args,&F,false);
+      LastSeal = Now;
+      }
+    else if (!F.Since) { LastSeal = Now; } // nothing new to seal
+
+    if (Idle && (Now-LastGrowth >= Idle*1000)) { break; }
+    if (Got >= FOLLOW_READ) { continue; } // more to read
+
+    // Wait for a change, the next record, or idle
+    Wait = 1000;
+    if (Seconds && F.Since && (LastSeal+Seconds*1000 > Now)) { Wait = Min(Wait,(int)(LastSeal+Seconds*1000-Now)); }
+    if (Idle && (LastGrowth+Idle*1000 > Now)) { Wait = Min(Wait,(int)(LastGrowth+Idle*1000-Now)); }
+    if (Ifd < 0) { poll(NULL,0,Wait); continue; }
+#ifdef __linux__
+    struct pollfd Pfd;
+    Pfd.fd = Ifd;
+    Pfd.events = POLLIN;
+    if (poll(&Pfd,1,Wait) > 0)
+      {
+      // Drain the events
+      char Buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+      ssize_t Len, i;
+      while((Len = read(Ifd,Buf,sizeof(Buf))) > 0)
+	{
+	for(i=0; i < Len; i += sizeof(struct inotify_event) + ((struct inotify_event*)(Buf+i))->len)
+	  {
+	  if (((struct inotify_event*)(Buf+i))->mask & (IN_DELETE_SELF|IN_MOVE_SELF)) { Gone=true; }
+	  }
+	}
+      }
+#endif
+    }
+
+  // Finish: write everything and finalize
+  while(_FollowRead(Fd,&F,&Shrank)) { _FollowWrite(&F,_FollowCut(&F)); }
+  if (Shrank) { printf(" WARNING: Followed file shrank; stopped following.\n"); }
+  if (Gone) { printf(" Followed file was moved or deleted; stopped following.\n"); }
+  // Text and MPEG end with the record; an incomplete AAC frame or
+  // Matroska element stays last, after the record.
+  if ((F.Format=='x') || (F.Format=='a')) { _FollowWrite(&F,F.PendingLen); }
+  Args = _FollowSeal(Args,&F,true);
+
+  // Clean up
+  SealFileClose(F.Fout);
+  EVP_MD_CTX_free(F.Ctx);
+  free(F.Pending);
+  if (Ifd >= 0) { close(Ifd); }
+  close(Fd);
+  SealFree(Args);
+} /* SealFollow() */
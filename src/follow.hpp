@@ -0,0 +1,19 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Rolling signatures for growing files (--follow).
+ ************************************************/
+#ifndef FOLLOW_HPP
+#define FOLLOW_HPP
+
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "seal.hpp"
+
+void	SealFollow	(sealfield *CleanArgs, const char *Filename);
+
+#endif
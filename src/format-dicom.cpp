@@ -59,9 +59,25 @@
  (Why this complexity? Because consistent parsing is for wimps!)
 
 
+ The transfer syntax (0002,0010) defines the encoding after group 0002.
+ Group 0002 is always explicit VR little endian.
+ If the transfer syntax is "1.2.840.10008.1.2", then the rest of
+ the file is implicit VR little endian: there is no VR, and every
+ length is 32-bits:
+   Tag (4 bytes), VL (4 bytes), VF
+
+ Pixel data (7fe0,0010) is usually most of the file.
+ If it has an explicit length, then it is skipped by length.
+ If the length is undefined, then it is encapsulated: a series of
+ (fffe,e000) items, each with a 32-bit length, ending with (fffe,e0dd).
+ Each item (fragment) is skipped by length.
+ Only element headers are read; the pixel data is never touched.
+
  For SEAL:
  Scan any explicit ST, LT, and UT fields.
  (Skip an implicit records since they are nested.)
+ With implicit VR, there is no VR to identify text, so only
+ the SEAL private group (cea1,1000-10ff) is scanned.
 
  For encoding: Use one of these VR:
    ST = Short text, up to 1024 characters max
@@ -95,6 +111,7 @@
    Pos is the absolute start of the chunk relative to the file.
    Mmap is the absolute start of the file.
    Uses '@DICOMcea1' to track if it has the cea1 group reserved.
+   Uses '@DICOMimplicit' to track implicit VR transfer syntax.
  **************************************/
 sealfield *	_DICOMwalk	(sealfield *Args, mmapfile *Mmap)
 {
@@ -103,6 +120,8 @@ sealfield *	_DICOMwalk	(sealfield *Args, mmapfile *Mmap)
   uint16_t Group,Element,VR;
   uint32_t VL; // value length
   bool SkipVL;
+  bool Implicit=false; // implicit VR little endian?
+  bool Undefined; // undefined length?
 
 #define DEBUGDICOMWALK 0
   Args = SealSetText(Args,"DICOM_ERROR","Overflow"); // assume bad
@@ -132,8 +151,13 @@ sealfield *	_DICOMwalk	(sealfield *Args, mmapfile *Mmap)
       else if (Element==0xe00d) { Nest--; } // end delimination
       else if (Element==0xe0dd) { Nest--; } // end sequence
       }
+    else if (Implicit && (Group != 0x0002)) // no VR
+      {
+      VR=0; Offset-=4; // No VR; will read 32-bit VL next.
+      }
 
     // Now check for special VL lengths
+    Undefined=false;
     if (!SkipVL)
       {
       switch(VR)
@@ -170,7 +194,7 @@ sealfield *	_DICOMwalk	(sealfield *Args, mmapfile *Mmap)
 	  VL = readle32(Mmap->mem + Offset); Offset+=4;
 	  if (VL==0xffffffff)
 	    {
-	    Nest++; VL=0;
+	    Nest++; VL=0; Undefined=true;
 #if DEBUGDICOMWALK
 	    printf("\n");
 #endif
@@ -185,12 +209,49 @@ sealfield *	_DICOMwalk	(sealfield *Args, mmapfile *Mmap)
 
     if (Offset+VL > Mmap->memsize) { return(Args); } // overflow
 
+    // Encapsulated pixel data: skip every fragment by length
+    if (Undefined && (Group==0x7fe0) && (Element==0x0010))
+      {
+      while(Offset+8 <= Mmap->memsize)
+	{
+	if (readle16(Mmap->mem+Offset) != 0xfffe) { return(Args); } // not an item
+	Element = readle16(Mmap->mem + Offset + 2);
+	VL = readle32(Mmap->mem + Offset + 4);
+	Offset+=8;
+	if (Element==0xe0dd) { Nest--; break; } // end of fragments
+	if ((Element!=0xe000) || (VL==0xffffffff)) { return(Args); } // fragments must have lengths
+	if (Offset+VL > Mmap->memsize) { return(Args); } // overflow
+	Offset += VL;
+	}
+      continue;
+      }
+
+    // Check the transfer syntax
+    if ((Group==0x0002) && (Element==0x0010))
+      {
+      uint32_t Len;
+      // Value is a UID padded with null or space
+      for(Len=VL; (Len > 0) && ((Mmap->mem[Offset+Len-1]=='\0') || (Mmap->mem[Offset+Len-1]==' ')); Len--) { ; }
+      if ((Len==17) && !memcmp(Mmap->mem+Offset,"1.2.840.10008.1.2",17))
+	{
+	Implicit=true;
+	Args = SealSetText(Args,"@DICOMimplicit","true");
+	}
+      }
+
     // Look for SEAL records
     if ((Group==0xcea1) && (Element==0x0010))
       {
       Args = SealSetText(Args,"@DICOMcea1","true"); // Someone already reserved the space!
       }
 
+    // Implicit VR: only check the SEAL private group
+    if ((VR==0) && Implicit && (Nest == 0) && (VL > 8) &&
+	((Group==0xcea1) || (Group==0xc3a1)) && ((Element & 0xff00)==0x1000))
+      {
+      Args = SealVerifyBlock(Args, Offset, Offset+VL, Mmap);
+      }
+
     switch(VR)
       {
       case 0x5354: // ST: short text (1024 or shorter)
@@ -305,12 +366,24 @@ sealfield *	Seal_DICOMsign	(sealfield *Args, mmapfile *MmapIn)
   // Add the tag reservation if necessary
   if (SealGetText(Args,"@DICOMcea1")==NULL) // does it need a reservation
     {
-    Args = SealSetBin(Args,"@BLOCK",12,(const byte*)"\xa1\xce\x10\x00LO\x04\x00SEAL"); // reserved group 0xcea1
+    if (SealGetText(Args,"@DICOMimplicit")) // implicit VR: tag and 32-bit length
+      {
+      Args = SealSetBin(Args,"@BLOCK",12,(const byte*)"\xa1\xce\x10\x00\x04\x00\x00\x00SEAL"); // reserved group 0xcea1
+      }
+    else
+      {
+      Args = SealSetBin(Args,"@BLOCK",12,(const byte*)"\xa1\xce\x10\x00LO\x04\x00SEAL"); // reserved group 0xcea1
+      }
     }
 
   // Data type (VR) and length (VL) depends on the record size
   writele32(VLlen,rec->ValueLen);
-  if (rec->ValueLen < 1024) // fits in short text!
+  if (SealGetText(Args,"@DICOMimplicit")) // implicit VR: no data type
+    {
+    Args = SealAddBin(Args,"@BLOCK",4,(const byte*)"\xa1\xc3\x01\x10");
+    Args = SealAddBin(Args,"@BLOCK",4,VLlen);
+    }
+  else if (rec->ValueLen < 1024) // fits in short text!
     {
     Args = SealAddBin(Args,"@BLOCK",6,(const byte*)"\xa1\xc3\x01\x10ST");
     Args = SealAddBin(Args,"@BLOCK",2,VLlen);
@@ -362,6 +435,7 @@ sealfield *	Seal_DICOM	(sealfield *Args, mmapfile *Mmap)
    *****/
   Args = Seal_DICOMsign(Args,Mmap); // Add a signature as needed
   Args = SealDel(Args,"@DICOMcea1"); // no longer needed
+  Args = SealDel(Args,"@DICOMimplicit"); // no longer needed
   if (SealGetIindex(Args,"@s",2)==0) // no signatures
     {
     printf(" No SEAL signatures found.\n");
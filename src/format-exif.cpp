@@ -28,9 +28,23 @@
        If size <= 4, then this is the data.
        If size > 4, then this is the offset to the data.
    
- SEAL: Only cares about tag 0xcea1.
+ After the entries is a 4 byte offset to the next IFD (0 = none).
+ IFD0 links to IFD1 (usually the thumbnail).
+ Some entries point to nested IFDs:
+   0x8769 = Exif IFD (holds UserComment 0x9286)
+   0x8825 = GPS IFD
+   0xa005 = Interoperability IFD
+   0x014a = SubIFDs (array of offsets)
+
+ SEAL: Only cares about tag 0xcea1 (and text comments).
  The type should be "1" (ASCII text), but this decoder
  ignores the type.
+
+ Every IFD is visited breadth-first: IFD0, the linked chain,
+ then any nested IFDs.
+ Malicious files may contain loops or overlapping IFDs.
+ A bitmap records every IFD and entry offset that was seen, so each
+ entry is processed at most once.
  ************************************************/
 #include <stdlib.h>
 #include <ctype.h>
@@ -41,52 +55,99 @@
 #include "files.hpp"
 #include "formats.hpp"
 
+#define Read16(x) ((Endian==1234) ? readle16(x) : readbe16(x))
+#define Read32(x) ((Endian==1234) ? readle32(x) : readbe32(x))
+
+#pragma GCC visibility push(hidden)
+
 /**************************************
- Seal_Exif(): Process a EXIF.
+ _ExifQueue(): Add an IFD offset to the queue.
+ Skips offsets that are invalid or already seen.
+ Returns updated queue length.
  **************************************/
-sealfield *	Seal_Exif	(sealfield *Args, mmapfile *MmapFile, uint32_t ExifStart, uint32_t ExifSize)
+uint32_t	_ExifQueue	(uint32_t IFDoffset, mmapfile *MmapExif, byte *Seen, uint32_t **Queue, uint32_t *QueueMax, uint32_t QueueLen)
 {
-  #define Read16(x) ((Endian==1234) ? readle16(x) : readbe16(x))
-  #define Read32(x) ((Endian==1234) ? readle32(x) : readbe32(x))
-
-  mmapfile MmapExif;
-  int Endian;
-  uint16_t Tag,Type,MaxEntries,e;
-  uint32_t EntrySize,EntryValue,Offset;
-
-  // Make sure it's a EXIF.
-  if (MmapFile->memsize < ExifStart+ExifSize) { return(Args); } // invalid offsets
-  MmapExif.mem = MmapFile->mem + ExifStart;
-  MmapExif.memsize = ExifSize;
-  if (MmapExif.memsize < 8+2+12) { return(Args); } // header + count + 1 entry
+  if (IFDoffset < 8) { return(QueueLen); } // overlaps header
+  if (IFDoffset > MmapExif->memsize - 2) { return(QueueLen); } // overflow
+  if (Seen[IFDoffset/8] & (1 << (IFDoffset%8))) { return(QueueLen); } // already seen
+  Seen[IFDoffset/8] |= (1 << (IFDoffset%8));
 
-  // Read TIFF header
-  // Endian values consistent with Gnu.
-  if (!memcmp(MmapExif.mem,"II*\0",4)) { Endian=1234; } // little endian
-  else if (!memcmp(MmapExif.mem,"MM\0*",4)) { Endian=4321; } // big endian
-  else { return(Args); } // unknown endian.
+  if (QueueLen >= *QueueMax)
+    {
+    *QueueMax += 64;
+    *Queue = (uint32_t*)realloc(*Queue,*QueueMax * sizeof(uint32_t));
+    }
+  (*Queue)[QueueLen] = IFDoffset;
+  return(QueueLen+1);
+} /* _ExifQueue() */
 
-  Offset = Read32(MmapExif.mem+4);
-  if (Offset < 8) { return(Args); } // bad offset
-  if (Offset+2+12 > MmapExif.memsize) { return(Args); } // overflow
+/**************************************
+ _ExifWalk(): Scan every IFD for SEAL records.
+ The endian is a template parameter so every Read16/Read32 is
+ resolved at compile time. Seal_Exif() selects the instance.
+ Offset is the start of IFD0 relative to MmapExif.
+ **************************************/
+template <int Endian>
+sealfield *	_ExifWalk	(sealfield *Args, mmapfile *MmapFile, uint32_t ExifStart, mmapfile *MmapExif, uint32_t Offset)
+{
+  uint16_t Tag,Type,MaxEntries,e;
+  uint32_t EntrySize,EntryValue,EntryOffset;
+  uint32_t i,q,QueueLen,QueueMax;
+  uint32_t *Queue;
+  byte *Seen; // bitmap: one bit per byte offset
 
-  // Read IFD0
-  MaxEntries = Read16(MmapExif.mem+Offset);
-  Offset+=2;
+  Seen = (byte*)calloc(MmapExif->memsize/8 + 1,1);
+  Queue = NULL; QueueMax = 0;
+  QueueLen = _ExifQueue(Offset,MmapExif,Seen,&Queue,&QueueMax,0);
 
-  // Process every entry
-  for(e=0; e < MaxEntries; e++)
+  // Breadth-first: the queue grows while it is processed
+  for(q=0; q < QueueLen; q++)
     {
-    if (Offset+e*12+12 > MmapExif.memsize) { break; } // overflow
-    Tag  = Read16(MmapExif.mem + Offset + e*12 + 0);
-    Type = Read16(MmapExif.mem + Offset + e*12 + 2);
-    EntrySize = Read32(MmapExif.mem + Offset + e*12 + 4);
-    EntryValue = Read32(MmapExif.mem + Offset + e*12 + 8);
+    Offset = Queue[q];
+    MaxEntries = Read16(MmapExif->mem+Offset);
+    Offset+=2;
+
+    // Process every entry
+    for(e=0; e < MaxEntries; e++, Offset+=12)
+      {
+      if (Offset > MmapExif->memsize - 12) { break; } // overflow
+      if (Seen[Offset/8] & (1 << (Offset%8))) { break; } // overlaps another IFD
+      Seen[Offset/8] |= (1 << (Offset%8));
+
+      Tag  = Read16(MmapExif->mem + Offset + 0);
+      Type = Read16(MmapExif->mem + Offset + 2);
+      EntrySize = Read32(MmapExif->mem + Offset + 4);
+      EntryValue = Read32(MmapExif->mem + Offset + 8);
+
+      // Queue nested IFDs
+      switch(Tag)
+	{
+	case 0x8769: // Exif IFD
+	case 0x8825: // GPS IFD
+	case 0xa005: // Interoperability IFD
+	  QueueLen = _ExifQueue(EntryValue,MmapExif,Seen,&Queue,&QueueMax,QueueLen);
+	  continue;
+	case 0x014a: // SubIFDs: count is number of 4-byte offsets
+	  if ((Type != 4) && (Type != 13)) { continue; } // must be long or IFD
+	  if (EntrySize <= 1) // offset stored in the entry
+	    {
+	    QueueLen = _ExifQueue(EntryValue,MmapExif,Seen,&Queue,&QueueMax,QueueLen);
+	    continue;
+	    }
+	  if ((EntrySize > MmapExif->memsize/4) || (EntryValue > MmapExif->memsize - EntrySize*4)) { continue; } // overflow
+	  for(i=0; i < EntrySize; i++)
+	    {
+	    EntryOffset = Read32(MmapExif->mem + EntryValue + i*4);
+	    QueueLen = _ExifQueue(EntryOffset,MmapExif,Seen,&Queue,&QueueMax,QueueLen);
+	    }
+	  continue;
+	default: break;
+	}
 
-    if (EntrySize <= 4) { continue; } // SEAL records are more than 4 bytes
-    if (EntryValue + EntrySize > MmapExif.memsize) { continue; } // overflow
+      if (EntrySize <= 4) { continue; } // SEAL records are more than 4 bytes
+      if ((EntrySize > MmapExif->memsize) || (EntryValue > MmapExif->memsize - EntrySize)) { continue; } // overflow
 
-    switch(Type)
+      switch(Type)
 	{
 	case 1: /* unsigned byte */
         case 2: /* ascii string */
@@ -95,15 +156,55 @@ sealfield *	Seal_Exif	(sealfield *Args, mmapfile *MmapFile, uint32_t ExifStart,
 	default: continue; /* unsupported for SEAL */
 	}
 
-    // Look for SEAL tag (or text comment)
-    if ((Tag == 0xcea1) || // SEAL code
-	(Tag == 0x9286) || // User Comment (deprecated)
-	(Tag == 0xfffe)) // generic Comment
+      // Look for SEAL tag (or text comment)
+      if ((Tag == 0xcea1) || // SEAL code
+	  (Tag == 0x9286) || // User Comment (deprecated)
+	  (Tag == 0xfffe)) // generic Comment
 	{
 	Args = SealVerifyBlock(Args, ExifStart+EntryValue, ExifStart+EntryValue+EntrySize, MmapFile);
 	}
+      }
+
+    // Queue the next IFD in the chain
+    if ((e == MaxEntries) && (Offset <= MmapExif->memsize - 4))
+      {
+      QueueLen = _ExifQueue(Read32(MmapExif->mem + Offset),MmapExif,Seen,&Queue,&QueueMax,QueueLen);
+      }
     }
 
+  if (Queue) { free(Queue); }
+  free(Seen);
   return(Args);
-} /* Seal_Exif() */
+} /* _ExifWalk() */
+
+#pragma GCC visibility pop
+
+/**************************************
+ Seal_Exif(): Process a EXIF.
+ **************************************/
+sealfield *	Seal_Exif	(sealfield *Args, mmapfile *MmapFile, uint32_t ExifStart, uint32_t ExifSize)
+{
+  mmapfile MmapExif;
+  int Endian;
+  uint32_t Offset;
 
+  // Make sure it's a EXIF.
+  if (MmapFile->memsize < (uint64_t)ExifStart+ExifSize) { return(Args); } // invalid offsets
+  MmapExif.mem = MmapFile->mem + ExifStart;
+  MmapExif.memsize = ExifSize;
+  if (MmapExif.memsize < 8+2+12) { return(Args); } // header + count + 1 entry
+
+  // Read TIFF header
+  // Endian values consistent with Gnu.
+  if (!memcmp(MmapExif.mem,"II*\0",4)) { Endian=1234; } // little endian
+  else if (!memcmp(MmapExif.mem,"MM\0*",4)) { Endian=4321; } // big endian
+  else { return(Args); } // unknown endian.
+
+  Offset = Read32(MmapExif.mem+4);
+  if (Offset < 8) { return(Args); } // bad offset
+  if (Offset > MmapExif.memsize - (2+12)) { return(Args); } // overflow
+
+  // Walk every IFD with the endian-specific reader
+  if (Endian == 1234) { return(_ExifWalk<1234>(Args, MmapFile, ExifStart, &MmapExif, Offset)); }
+  return(_ExifWalk<4321>(Args, MmapFile, ExifStart, &MmapExif, Offset));
+} /* Seal_Exif() */
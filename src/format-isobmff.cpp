@@ -105,6 +105,19 @@
      Assume they are global and not relative. However, I've seen some
      videos where different tracks have different attributions!
 
+ HEIF/AVIF items:
+ The top-level 'meta' atom (a "full box": 1 byte version, 3 bytes flags)
+ describes items. Two nested atoms matter:
+   - 'iinf' lists each item: 'infe' atoms with the item ID and the
+     item type (e.g., "Exif", "mime" for XMP, "SEAL").
+   - 'iloc' lists where each item's data is stored: one or more
+     extents (offset + length). The offset is either absolute in the
+     file (construction method 0) or relative to the 'idat' atom in the
+     'meta' (method 1).
+ Only extents for Exif, mime, and SEAL items are checked. The rest of
+ 'meta' and 'mdat' (e.g., image bursts) is never scanned.
+ Exif items begin with a 4-byte offset to the TIFF header.
+
  For signing?
  Keep it simple. Append the SEAL record at the end of the file.
  ************************************************/
@@ -116,19 +129,16 @@
 #include "sign.hpp"
 #include "files.hpp"
 #include "formats.hpp"
+#include "fourcc.hpp"
 
 #pragma GCC visibility push(hidden)
 
-/**************************************
- **************************************/
-
-/**************************************
- **************************************/
-struct
+struct bmffatom
   {
   const char *name;
-  byte type; // 'r' for recurse, 's' for scan, 'i' for iinf, 'e' for exif
-  } BMFFatoms[] =
+  byte type; // 'r' for recurse, 's' for scan, 'm' for meta items, 'e' for exif
+  };
+constexpr bmffatom BMFFatoms[] =
   {
 #if 0
     // recursive
@@ -140,7 +150,6 @@ struct
     {"iref",'r'}, // Item Reference"
     {"hoov",'r'}, // Apple HEIV movie stream, embedded in mdat
     {"mdia",'r'}, // Media
-    {"meta",'r'}, // Meta Data
     {"minf",'r'}, // Media Info
     {"moov",'r'}, // Movie
     {"stbl",'r'}, // Sample Table
@@ -149,11 +158,10 @@ struct
     {"ipco",'r'}, // Item Property Container (HEIC)
     {"iprp",'r'}, // Item properties (HEIC)
     {"gmhd",'r'}, // GenMedia Header
-    // arrays of atoms
-    {"iinf",'i'}, // item info (HEIC); array
-    {"iloc",'l'}, // item location (HEIC); array
-    // May contain SEAL record
 #endif
+    // items (iinf and iloc) (HEIC/AVIF)
+    {"meta",'m'}, // Meta Data
+    // May contain SEAL record
     {"SEAL",'s'},
     {"name",'s'},
     {"mdta",'s'}, // metadata
@@ -162,9 +170,200 @@ struct
     {"xml ",'s'}, // XMP
     {"XMP_",'s'}, // XMP
     {"Exif",'e'}, // EXIF
-    {NULL,0} // END
   };
 
+// Compile-time perfect hash of BMFFatoms: FourCC to type
+constexpr auto BMFFatomKey = [](const bmffatom &A) { return(FourCC(A.name)); };
+constexpr auto BMFFatomValue = [](const bmffatom &A, size_t) { return((uint8_t)A.type); };
+constexpr fourcchash<5> BMFFatomHash = FourCCHashBuild<5>(BMFFatoms,BMFFatomKey,BMFFatomValue);
+static_assert(FourCCHashCheck(BMFFatomHash,BMFFatoms,BMFFatomKey,BMFFatomValue),"BMFF hash does not match BMFFatoms");
+
+/**************************************
+ _BMFFreadN(): Read a big-endian value that is Len bytes long.
+ Len is 0, 4, or 8 (iloc field sizes).
+ **************************************/
+uint64_t	_BMFFreadN	(const byte *Data, int Len)
+{
+  if (Len==4) { return((uint32_t)readbe32(Data)); }
+  if (Len==8) { return(readbe64(Data)); }
+  return(0);
+} /* _BMFFreadN() */
+
+/**************************************
+ _BMFFsizeOK(): Is this a valid iloc field size (0, 4, or 8)?
+ **************************************/
+bool	_BMFFsizeOK	(int Len)
+{
+  return((Len==0) || (Len==4) || (Len==8));
+} /* _BMFFsizeOK() */
+
+/**************************************
+ _BMFFitems(): Given a top-level 'meta' atom, find items by iinf/iloc.
+ Only Exif, mime (XMP), and SEAL items are checked.
+ MetaStart/MetaEnd are the meta atom's contents (after the header).
+ **************************************/
+sealfield *	_BMFFitems	(sealfield *Args, size_t MetaStart, size_t MetaEnd, mmapfile *Mmap)
+{
+  size_t Pos, AtomLen;
+  size_t Iinf=0, IinfEnd=0, Iloc=0, IlocEnd=0, Idat=0, IdatEnd=0;
+  const byte *Data;
+  // Items of interest: ID and type ('e'=Exif, 's'=scan)
+  uint32_t *ItemID=NULL;
+  byte *ItemType=NULL;
+  uint32_t Items=0, ItemMax;
+  uint32_t Version, Count, c, i;
+
+  // meta is a full box: skip version and flags
+  if (MetaEnd > Mmap->memsize) { MetaEnd = Mmap->memsize; } // overflow
+  Pos = MetaStart+4;
+  while(Pos+8 <= MetaEnd)
+    {
+    Data = Mmap->mem+Pos;
+    AtomLen = (uint32_t)readbe32(Data);
+    if ((AtomLen < 8) || (Pos+AtomLen > MetaEnd)) { break; } // overflow
+    if (!memcmp(Data+4,"iinf",4)) { Iinf=Pos+8; IinfEnd=Pos+AtomLen; }
+    else if (!memcmp(Data+4,"iloc",4)) { Iloc=Pos+8; IlocEnd=Pos+AtomLen; }
+    else if (!memcmp(Data+4,"idat",4)) { Idat=Pos+8; IdatEnd=Pos+AtomLen; }
+    Pos += AtomLen;
+    }
+  if (!Iinf || !Iloc) { return(Args); } // no items
+
+  /*****
+   iinf: full box, count (16-bit if version 0, else 32-bit), then infe atoms.
+   infe version 2/3: item ID (16/32 bits), protection (16), type (4cc)
+   infe version 0/1: item ID (16), protection (16), name, content type
+   *****/
+  if (Iinf+8 > IinfEnd) { return(Args); } // overflow
+  Version = Mmap->mem[Iinf];
+  if (Version==0) { Count = readbe16(Mmap->mem+Iinf+4); Pos = Iinf+6; }
+  else { Count = (uint32_t)readbe32(Mmap->mem+Iinf+4); Pos = Iinf+8; }
+  ItemMax = Min(Count, (IinfEnd-Pos)/12); // each infe is at least 12 bytes
+  ItemID = (uint32_t*)calloc(ItemMax+1,sizeof(uint32_t));
+  ItemType = (byte*)calloc(ItemMax+1,1);
+  for(c=0; (c < Count) && (Pos+12 <= IinfEnd) && (Items < ItemMax); c++)
+    {
+    Data = Mmap->mem+Pos;
+    AtomLen = (uint32_t)readbe32(Data);
+    if ((AtomLen < 12) || (Pos+AtomLen > IinfEnd)) { break; } // overflow
+    if (!memcmp(Data+4,"infe",4))
+      {
+      Version = Data[8];
+      ItemID[Items]=0; ItemType[Items]=0;
+      if ((Version==2) && (AtomLen >= 20))
+	{
+	ItemID[Items] = readbe16(Data+12);
+	Data += 16; // item type
+	}
+      else if ((Version==3) && (AtomLen >= 22))
+	{
+	ItemID[Items] = (uint32_t)readbe32(Data+12);
+	Data += 18; // item type
+	}
+      else if (Version < 2)
+	{
+	ItemID[Items] = readbe16(Data+12);
+	Data = (const byte*)"mime"; // content type is XMP or other text
+	}
+      else { Data=NULL; }
+
+      if (!Data) { ; }
+      else if (!memcmp(Data,"Exif",4)) { ItemType[Items]='e'; Items++; }
+      else if (!memcmp(Data,"mime",4) || !memcmp(Data,"SEAL",4)) { ItemType[Items]='s'; Items++; }
+      }
+    Pos += AtomLen;
+    }
+
+  /*****
+   iloc: full box
+     4 bits offset size, 4 bits length size
+     4 bits base offset size, 4 bits index size (version 1/2) or reserved
+     item count (16-bit if version < 2, else 32-bit)
+   For each item:
+     item ID (16-bit if version < 2, else 32-bit)
+     construction method (version 1/2: 16 bits, low 4 bits are the method)
+     data reference index (16)
+     base offset (base offset size)
+     extent count (16)
+     For each extent:
+       extent index (index size; version 1/2 only)
+       extent offset (offset size)
+       extent length (length size)
+   *****/
+  if (Items > 0) do
+    {
+    int OffsetSize, LengthSize, BaseSize, IndexSize;
+    uint32_t ID, Method, Extents, e;
+    uint64_t Base, Offset, Length;
+
+    if (Iloc+8 > IlocEnd) { break; } // overflow
+    Version = Mmap->mem[Iloc];
+    if (Version > 2) { break; } // unknown
+    OffsetSize = Mmap->mem[Iloc+4] >> 4;
+    LengthSize = Mmap->mem[Iloc+4] & 0x0f;
+    BaseSize = Mmap->mem[Iloc+5] >> 4;
+    IndexSize = (Version > 0) ? (Mmap->mem[Iloc+5] & 0x0f) : 0;
+    if (!_BMFFsizeOK(OffsetSize) || !_BMFFsizeOK(LengthSize) ||
+	!_BMFFsizeOK(BaseSize) || !_BMFFsizeOK(IndexSize)) { break; } // must be 0, 4, or 8
+    if (Version < 2) { Count = readbe16(Mmap->mem+Iloc+6); Pos = Iloc+8; }
+    else { Count = (uint32_t)readbe32(Mmap->mem+Iloc+6); Pos = Iloc+10; }
+
+    for(c=0; c < Count; c++)
+      {
+      // Fixed part of the item
+      if (Pos + 4+2+2+BaseSize+2 > IlocEnd) { break; } // overflow
+      if (Version < 2) { ID = readbe16(Mmap->mem+Pos); Pos+=2; }
+      else { ID = (uint32_t)readbe32(Mmap->mem+Pos); Pos+=4; }
+      Method = 0;
+      if (Version > 0) { Method = readbe16(Mmap->mem+Pos) & 0x0f; Pos+=2; }
+      Pos += 2; // data reference index
+      Base = _BMFFreadN(Mmap->mem+Pos,BaseSize); Pos += BaseSize;
+      Extents = readbe16(Mmap->mem+Pos); Pos+=2;
+      if (Pos + (size_t)Extents*(IndexSize+OffsetSize+LengthSize) > IlocEnd) { break; } // overflow
+
+      // Is this an item of interest?
+      for(i=0; (i < Items) && (ItemID[i] != ID); i++) { ; }
+
+      for(e=0; e < Extents; e++)
+	{
+	Pos += IndexSize;
+	Offset = _BMFFreadN(Mmap->mem+Pos,OffsetSize); Pos += OffsetSize;
+	Length = _BMFFreadN(Mmap->mem+Pos,LengthSize); Pos += LengthSize;
+	if (i >= Items) { continue; } // not interesting
+
+	// Find the absolute offset
+	Offset += Base;
+	if (Method==1) // relative to idat
+	  {
+	  if (!Idat) { continue; }
+	  Offset += Idat;
+	  if ((Length > IdatEnd) || (Offset > IdatEnd - Length)) { continue; } // overflow
+	  }
+	else if (Method != 0) { continue; } // item references are not supported
+	if ((Length == 0) || (Length > Mmap->memsize) || (Offset > Mmap->memsize - Length)) { continue; } // overflow
+
+	if (ItemType[i]=='e') // Exif: skip to the TIFF header
+	  {
+	  uint32_t TiffOffset;
+	  if (Length < 4) { continue; }
+	  TiffOffset = (uint32_t)readbe32(Mmap->mem+Offset);
+	  if (TiffOffset > Length-4) { continue; }
+	  Offset += 4+TiffOffset; Length -= 4+TiffOffset;
+	  if ((Length > 6) && !memcmp(Mmap->mem+Offset,"Exif\0\0",6)) { Offset+=6; Length-=6; }
+	  Args = Seal_Exif(Args,Mmap,Offset,Length);
+	  }
+	else
+	  {
+	  Args = SealVerifyBlock(Args, Offset, Offset+Length, Mmap);
+	  }
+	}
+      }
+    } while(0);
+
+  free(ItemID);
+  free(ItemType);
+  return(Args);
+} /* _BMFFitems() */
+
 /**************************************
  _BMFFwalk(): Given a BMFF, walk the structures.
  Evaluate any SEAL or text chunks.
@@ -179,7 +378,6 @@ sealfield *	_BMFFwalk	(sealfield *Args, size_t DataStart, size_t DataEnd, unsign
 {
   sealfield *bmff;
   size_t AtomLen, AtomHeader;
-  int a;
 
   bmff = SealSearch(Args,"@BMFF");
   while(DataStart+8 <= DataEnd)
@@ -195,6 +393,7 @@ sealfield *	_BMFFwalk	(sealfield *Args, size_t DataStart, size_t DataEnd, unsign
 	if (DataStart + 16 > DataEnd) { break; } // overflow
 	AtomLen = readbe64(Mmap->mem + DataStart + 8);
 	AtomHeader+=8;
+	if ((AtomLen < AtomHeader+4) || (AtomLen > DataEnd-DataStart)) { break; } // overflow
 	}
 
     // Track the tag
@@ -215,42 +414,27 @@ sealfield *	_BMFFwalk	(sealfield *Args, size_t DataStart, size_t DataEnd, unsign
 
     // Look for recursive structures
     //DEBUGPRINT("MBFF: %.*s  [%ld]",(int)bmff->ValueLen,bmff->Value,(long)AtomLen);
-    for(a=0; BMFFatoms[a].type; a++)
+    switch(BMFFatomHash.Find(readbe32(Mmap->mem+DataStart+4)))
 	{
-	if (memcmp(BMFFatoms[a].name,Mmap->mem+DataStart+4,4)) { continue; }
 #if 0
-	else if (BMFFatoms[a].type=='r') // RECURSE!
-	  {
-	  // RECURSE!
+	case 'r': // RECURSE!
 	  Args = _BMFFwalk(Args, DataStart+AtomHeader, DataStart+AtomLen, Depth+1, Mmap);
-	  }
-	else if (BMFFatoms[a].type=='i') // iinf array of items
-	  {
-	  uint32_t Version, Count, c;
-	  if (AtomLen < 18) { break; } // overflow
-	  Version = readbe16(Mmap->mem+DataStart+AtomHeader+0);
-	  if (Version==0) { Count = readbe16(Mmap->mem+DataStart+AtomHeader+4); }
-	  else { Count = readbe32(Mmap->mem+DataStart+AtomHeader+4); }
-	  }
-	else if (BMFFatoms[a].type=='l') // iloc array of items
-	  {
-	  uint32_t Version, Count, c;
-	  if (AtomLen < 18) { break; } // overflow
-	  Version = Mmap->mem[DataStart+AtomHeader];
-	  if (Version < 2) { Count = readbe16(Mmap->mem+DataStart+AtomHeader+6); }
-	  else { Count = readbe32(Mmap->mem+DataStart+AtomHeader+6); }
-	  }
+	  break;
 #endif
-	else if (BMFFatoms[a].type=='s') // search for SEAL!
-	  {
+	case 'm': // items in iinf/iloc
+	  if (Depth == 0) // only top-level items are global
+	    {
+	    Args = _BMFFitems(Args, DataStart+AtomHeader, DataStart+AtomLen, Mmap);
+	    }
+	  break;
+	case 's': // search for SEAL!
 	  Args = SealVerifyBlock(Args, DataStart, DataStart+AtomLen, Mmap);
-	  }
-	else if (BMFFatoms[a].type=='e') // search EXIF for SEAL!
-	  {
+	  break;
+	case 'e': // search EXIF for SEAL!
 	  // Process possible EXIF for SEAL record.
 	  Args = Seal_Exif(Args,Mmap,DataStart,AtomLen);
-	  }
-	break;
+	  break;
+	default: break; // unknown atom
 	}
 
     // Continue
@@ -118,15 +118,116 @@
 #include <ctype.h>
 #include <string.h>
 
-#include <endian.h> // for MPF endian
-
 #include "seal.hpp"
 #include "files.hpp"
 #include "formats.hpp"
 #include "seal-parse.hpp"
 #include "sign.hpp"
+#include "fourcc.hpp"
 
 #pragma GCC visibility push(hidden)
+
+// One planned MPF update: 4 bytes at an absolute file offset
+typedef struct
+  {
+  size_t Offset;
+  byte Value[4];
+  } jpegpatch;
+
+/**************************************
+ Known APP labels to skip.
+ These can contain nested media and don't support
+ their own comment structure.
+ **************************************/
+struct jpeglabel
+  {
+  int LabelLen;
+  const char *Label; // some labels are null-terminated; "standard" /smh
+  };
+constexpr jpeglabel KnownLabel[] =
+  {
+  // Ordered by length (shortest match first)
+  { 3, "JP\0" },
+  { 4, "JPN\0" },
+  { 4, "HPQ-" },
+  { 4, "DP2\0" },
+  { 4, "PIC\0" },
+  { 5, "AROT\0" },
+  { 5, "JFIF\0" },
+  { 5, "JFXX\0" },
+  { 5, "HPSC\0" },
+  { 5, "H3X0\0" },
+  { 5, "FPXR\0" },
+  { 5, "MOTO\0" },
+  { 5, "XMTH\0" },
+  { 6, "Adobe\0" },
+  { 6, "Ducky\0" },
+  { 6, "AJPEG\0" },
+  { 7, "SCRNAIL" },
+  { 7, "MMIMETA" },
+  { 8, "Ocad$Rev" },
+  { 8, "Qualcomm" },
+  { 10, "ssuniqueid" },
+  { 11, "HPQ-Capture" },
+  { 12, "ICC_PROFILE\0" },
+  { 14, "Photoshop 3.0\0" },
+  { 17, "GenaPhotoStamperd" },
+  // Permit "XMP\0" for XMP metadata
+  // Permit "http://ns.adobe.com/\0" for XMP extension
+  };
+
+/*****
+ Hash the first 4 bytes of each label.
+ 3-byte labels ("JP\0") end with a null, so the 4th byte is zero;
+ they are found by masking the 4th byte.
+ Labels that share the first 4 bytes (e.g., "HPQ-" and "HPQ-Capture")
+ keep the shortest; it matches everything the longer one does.
+ *****/
+constexpr auto KnownLabelKey = [](const jpeglabel &L) { return(FourCC(L.Label) & ((L.LabelLen < 4) ? 0xffffff00 : 0xffffffff)); };
+constexpr auto KnownLabelValue = [](const jpeglabel &, size_t i) { return((uint8_t)(i+1)); };
+constexpr fourcchash<6> KnownLabelHash = FourCCHashBuild<6>(KnownLabel,KnownLabelKey,KnownLabelValue);
+static_assert(FourCCHashCheck(KnownLabelHash,KnownLabel,KnownLabelKey,KnownLabelValue),"JPEG hash does not match KnownLabel");
+
+/**************************************
+ _JPEGknownLabelCheck(): Ensure hashing by 4 bytes is equivalent to
+ checking every label.
+ The entry kept for a key must be a prefix of every label with that key.
+ **************************************/
+constexpr bool	_JPEGknownLabelCheck	()
+{
+  for(const jpeglabel &L : KnownLabel)
+    {
+    const jpeglabel &First = KnownLabel[KnownLabelHash.Find(KnownLabelKey(L))-1];
+    if (First.LabelLen > L.LabelLen) { return(false); }
+    for(int i=0; i < First.LabelLen; i++)
+      {
+      if (First.Label[i] != L.Label[i]) { return(false); }
+      }
+    }
+  return(true);
+} /* _JPEGknownLabelCheck() */
+static_assert(_JPEGknownLabelCheck(),"KnownLabel entries sharing 4 bytes must be prefixes");
+
+/**************************************
+ _JPEGknownLabel(): Is this APP block a known label to skip?
+ Label is the start of the APP data (after the length).
+ BlockSize includes the 2-byte length.
+ **************************************/
+bool	_JPEGknownLabel	(const byte *Label, size_t BlockSize)
+{
+  uint32_t Key;
+  uint8_t v;
+
+  if (BlockSize < 6) { return(false); } // too small for any label
+  Key = readbe32(Label);
+  v = KnownLabelHash.Find(Key);
+  if (!v) { v = KnownLabelHash.Find(Key & 0xffffff00); } // 3-byte label?
+  if (!v) { return(false); }
+  v--;
+  if ((size_t)KnownLabel[v].LabelLen+2 >= BlockSize) { return(false); } // too small
+  return(!memcmp(Label, KnownLabel[v].Label, KnownLabel[v].LabelLen));
+} /* _JPEGknownLabel() */
+
 /**************************************
  _JPEGblock(): Generate the signature block.
  Return a stub block.
@@ -226,9 +327,16 @@ sealfield *     _JPEGblock   (sealfield *Args, uint16_t Tag)
 } /* _JPEGblock() */
 
 /**************************************
- _SealFileWriteMPF(): Update the MPF record's offsets.
+ _JPEGmpfPlan(): Plan the MPF record's offset updates.
+ Nothing is copied or written. Instead, every value that needs to
+ change is stored in the Patch list as an absolute file offset and
+ the new 4 bytes (already in the MPF's endian).
+ Since the MPF comes before the 0xffda, the offsets are the same in
+ the source and destination files.
+ Caller must free() the Patch list.
+ Returns: number of patches.
  **************************************/
-void	_SealFileWriteMPF	(FILE *Fout, size_t IncValue, size_t FFDAoffset, size_t *MPFoffset, mmapfile *Mmap)
+size_t	_JPEGmpfPlan	(size_t IncValue, size_t FFDAoffset, size_t *MPFoffset, mmapfile *Mmap, jpegpatch **Patch)
 {
   /*****
    Multi-Picture Format
@@ -260,44 +368,48 @@ void	_SealFileWriteMPF	(FILE *Fout, size_t IncValue, size_t FFDAoffset, size_t *
        2 byte: dependency
        2 byte: dependency
    *****/
+  #define Read16(x) ((Endian==1234) ? readle16(x) : readbe16(x))
+  #define Read32(x) ((Endian==1234) ? (uint32_t)readle32(x) : (uint32_t)readbe32(x))
   int Endian=0;
-  sealfield *MPF;
+  byte *MPF; // view into the source file; never modified
+  size_t MPFlen;
   size_t v, ifdoffset, type;
   size_t count, co, c;
   size_t entries, entriesoffset, eo, e, esize, eoffset;
-  bool IsError=false;
+  size_t PatchCount=0, PatchMax;
 
-  // Allocate memory
-  MPF = SealSetBin(NULL, "MPF", MPFoffset[1]-MPFoffset[0], Mmap->mem + MPFoffset[0]);
-  MPF->Type='x'; // for debugging
+  MPF = Mmap->mem + MPFoffset[0];
+  MPFlen = MPFoffset[1]-MPFoffset[0];
+  // At most one patch per 16-byte entry
+  PatchMax = MPFlen/16 + 1;
+  *Patch = (jpegpatch*)calloc(PatchMax,sizeof(jpegpatch));
 
   // Skip APP header
   ifdoffset = 6; // uint16(APPlen) MPF \0
 
   // Find endian
-  if (ifdoffset+4 > MPF->ValueLen) { IsError=true; goto MPFdone; }
-  if (!memcmp(MPF->Value+ifdoffset,"II*\0",4)) { Endian = 1234; }
-  else if (!memcmp(MPF->Value+ifdoffset,"MM\0*",4)) { Endian = 4321; }
-  else { IsError=true; goto MPFdone; }
+  if (ifdoffset+4 > MPFlen) { goto MPFerror; }
+  if (!memcmp(MPF+ifdoffset,"II*\0",4)) { Endian = 1234; }
+  else if (!memcmp(MPF+ifdoffset,"MM\0*",4)) { Endian = 4321; }
+  else { goto MPFerror; }
 
   // Process each IFD (stop at zero or if it tries to go backwards; no loops!
   ifdoffset+=4;
-  while((ifdoffset > 0) && (ifdoffset+6+4 < MPF->ValueLen))
+  while((ifdoffset > 0) && (ifdoffset+6+4 < MPFlen))
     {
     // Load value by endian
-    if (Endian == 1234) { v = readle32(MPF->Value+ifdoffset); }
-    else { v = readbe32(MPF->Value+ifdoffset); }
+    v = Read32(MPF+ifdoffset);
     v += 6; // relative to endian definition
 
     // Now process the records
     entriesoffset = entries = 0;
     if (v == 0) { break; } // done
-    if (ifdoffset+2 > MPF->ValueLen) { IsError=true; goto MPFdone; } // overflow
-    if (v <= ifdoffset) { IsError=true; goto MPFdone; } // looping
+    if (ifdoffset+2 > MPFlen) { goto MPFerror; } // overflow
+    if (v <= ifdoffset) { goto MPFerror; } // looping
     ifdoffset = v;
+    if (ifdoffset+2 > MPFlen) { goto MPFerror; } // overflow
 
-    if (Endian == 1234) { count = readle16(MPF->Value+ifdoffset); }
-    else { count = readbe16(MPF->Value+ifdoffset); }
+    count = Read16(MPF+ifdoffset);
     ifdoffset += 2;
 
     for(c=0; c < count; c++)
@@ -305,28 +417,25 @@ void	_SealFileWriteMPF	(FILE *Fout, size_t IncValue, size_t FFDAoffset, size_t *
       co = ifdoffset; // count offset
       ifdoffset += 12;
 
-      if (co + 12 > MPF->ValueLen) { IsError=true; goto MPFdone; } // overflow
-      if (Endian == 1234) { type = readle16(MPF->Value+co); }
-      else { type = readbe16(MPF->Value+co); }
+      if (co + 12 > MPFlen) { goto MPFerror; } // overflow
+      type = Read16(MPF+co);
 
       co += 8;
       if (type == 0xb001) // number of images
 	{
-	if (Endian == 1234) { entries = readle32(MPF->Value+co); }
-	else { entries = readbe32(MPF->Value+co); }
+	entries = Read32(MPF+co);
 	}
       if (type == 0xb002) // if it's the offset to an image
 	{
-	if (Endian == 1234) { entriesoffset = readle32(MPF->Value+co); }
-	else { entriesoffset = readbe32(MPF->Value+co); }
-	// Ugh. The offset is relative 
+	entriesoffset = Read32(MPF+co);
+	// Ugh. The offset is relative
 	entriesoffset += 6; // relative to endian definition
 	}
       } // foreach entry
 
     // Now process each entry for the IFD
     if (entriesoffset <= 0) { entries=0; } // not set; skip any entries
-    for(e=0; e < entries; e++)
+    for(e=0; (e < entries) && (PatchCount < PatchMax); e++)
 	{
         /*****
          Each entry has 16 bytes, but I only care about
@@ -339,18 +448,13 @@ void	_SealFileWriteMPF	(FILE *Fout, size_t IncValue, size_t FFDAoffset, size_t *
          *****/
         // Any overflow? Just process the next IFD.
         eo = entriesoffset + e*16;
-        if (eo + 12 > MPF->ValueLen) { break; }
+        if (eo + 12 > MPFlen) { break; }
 
 	// 4-bytes: skip attribute/type
-
 	// 4-bytes: Load size
-        if (Endian == 1234) { esize = readle32(MPF->Value+eo+4); }
-        else { esize = readbe32(MPF->Value+eo+4); }
-
+        esize = Read32(MPF+eo+4);
 	// 4-bytes: Load offset
-        if (Endian == 1234) { eoffset = readle32(MPF->Value+eo+8); }
-        else { eoffset = readbe32(MPF->Value+eo+8); }
-
+        eoffset = Read32(MPF+eo+8);
 	// 4-bytes: Skip dependents flags
 
 	// Now: What needs to shift???
@@ -358,44 +462,40 @@ void	_SealFileWriteMPF	(FILE *Fout, size_t IncValue, size_t FFDAoffset, size_t *
 
 	else if ((eoffset <= FFDAoffset) && (eoffset+esize >= FFDAoffset)) // size grows
 	  {
-	  // size is going to increase 
+	  // size is going to increase
 	  esize += IncValue;
-	  if (Endian == 1234) { esize = htole32(esize); }
-	  else { esize = htobe32(esize); }
-	  writele32(MPF->Value+eo+4,esize);
+	  (*Patch)[PatchCount].Offset = MPFoffset[0]+eo+4;
+	  if (Endian == 1234) { writele32((*Patch)[PatchCount].Value,esize); }
+	  else { writebe32((*Patch)[PatchCount].Value,esize); }
+	  PatchCount++;
 	  }
 
 	else if (eoffset > FFDAoffset) // offset shifts
           {
 	  eoffset += IncValue;
-	  if (Endian == 1234) { eoffset = htole32(eoffset); }
-	  else { eoffset = htobe32(eoffset); }
-	  writele32(MPF->Value+eo+8,eoffset);
+	  (*Patch)[PatchCount].Offset = MPFoffset[0]+eo+8;
+	  if (Endian == 1234) { writele32((*Patch)[PatchCount].Value,eoffset); }
+	  else { writebe32((*Patch)[PatchCount].Value,eoffset); }
+	  PatchCount++;
 	  }
         } // foreach entry
 
     // Load pointer to next IFD
-    if (Endian == 1234) { v = readle32(MPF->Value+ifdoffset); }
-    else { v = readbe32(MPF->Value+ifdoffset); }
+    if (ifdoffset+4 > MPFlen) { break; } // overflow
+    v = Read32(MPF+ifdoffset);
     if (v < ifdoffset) { break; } // no loops
     if (v == 0) { break; } // no next IFD
     ifdoffset = v+6;
     } // foreach item in the IFD
 
-  
-MPFdone:
-  if (IsError)
-    {
-    printf(" ERROR: Invalid MPF metadata block; not fixing.\n");
-    SealFileWrite(Fout, MPFoffset[1]-MPFoffset[0], Mmap->mem + MPFoffset[0]);
-    }
-  else
-    {
-    SealFileWrite(Fout, MPF->ValueLen, MPF->Value);
-    }
-  SealFree(MPF);
-  return;
-} /* _SealFileWriteMPF() */
+  return(PatchCount);
+
+MPFerror:
+  printf(" ERROR: Invalid MPF metadata block; not fixing.\n");
+  return(0);
+  #undef Read16
+  #undef Read32
+} /* _JPEGmpfPlan() */
 #pragma GCC visibility pop
 
 /**************************************
@@ -448,9 +548,11 @@ bool    Seal_isJPEG      (mmapfile *Mmap)
 sealfield *     Seal_JPEGsign    (sealfield *Rec, mmapfile *MmapIn, size_t FFDAoffset, uint16_t Tag)
 {
   const char *fname;
-  FILE *Fout;
   sealfield *block;
+  mmapfile *MmapOut;
   size_t MPFoffset[2]={0,0};
+  jpegpatch *Patch=NULL;
+  size_t PatchCount=0, p;
 
   fname = SealGetText(Rec,"@FilenameOut");
   if (!fname) { return(Rec); } // not signing
@@ -477,57 +579,35 @@ sealfield *     Seal_JPEGsign    (sealfield *Rec, mmapfile *MmapIn, size_t FFDAo
 	MPFoffset[0]=0;
 	}
 
-  // Open file for writing!
-  Fout = SealFileOpen(fname,"w+b"); // returns handle or aborts
-  if (!Fout)
-    {
-    fprintf(stderr," ERROR: Cannot create file (%s). Aborting.\n",fname);
-    exit(0x80);
-    }
-
   // Grab the new block placeholder
   Rec = _JPEGblock(Rec,Tag); // populates "@BLOCK"
   block = SealSearch(Rec,"@BLOCK");
 
-  // Write to file!!!
-  // NOTE: Not using SealInsert() because of special case MPF
-  rewind(Fout); // should not be needed
-
-  // Store up to the 0xffda
-  if (MPFoffset[0] == 0)
+  /*****
+   Plan, then copy.
+   MPF offsets that point past the insertion must be updated.
+   Compute the list of changes first, then copy the file in one
+   pass (SealInsert), then apply the few changed bytes to the output.
+   *****/
+  if (MPFoffset[0] > 0)
     {
-    SealFileWrite(Fout, FFDAoffset, MmapIn->mem);
+    PatchCount = _JPEGmpfPlan(block->ValueLen, FFDAoffset, MPFoffset, MmapIn, &Patch);
     }
-  else
+
+  // Insert signature block before the 0xffda
+  MmapOut = SealInsert(Rec,MmapIn,FFDAoffset);
+  if (MmapOut)
     {
-    // Write up to MPF
-    SealFileWrite(Fout, MPFoffset[0], MmapIn->mem);
-    // Write updated MPF
-    _SealFileWriteMPF(Fout, block->ValueLen, FFDAoffset, MPFoffset, MmapIn);
-    // Write from end-of-MPF to 0xffda
-    SealFileWrite(Fout, FFDAoffset - MPFoffset[1], MmapIn->mem + MPFoffset[1]);
+    // Apply MPF updates (all are before the insertion point)
+    for(p=0; p < PatchCount; p++)
+      {
+      memcpy(MmapOut->mem + Patch[p].Offset, Patch[p].Value, 4);
+      }
+    // Sign it!
+    SealSign(Rec,MmapOut);
+    MmapFree(MmapOut);
     }
-
-  // Make 's' offset relative to the file
-  {
-  size_t *s;
-  s = SealGetIarray(Rec,"@s");
-  s[0] += ftell(Fout);
-  s[1] += ftell(Fout);
-  }
-
-  // Append signature block
-  SealFileWrite(Fout, block->ValueLen, block->Value);
-
-  // Store everything else (0xffda, stream, and any trailers)
-  SealFileWrite(Fout, MmapIn->memsize - FFDAoffset, MmapIn->mem + FFDAoffset);
-  SealFileClose(Fout);
-
-  // Insert new signature
-  mmapfile *MmapOut;
-  MmapOut = MmapFile(fname,PROT_WRITE);
-  SealSign(Rec,MmapOut);
-  MmapFree(MmapOut);
+  if (Patch) { free(Patch); }
 
   return(Rec);
 } /* Seal_JPEGsign() */
@@ -652,50 +732,10 @@ sealfield *	Seal_JPEG	(sealfield *Args, mmapfile *Mmap)
        Skip known-blocks that can contain nested media and that don't
        support their own comment structure.
        *****/
-      int kl;
-      static struct // known block types to skip
-	{
-	int LabelLen; 
-	const char *Label; // some labels are null-terminated; "standard" /smh
-	} KnownLabel[] =
-	{
-	  // Ordered by length (stop searching if it's too small)
-	  { 3, "JP\0" },
-	  { 4, "JPN\0" },
-	  { 4, "HPQ-" },
-	  { 4, "DP2\0" },
-	  { 4, "PIC\0" },
-	  { 5, "AROT\0" },
-	  { 5, "JFIF\0" },
-	  { 5, "JFXX\0" },
-	  { 5, "HPSC\0" },
-	  { 5, "H3X0\0" },
-	  { 5, "FPXR\0" },
-	  { 5, "MOTO\0" },
-	  { 5, "XMTH\0" },
-	  { 6, "Adobe\0" },
-	  { 6, "Ducky\0" },
-	  { 6, "AJPEG\0" },
-	  { 7, "SCRNAIL" },
-	  { 7, "MMIMETA" },
-	  { 8, "Ocad$Rev" },
-	  { 8, "Qualcomm" },
-	  { 10, "ssuniqueid" },
-	  { 11, "HPQ-Capture" },
-	  { 12, "ICC_PROFILE\0" },
-	  { 14, "Photoshop 3.0\0" },
-	  { 17, "GenaPhotoStamperd" },
-	  { 0, NULL } // end marker
-	  // Permit "XMP\0" for XMP metadata
-	  // Permit "http://ns.adobe.com/\0" for XMP extension
-	};
-      for(kl=0; KnownLabel[kl].Label && ((size_t)KnownLabel[kl].LabelLen+2 < BlockSize); kl++)
+      if (_JPEGknownLabel(Mmap->mem+Offset+4, BlockSize))
 	{
-	if (!memcmp(Mmap->mem+Offset+4, KnownLabel[kl].Label, KnownLabel[kl].LabelLen))
-	  {
-	  //DEBUGPRINT("Skipping known: %s",KnownLabel[kl].Label);
-	  goto NextBlock;
-	  }
+	//DEBUGPRINT("Skipping known: %.4s",Mmap->mem+Offset+4);
+	goto NextBlock;
 	}
 
       /*****
@@ -22,10 +22,26 @@
     This will display the SEAL record with the signature.
  5. Manual copy the signature into your file.
  6. Verify the file again to make sure the signature is correct.
+
+ Stream mode (-m - or -M -) is for external systems that compute
+ their own digests. It reads one digest per line from stdin and
+ writes one record per line to stdout, in the same order:
+   hexdigest [id=userid] [date=YYYYMMDDhhmmss[.fraction]]
+ id= sets the record's id (and double digest) for that line.
+ date= sets the signing date (local signing with --sf date...).
+ Blank lines are ignored. A bad line writes " ERROR: ..." in its
+ place and sets the return code to 0x80 at the end.
+ The key and prepared signer stay loaded. With --manual-jobs N,
+ local signing uses N threads (SealSignBulk). Lines that are already
+ waiting on stdin are signed together; a single line is answered
+ right away.
  ************************************************/
 #include <stdlib.h>
+#include <stdio.h>
 #include <ctype.h>
 #include <string.h>
+#include <unistd.h>
+#include <poll.h>
 
 #include <endian.h> // for MPF endian
 
@@ -34,6 +50,195 @@
 #include "seal-parse.hpp"
 #include "sign.hpp"
 
+// For openssl 3.x
+#include <openssl/evp.h>
+
+#pragma GCC visibility push(hidden)
+
+#define MANUAL_BATCH 64 // lines per thread per batch
+#define MANUAL_LINE 4096 // longest line
+
+// One input line and its output
+typedef struct
+  {
+  char *Line;
+  size_t LineNo;
+  sealfield *Rec; // parsed line to sign
+  char *Out; // or the error
+  } manualjob;
+
+// stdin buffer
+static char *ManualIn=NULL;
+static size_t ManualInLen=0, ManualInPos=0, ManualInMax=0;
+static bool ManualInEOF=false;
+
+/**************************************
+ _ManualRead(): Read more from stdin.
+ If Block is false, only read if data is waiting.
+ Returns: true if anything was read.
+ **************************************/
+bool	_ManualRead	(bool Block)
+{
+  struct pollfd Poll;
+  ssize_t Len;
+
+  if (ManualInEOF) { return(false); }
+  if (!Block)
+    {
+    Poll.fd = 0;
+    Poll.events = POLLIN;
+    if (poll(&Poll,1,0) <= 0) { return(false); }
+    }
+
+  // Keep the unread part
+  if (ManualInPos > 0)
+    {
+    memmove(ManualIn,ManualIn+ManualInPos,ManualInLen-ManualInPos);
+    ManualInLen -= ManualInPos;
+    ManualInPos = 0;
+    }
+  if (ManualInMax - ManualInLen < 65536)
+    {
+    ManualInMax = ManualInLen + 65536;
+    ManualIn = (char*)realloc(ManualIn,ManualInMax+1);
+    if (!ManualIn) // should never happen
+      {
+      fprintf(stderr,"ERROR: Unable to allocate the manual input buffer. Aborting.\n");
+      exit(0x80);
+      }
+    }
+
+  Len = read(0,ManualIn+ManualInLen,ManualInMax-ManualInLen);
+  if (Len <= 0) { ManualInEOF=true; return(false); }
+  ManualInLen += Len;
+  return(true);
+} /* _ManualRead() */
+
+/**************************************
+ _ManualLine(): Get the next complete line from the buffer.
+ Returns: allocated line (no newline), or NULL if none.
+ **************************************/
+char *	_ManualLine	()
+{
+  char *Start, *End;
+  char *Line;
+  size_t Len;
+
+  if (ManualInPos >= ManualInLen) { return(NULL); }
+  Start = ManualIn + ManualInPos;
+  End = (char*)memchr(Start,'\n',ManualInLen-ManualInPos);
+  if (End) { Len = End-Start; ManualInPos += Len+1; }
+  else if (ManualInEOF) { Len = ManualInLen-ManualInPos; ManualInPos = ManualInLen; } // last line
+  else { return(NULL); } // incomplete
+  if ((Len > 0) && (Start[Len-1]=='\r')) { Len--; }
+
+  Line = (char*)malloc(Len+1);
+  if (!Line) // should never happen
+    {
+    fprintf(stderr,"ERROR: Unable to allocate a manual input line. Aborting.\n");
+    exit(0x80);
+    }
+  memcpy(Line,Start,Len);
+  Line[Len]='\0';
+  return(Line);
+} /* _ManualLine() */
+
+/**************************************
+ _ManualError(): Make an error line.
+ Returns: allocated text.
+ **************************************/
+char *	_ManualError	(size_t LineNo, const char *Msg)
+{
+  char *Out;
+  Out = (char*)malloc(strlen(Msg)+80);
+  if (!Out) // should never happen
+    {
+    fprintf(stderr,"ERROR: Unable to allocate a manual error. Aborting.\n");
+    exit(0x80);
+    }
+  sprintf(Out," ERROR: Line %lu: %s. Skipping.",(unsigned long)LineNo,Msg);
+  return(Out);
+} /* _ManualError() */
+
+/**************************************
+ _ManualParse(): Parse one line for signing.
+ Sets Job->Rec (with '@digest1') or Job->Out (the error).
+ **************************************/
+void	_ManualParse	(sealfield *Base, manualjob *Job)
+{
+  sealfield *Rec;
+  const EVP_MD *Md;
+  char *Tok, *Save=NULL, *sf;
+  size_t Len, i, DateLen;
+
+  if (strlen(Job->Line) > MANUAL_LINE) { Job->Out = _ManualError(Job->LineNo,"line is too long"); return; }
+  Tok = strtok_r(Job->Line," \t",&Save);
+  Len = strlen(Tok);
+  if ((Len % 2) || (strspn(Tok,"0123456789abcdefABCDEF") != Len))
+    {
+    Job->Out = _ManualError(Job->LineNo,"digest is not hex");
+    return;
+    }
+  Md = EVP_get_digestbyname(SealGetText(Base,"da"));
+  if (!Md || ((size_t)EVP_MD_get_size(Md)*2 != Len))
+    {
+    Job->Out = _ManualError(Job->LineNo,"digest size does not match the digest algorithm (da)");
+    return;
+    }
+
+  Rec = SealClone(Base);
+  Rec = SealSetText(Rec,"@digest1",Tok);
+  SealHexDecode(SealSearch(Rec,"@digest1")); // hex to binary
+
+  // Optional parameters
+  sf = SealGetText(Rec,"sf");
+  while((Tok = strtok_r(NULL," \t",&Save)) != NULL)
+    {
+    if (!strncmp(Tok,"id=",3))
+      {
+      if (strchr(Tok+3,'"') && strchr(Tok+3,'\''))
+	{
+	SealFree(Rec);
+	Job->Out = _ManualError(Job->LineNo,"id contains mixed quotes");
+	return;
+	}
+      Rec = SealSetText(Rec,"id",Tok+3);
+      }
+    else if (!strncmp(Tok,"date=",5))
+      {
+      Tok += 5;
+      DateLen = 14;
+      if (isdigit(sf[4])) { DateLen += 1 + (sf[4]-'0'); }
+      if (strncmp(sf,"date",4) || (SealGetCindex(Rec,"@mode",0) != 'm'))
+	{
+	SealFree(Rec);
+	Job->Out = _ManualError(Job->LineNo,"date= needs local signing (-m) with --sf date");
+	return;
+	}
+      for(i=0; Tok[i]; i++)
+	{
+	if ((i==14) ? (Tok[i] != '.') : !isdigit(Tok[i])) { break; }
+	}
+      if (Tok[i] || (i != DateLen))
+	{
+	SealFree(Rec);
+	Job->Out = _ManualError(Job->LineNo,"date does not match the signing format (sf)");
+	return;
+	}
+      Rec = SealSetText(Rec,"@sigdatefixed",Tok);
+      }
+    else
+      {
+      SealFree(Rec);
+      Job->Out = _ManualError(Job->LineNo,"unknown parameter");
+      return;
+      }
+    }
+  Job->Rec = Rec;
+} /* _ManualParse() */
+
+#pragma GCC visibility pop
+
 /**************************************
  Seal_Manual(): Process manual signing.
  **************************************/
@@ -41,12 +246,11 @@ sealfield *	Seal_Manual	(sealfield *Args)
 {
   sealfield *digest;
 
-  Args = SealRecord(Args);
-
   digest = SealSearch(Args,"@digest1");
   if (digest)
     {
-    // sign it
+    // sign it (replace any signature from sizing)
+    Args = SealDel(Args,"@signatureenc");
     switch(SealGetCindex(Args,"@mode",0)) // sign it
 	{
 	// Only called with -M or -m
@@ -56,7 +260,111 @@ sealfield *	Seal_Manual	(sealfield *Args)
 	}
     }
 
+  Args = SealRecord(Args);
   printf("%s\n",SealGetText(Args,"@record"));
   return(Args);
 } /* Seal_Manual() */
 
+/**************************************
+ Seal_ManualStream(): Sign every digest from stdin.
+ Writes one record per line to stdout.
+ '--manual-jobs' sets the number of signing threads.
+ **************************************/
+sealfield *	Seal_ManualStream	(sealfield *Args)
+{
+  localsigner *Signer=NULL;
+  manualjob *Jobs;
+  sealfield **Recs;
+  int JobCount=1;
+  size_t Count, Max, RecCount, i, LineNo=0;
+  char *Line;
+
+  if (SealSearch(Args,"manual-jobs")) { JobCount = atoi(SealGetText(Args,"manual-jobs")); }
+  if ((JobCount < 1) || (JobCount > 1024))
+    {
+    fprintf(stderr,"ERROR: --manual-jobs must be from 1 to 1024. Aborting.\n");
+    exit(0x80);
+    }
+  if ((JobCount > 1) && (SealGetCindex(Args,"@mode",0) != 'm'))
+    {
+    fprintf(stderr,"ERROR: --manual-jobs is only for local signing (-m -). Aborting.\n");
+    exit(0x80);
+    }
+
+  Args = SealDel(Args,"@signatureenc");
+  if (SealGetCindex(Args,"@mode",0) == 'm') { Signer = SealLocalSigner(Args); }
+  Max = MANUAL_BATCH * JobCount;
+  Jobs = (manualjob*)calloc(Max,sizeof(manualjob));
+  Recs = (sealfield**)calloc(Max,sizeof(sealfield*));
+  if (!Jobs || !Recs) // should never happen
+    {
+    fprintf(stderr,"ERROR: Unable to allocate the manual batch. Aborting.\n");
+    exit(0x80);
+    }
+
+  for(;;)
+    {
+    // Collect lines: wait for the first, then take whatever is waiting
+    Count=0;
+    while(Count < Max)
+      {
+      Line = _ManualLine();
+      if (Line)
+	{
+	LineNo++;
+	if (!Line[strspn(Line," \t")]) { free(Line); continue; } // blank
+	Jobs[Count].Line = Line;
+	Jobs[Count].LineNo = LineNo;
+	Count++;
+	continue;
+	}
+      if (_ManualRead(Count==0)) { continue; }
+      // At EOF, an unterminated last line is still waiting
+      if (!ManualInEOF || (ManualInPos >= ManualInLen)) { break; }
+      }
+    if (Count==0) { break; } // end of input
+
+    // Parse the batch
+    RecCount=0;
+    for(i=0; i < Count; i++)
+      {
+      _ManualParse(Args,Jobs+i);
+      if (Jobs[i].Rec) { Recs[RecCount++] = Jobs[i].Rec; }
+      }
+
+    // Sign the batch
+    if (Signer) { SealSignBulk(Signer,RecCount,Recs,JobCount); }
+    else
+      {
+      for(i=0; i < RecCount; i++) { Recs[i] = SealSignURL(Recs[i]); }
+      }
+
+    // Write in order
+    RecCount=0;
+    for(i=0; i < Count; i++)
+      {
+      if (Jobs[i].Rec)
+	{
+	Jobs[i].Rec = SealRecord(Recs[RecCount++]);
+	printf("%s\n",SealGetText(Jobs[i].Rec,"@record"));
+	SealFree(Jobs[i].Rec);
+	}
+      else
+	{
+	printf("%s\n",Jobs[i].Out);
+	ReturnCode = 0x80;
+	free(Jobs[i].Out);
+	}
+      free(Jobs[i].Line);
+      memset(Jobs+i,0,sizeof(manualjob));
+      }
+    fflush(stdout);
+    }
+
+  // Clean up
+  free(Recs);
+  free(Jobs);
+  if (ManualIn) { free(ManualIn); }
+  ManualIn=NULL;
+  return(Args);
+} /* Seal_ManualStream() */
@@ -124,14 +124,24 @@ sealfield *	_MaWriteData	(sealfield *Rec, const char *Field, size_t Value)
 sealfield *	_Matroskawalk	(sealfield *Args, mmapfile *Mmap)
 {
   size_t iTag,iLen;
-  size_t Offset=0;
+  size_t Offset=0, LenStart;
 
   while(Offset < Mmap->memsize)
     {
     iTag = _MaReadData(Mmap,&Offset);
     if (iTag == (size_t)(-1)) { break; } // invalid
+    LenStart = Offset;
     iLen = _MaReadData(Mmap,&Offset);
     if (iLen == (size_t)(-1)) { break; } // invalid
+
+    // Live recordings use an unknown size (all bits set) for the
+    // Segment and Clusters. Walk their children (for --follow records).
+    if (((iTag == 0x8538067) || (iTag == 0xf43b675)) &&
+	(iLen == ((size_t)1 << (7*(Offset-LenStart))) - 1))
+	{
+	continue;
+	}
+
     if (Offset+iLen > Mmap->memsize) { break; } // overflow
 
     if (iTag == 0xa45dfa3) // if Header chunk
@@ -125,6 +125,15 @@ sealfield *	_SealWalkMPEG	(sealfield *Args, mmapfile *Mmap)
 	offset += 4;
 	scanStart=offset;
 	}
+    else if ((u32 == 0) && InHeader && (offset+9 <= Mmap->memsize) &&
+	     !memcmp(Mmap->mem+offset+4,"<seal",5)) // block between packs (--follow)
+	{
+	byte *End;
+	End = (byte*)memmem(Mmap->mem+offset+4,Mmap->memsize-offset-4,"/>",2);
+	if (!End) { offset++; continue; }
+	Args = SealVerifyBlock(Args, offset+4, End+2-Mmap->mem, Mmap);
+	offset = End+2-Mmap->mem;
+	}
     else { offset++; }
     }
   if (!InHeader) { Args = SealVerifyBlock(Args, scanStart, offset, Mmap); }
@@ -53,10 +53,31 @@
    - If there was tampering, then it is perfectly acceptable to
      have one invalid seal chunk followed by a valid chunk.
      It means one b=range is invalid, but the next one is still valid.
+
+ =====
+ CRC32:
+ The CRC is the standard (zlib) CRC-32, reflected polynomial 0xedb88320.
+ Normally only the new sEAl chunk needs a CRC.
+ With --check-crc, every chunk's CRC is checked (including huge IDATs),
+ so it needs to be fast:
+   - Slicing-by-8 with tables generated at compile time.
+   - x86-64 with PCLMULQDQ: carry-less multiplication folding.
+     (Intel: "Fast CRC Computation for Generic Polynomials Using
+     PCLMULQDQ Instruction".)
+   - ARMv8 with the CRC extension: crc32 instructions.
+     (Only when compiled with it; e.g., -march=armv8-a+crc.)
+ The implementation is selected once at runtime.
+ (The SSE4.2 crc32 instruction is CRC-32C; it's the wrong polynomial.)
  ************************************************/
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#if defined(__x86_64__)
+  #include <immintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+  #include <arm_acle.h>
+#endif
 #include "seal.hpp"
 #include "seal-parse.hpp"
 #include "sign.hpp"
@@ -64,45 +85,204 @@
 #include "formats.hpp"
 
 #pragma GCC visibility push(hidden)
-static uint32_t _PNG_table[256] = {255};
 
 /**************************************
- _PNGCrc32(): Calculate the PNG checksum.
- PNG CRC covers type+data, not chunk length or checksum.
+ _PNGtables: Slicing-by-8 CRC tables.
+ Table[0] is the classic byte-at-a-time table.
+ Table[k][n] is the CRC of byte n followed by k zero bytes.
+ Generated at compile time, so there is no initialization race.
  **************************************/
-uint32_t	_PNGCrc32	(uint32_t DataLen, byte *Data)
+struct _PNGcrctables { uint32_t Table[8][256]; };
+static constexpr _PNGcrctables _PNGcrcInit()
 {
-  uint32_t crc;
-  size_t n,j;
-
-  // Populate the CRC table
-  if (_PNG_table[0]==255)
+  _PNGcrctables T{};
+  uint32_t crc=0;
+  for(uint32_t n=0; n < 256; n++)
     {
-    memset(_PNG_table,0,256*sizeof(uint32_t));
-    for(n=0; n < 256; n++)
+    crc = n;
+    for(int j=0; j < 8; j++)
       {
-      crc = n;
-      for(j=0; j < 8; j++)
-	{
-	if (crc & 1) { crc = 0xedb88320L ^ (crc>>1); }
-	else { crc = (crc>>1); }
-	}
-      _PNG_table[n] = crc;
+      if (crc & 1) { crc = 0xedb88320L ^ (crc>>1); }
+      else { crc = (crc>>1); }
       }
+    T.Table[0][n] = crc;
     }
+  for(uint32_t n=0; n < 256; n++)
+    {
+    for(int k=1; k < 8; k++)
+      {
+      T.Table[k][n] = T.Table[0][T.Table[k-1][n] & 0xff] ^ (T.Table[k-1][n] >> 8);
+      }
+    }
+  return(T);
+}
+static constexpr _PNGcrctables _PNG_table = _PNGcrcInit();
 
-  /*****
-   Calculate the current value.
-   NOTE: This uses a do-loop.
-   Why? Because we don't want an infinite loop if DataLen=max size.
-   *****/
-  crc = 0xffffffffL; // initial value
-  for(n=0; n < DataLen; n++)
+/**************************************
+ _PNGCrc32Slice8(): Update a CRC with slicing-by-8.
+ Crc is the running (inverted) value.
+ **************************************/
+static uint32_t	_PNGCrc32Slice8	(uint32_t Crc, const byte *Data, size_t DataLen)
+{
+  const uint32_t (*T)[256] = _PNG_table.Table;
+  uint32_t lo,hi;
+
+  while(DataLen >= 8)
+    {
+    lo = Crc ^ (uint32_t)readle32(Data);
+    hi = (uint32_t)readle32(Data+4);
+    Crc = T[7][lo & 0xff] ^ T[6][(lo>>8) & 0xff] ^ T[5][(lo>>16) & 0xff] ^ T[4][lo>>24] ^
+	  T[3][hi & 0xff] ^ T[2][(hi>>8) & 0xff] ^ T[1][(hi>>16) & 0xff] ^ T[0][hi>>24];
+    Data += 8; DataLen -= 8;
+    }
+  while(DataLen > 0)
+    {
+    Crc = T[0][(Crc^Data[0]) & 0xff] ^ (Crc>>8);
+    Data++; DataLen--;
+    }
+  return(Crc);
+} /* _PNGCrc32Slice8() */
+
+#if defined(__x86_64__)
+/**************************************
+ _PNGCrc32Clmul(): Update a CRC using PCLMULQDQ folding.
+ Folds 64 bytes at a time, then 16 bytes at a time, then
+ a Barrett reduction to 32 bits.
+ Any tail (less than 16 bytes) uses slicing-by-8.
+ Crc is the running (inverted) value.
+ **************************************/
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t	_PNGCrc32Clmul	(uint32_t Crc, const byte *Data, size_t DataLen)
+{
+  // Bit-reflected constants for polynomial 0x04c11db7
+  const __m128i K1K2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+  const __m128i K3K4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+  const __m128i K5K0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+  const __m128i Poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+  const __m128i Mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+  __m128i x0,x1,x2,x3,x4,x5,x6,x7,x8;
+
+  if (DataLen < 64) { return(_PNGCrc32Slice8(Crc,Data,DataLen)); }
+
+  x1 = _mm_loadu_si128((const __m128i*)(Data+0x00));
+  x2 = _mm_loadu_si128((const __m128i*)(Data+0x10));
+  x3 = _mm_loadu_si128((const __m128i*)(Data+0x20));
+  x4 = _mm_loadu_si128((const __m128i*)(Data+0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)Crc));
+  Data += 64; DataLen -= 64;
+
+  // Fold 4x128 bits at a time
+  x0 = K1K2;
+  while(DataLen >= 64)
     {
-    crc = _PNG_table[(crc^Data[n]) & 0xff]^(crc>>8);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(Data+0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(Data+0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(Data+0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(Data+0x30)));
+    Data += 64; DataLen -= 64;
     }
-  crc = crc ^ 0xffffffffL;
-  return(crc);
+
+  // Fold into 128 bits
+  x0 = K3K4;
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  // Fold 128 bits at a time
+  while(DataLen >= 16)
+    {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)Data)), x5);
+    Data += 16; DataLen -= 16;
+    }
+
+  // Fold 128 bits to 64 bits
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x0 = K5K0;
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, Mask32);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduce to 32 bits
+  x0 = Poly;
+  x2 = _mm_and_si128(x1, Mask32);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, Mask32);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  Crc = (uint32_t)_mm_extract_epi32(x1, 1);
+
+  // Any remaining tail
+  return(_PNGCrc32Slice8(Crc,Data,DataLen));
+} /* _PNGCrc32Clmul() */
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+/**************************************
+ _PNGCrc32Arm(): Update a CRC using ARMv8 crc32 instructions.
+ Crc is the running (inverted) value.
+ **************************************/
+static uint32_t	_PNGCrc32Arm	(uint32_t Crc, const byte *Data, size_t DataLen)
+{
+  uint64_t u64;
+  while(DataLen >= 8)
+    {
+    memcpy(&u64,Data,8);
+    Crc = __crc32d(Crc,u64);
+    Data += 8; DataLen -= 8;
+    }
+  while(DataLen > 0)
+    {
+    Crc = __crc32b(Crc,Data[0]);
+    Data++; DataLen--;
+    }
+  return(Crc);
+} /* _PNGCrc32Arm() */
+#endif
+
+typedef uint32_t (*_PNGCrc32Func)(uint32_t Crc, const byte *Data, size_t DataLen);
+
+/**************************************
+ _PNGCrc32Select(): Pick the fastest CRC for this CPU.
+ **************************************/
+static _PNGCrc32Func	_PNGCrc32Select	()
+{
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) { return(_PNGCrc32Clmul); }
+#endif
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+  return(_PNGCrc32Arm);
+#endif
+  return(_PNGCrc32Slice8);
+} /* _PNGCrc32Select() */
+
+/**************************************
+ _PNGCrc32(): Calculate the PNG checksum.
+ PNG CRC covers type+data, not chunk length or checksum.
+ **************************************/
+uint32_t	_PNGCrc32	(uint32_t DataLen, const byte *Data)
+{
+  // Selected once; thread-safe static initialization
+  static const _PNGCrc32Func Crc32 = _PNGCrc32Select();
+  return(Crc32(0xffffffffL,Data,DataLen) ^ 0xffffffffL);
 } /* _PNGCrc32() */
 
 /**************************************
@@ -305,6 +485,7 @@ sealfield *	Seal_PNG	(sealfield *Args, mmapfile *Mmap)
   size_t IEND_offset=0;
   uint32_t ChunkSize;
   const char *FourCC;
+  bool CheckCRC;
 
   // Make sure it's a PNG.
   if (!Seal_isPNG(Mmap)) { return(Args); }
@@ -319,6 +500,7 @@ sealfield *	Seal_PNG	(sealfield *Args, mmapfile *Mmap)
    Especially zTxt! Signatures cannot be compressed.
 
    - Do not verify chunk checksums. (I'm fine if they are wrong.)
+     Unless --check-crc is set; then report every bad checksum.
    - Abort if the file appears corrupted. Do not sign corrupted files.
    - Ignore any data after the end of the IEND.
 
@@ -331,6 +513,7 @@ sealfield *	Seal_PNG	(sealfield *Args, mmapfile *Mmap)
    This way, the scope of all values is limited to Rec.
    When this finishes, moves the values I want to keep back into Args.
    *****/
+  CheckCRC = (SealSearch(Args,"check-crc") != NULL);
   Offset=8; // skip PNG header
   while(Offset+12 <= Mmap->memsize)
     {
@@ -346,6 +529,13 @@ sealfield *	Seal_PNG	(sealfield *Args, mmapfile *Mmap)
 
     //printf("PNG FourCC[%.4s]\n",FourCC); // DEBUGGING
 
+    // CRC covers type+data
+    if (CheckCRC &&
+	(_PNGCrc32(ChunkSize+4, Mmap->mem+Offset+4) != (uint32_t)readbe32(Mmap->mem+Offset+8+ChunkSize)))
+	{
+	fprintf(stderr," WARNING: PNG chunk '%.4s' at offset %lu has an invalid CRC.\n",FourCC,(unsigned long)Offset);
+	}
+
     // Stop at the IEND
     if (!memcmp(FourCC,"IEND",4)) { IEND_offset = Offset; break; }
     // text or seal can encode a signature
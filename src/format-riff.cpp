@@ -29,6 +29,28 @@
    - "SEAL" chunk under the top-level RIFF.
    - Any chunk under a "LIST" chunk under the top-level RIFF.
  The value of the SEAL chunk is a "<seal .../>" record.
+
+ =====
+ RF64 and BW64
+
+ RIFF sizes are 32-bits, so a RIFF cannot be larger than 4G.
+ RF64 (EBU Tech 3306) and BW64 (ITU-R BS.2088) are RIFF with
+ 64-bit sizes. The outer chunk is "RF64" or "BW64" and its 32-bit
+ size is 0xffffffff. The first chunk must be "ds64":
+   4-byte: ds64
+   4-byte: length (at least 28)
+   8-byte: RIFF size (replaces the outer 32-bit size)
+   8-byte: "data" chunk size
+   8-byte: sample count
+   4-byte: number of table entries
+   Table of 12-byte entries:
+     4-byte: FourCC
+     8-byte: chunk size
+ Any chunk with a 32-bit size of 0xffffffff uses the 64-bit size
+ from ds64.
+
+ When signing an RF64, the ds64 RIFF size is updated (and excluded
+ from the digest); the outer 32-bit size stays 0xffffffff.
  ************************************************/
 #include <stdlib.h>
 #include <ctype.h>
@@ -38,10 +60,12 @@
 #include "sign.hpp"
 #include "files.hpp"
 #include "formats.hpp"
+#include "fourcc.hpp"
 
 #pragma GCC visibility push(hidden)
 
-const char *_RIFFvalidate[] = {
+// Chunks that may contain a SEAL record
+constexpr const char *_RIFFvalidate[] = {
 	"SEAL", // SEAL record
 	"XMP ", // XMP data
 	// INFO fields
@@ -80,36 +104,84 @@ const char *_RIFFvalidate[] = {
 	"ITCH", // "Technician"
 	"IWEB", // "Internet Address"
 	"IWRI", // "Written by"
-	NULL
 	};
 
+// Compile-time perfect hash of _RIFFvalidate
+constexpr auto _RIFFvalidateKey = [](const char *Name) { return(FourCC(Name)); };
+constexpr auto _RIFFvalidateValue = [](const char *, size_t) { return((uint8_t)1); };
+constexpr fourcchash<7> _RIFFvalidateHash = FourCCHashBuild<7>(_RIFFvalidate,_RIFFvalidateKey,_RIFFvalidateValue);
+static_assert(FourCCHashCheck(_RIFFvalidateHash,_RIFFvalidate,_RIFFvalidateKey,_RIFFvalidateValue),"RIFF hash does not match _RIFFvalidate");
+
+/**************************************
+ _RIFFisRF64(): Is this RIFF really an RF64 or BW64?
+ Returns: offset to ds64 chunk, or 0 if not RF64.
+ **************************************/
+size_t	_RIFFisRF64	(mmapfile *Mmap)
+{
+  if (!Mmap || (Mmap->memsize < 12+8+28)) { return(0); }
+  if (memcmp(Mmap->mem,"RF64",4) && memcmp(Mmap->mem,"BW64",4)) { return(0); }
+  if (memcmp(Mmap->mem+12,"ds64",4)) { return(0); } // ds64 must be first
+  if ((uint32_t)readle32(Mmap->mem+16) < 28) { return(0); } // too short
+  return(12);
+} /* _RIFFisRF64() */
+
+/**************************************
+ _RIFFsize64(): Find the 64-bit size for a chunk in an RF64.
+ Ds64 is the offset to the ds64 chunk.
+ Returns: size, or 0xffffffff if not found.
+ **************************************/
+uint64_t	_RIFFsize64	(const byte *Id, size_t Ds64, mmapfile *Mmap)
+{
+  const byte *Data;
+  size_t Ds64size;
+  uint32_t t,TableLen;
+
+  if (!Ds64) { return(0xffffffff); } // not RF64
+  Data = Mmap->mem+Ds64;
+  Ds64size = (uint32_t)readle32(Data+4);
+  if (Ds64+8+Ds64size > Mmap->memsize) { return(0xffffffff); } // overflow
+
+  if (!memcmp(Id,"RF64",4) || !memcmp(Id,"BW64",4)) { return(readle64(Data+8)); }
+  if (!memcmp(Id,"data",4)) { return(readle64(Data+16)); }
+
+  // Check the table
+  TableLen = readle32(Data+32);
+  for(t=0; (t < TableLen) && (36+t*12+12 <= Ds64size+8); t++)
+    {
+    if (!memcmp(Data+36+t*12,Id,4)) { return(readle64(Data+36+t*12+4)); }
+    }
+  return(0xffffffff);
+} /* _RIFFsize64() */
+
 /**************************************
  _RIFFwalk(): Given a RIFF, walk the structures.
  Evaluate any SEAL or text chunks.
  Data and Pos may change during recursion, but Mmap is always source file.
+ Ds64 is the offset to the RF64 ds64 chunk, or 0 for RIFF.
+ Chunks are skipped by size; large "data" chunks are never read.
  NOTE: This is recursive!
  **************************************/
-sealfield *	_RIFFwalk	(sealfield *Args, size_t PosStart, size_t PosEnd, int Depth, mmapfile *Mmap)
+sealfield *	_RIFFwalk	(sealfield *Args, size_t PosStart, size_t PosEnd, int Depth, size_t Ds64, mmapfile *Mmap)
 {
   byte *Data; // simplify indexing
-  size_t size;
-  int r;
+  uint64_t size;
 
   while(PosStart+8 < PosEnd)
     {
     Data = Mmap->mem+PosStart;
 
-    size = readle32(Data+4);
-    if (PosStart+size > PosEnd) { break; } // overflow
+    size = (uint32_t)readle32(Data+4);
+    if (size == 0xffffffff) { size = _RIFFsize64(Data,Ds64,Mmap); } // RF64
+    if ((size > PosEnd) || (PosStart+8 > PosEnd-size)) { break; } // overflow
     //DEBUGPRINT("%*s%.4s: %.4s",Depth*2,"",Data,Data+8);
 
-    if ((Depth < 1) && !memcmp(Data,"RIFF",4)) // iterate on RIFF!
+    if ((Depth < 1) && (!memcmp(Data,"RIFF",4) || (Ds64 && (!memcmp(Data,"RF64",4) || !memcmp(Data,"BW64",4))))) // iterate on RIFF!
 	{
 	if (size > 4)
 	  {
 	  // "RIFF" size and 4-byte type
 	  //DEBUGPRINT("%*s%.4s: %.4s",Depth*2,"",Data,Data+8);
-	  Args = _RIFFwalk(Args, PosStart+12, PosStart+12+size, Depth+1, Mmap);
+	  Args = _RIFFwalk(Args, PosStart+12, PosStart+8+size, Depth+1, Ds64, Mmap);
 	  }
 	}
     else if ((Depth < 2) && !memcmp(Data,"LIST",4)) // iterate on LIST!
@@ -121,7 +193,7 @@ sealfield *	_RIFFwalk	(sealfield *Args, size_t PosStart, size_t PosEnd, int Dept
 	  // only recurse on "INFO"
 	  if (!memcmp(Data+8,"INFO",4))
 	    {
-	    Args = _RIFFwalk(Args, PosStart+12, PosStart+12+size, Depth+1, Mmap);
+	    Args = _RIFFwalk(Args, PosStart+12, PosStart+8+size, Depth+1, Ds64, Mmap);
 	    }
 	  }
 	}
@@ -133,11 +205,10 @@ sealfield *	_RIFFwalk	(sealfield *Args, size_t PosStart, size_t PosEnd, int Dept
     else // any other field
 	{
 	//DEBUGPRINT("%*s%.4s",Depth*2,"",Data);
-	for(r=0; _RIFFvalidate[r]; r++)
+	if (_RIFFvalidateHash.Find(readbe32(Data))) // Can it contain a SEAL record?
 	  {
-	  if (memcmp(_RIFFvalidate[r],Data,4)) { continue; }// Can it contain a SEAL record?
 	  Args = SealVerifyBlock(Args, PosStart+8, PosStart+8+size, Mmap);
-	  } // foreach possible chunk
+	  }
 	}
 
     // Skip size and padding
@@ -158,10 +229,17 @@ bool	Seal_isRIFF	(mmapfile *Mmap)
 {
   if (!Mmap || (Mmap->memsize < 16)) { return(false); }
 
+  /* RF64 and BW64 store the size in ds64 */
+  if (_RIFFisRF64(Mmap))
+    {
+    if (readle64(Mmap->mem+20)+8 != Mmap->memsize) { return(false); } /* incorrect size */
+    return(true);
+    }
+
   /* header begins with "RIFF" */
   if (memcmp(Mmap->mem,"RIFF",4)) { return(false); } /* not a RIFF! */
   size_t size;
-  size = readle32(Mmap->mem+4);
+  size = (uint32_t)readle32(Mmap->mem+4);
   if (size+8 != Mmap->memsize) { return(false); } /* incorrect size; corrupt or wrong format */
   return(true);
 } /* Seal_isRIFF() */
@@ -185,9 +263,11 @@ sealfield *	Seal_RIFFsign	(sealfield *Args, mmapfile *MmapIn)
   char *Opt;
   mmapfile *MmapOut;
   size_t BlockLen;
+  size_t Ds64;
 
   fname = SealGetText(Args,"@FilenameOut");
   if (!fname || !fname[0] || !MmapIn) { return(Args); } // not signing
+  Ds64 = _RIFFisRF64(MmapIn);
 
   // Set the range
   Opt = SealGetText(Args,"options"); // grab options list
@@ -208,7 +288,8 @@ sealfield *	Seal_RIFFsign	(sealfield *Args, mmapfile *MmapIn)
 	{
 	// if starting from the beginning of the file
 	// Skip the total file length.
-	Args = SealSetText(Args,"b","F~F+4,F+8");
+	if (Ds64) { Args = SealSetText(Args,"b","F~F+4,F+8~F+20,F+28"); } // RF64: also skip ds64 RIFF size
+	else { Args = SealSetText(Args,"b","F~F+4,F+8"); }
 	}
   // Range covers signature and end of record.
   Args = SealAddText(Args,"b","~S");
@@ -247,12 +328,20 @@ sealfield *	Seal_RIFFsign	(sealfield *Args, mmapfile *MmapIn)
   BlockLen = block->ValueLen;
   writele32(block->Value+4,BlockLen-8);
 
+  // RIFF cannot hold more than 4G
+  if (!Ds64 && (MmapIn->memsize + BlockLen - 8 > 0xffffffff))
+    {
+    printf(" ERROR: RIFF is too large to sign; must be RF64. Skipping.\n");
+    return(Args);
+    }
+
   // Write the output; append new record to the end of the file
   MmapOut = SealInsert(Args,MmapIn,MmapIn->memsize);
   if (MmapOut)
     {
     // Update file (initial RIFF block) with new size
-    writele32(MmapOut->mem + 4, MmapOut->memsize - 8);
+    if (Ds64) { writele64(MmapOut->mem + Ds64 + 8, (uint64_t)(MmapOut->memsize - 8)); } // RF64 size
+    else { writele32(MmapOut->mem + 4, MmapOut->memsize - 8); }
     // Sign it!
     SealSign(Args,MmapOut);
     MmapFree(MmapOut);
@@ -271,7 +360,7 @@ sealfield *	Seal_RIFF	(sealfield *Args, mmapfile *Mmap)
   // Make sure it's a RIFF.
   if (!Seal_isRIFF(Mmap)) { return(Args); }
 
-  Args = _RIFFwalk(Args, 0, Mmap->memsize, 0, Mmap);
+  Args = _RIFFwalk(Args, 0, Mmap->memsize, 0, _RIFFisRF64(Mmap), Mmap);
 
   /*****
    Sign as needed
@@ -53,6 +53,31 @@
 	Next == 0? Done!
 	watch out for loops! (Hint: IFDs should never point backwards!)
 
+ =====
+ BigTIFF
+
+ Classic TIFF uses 32-bit offsets, so it cannot address more than 4 GB.
+ BigTIFF (version 43, 0x2b) is the same structure with 64-bit offsets.
+ Ref: https://www.awaresystems.be/imaging/tiff/bigtiff.html
+
+ BigTIFF header:
+   2 byte endian: II or MM
+   2 byte magic number: 43 ('+')
+   2 byte offset size: always 8
+   2 byte reserved: always 0
+   8 byte offset to first IFD.
+
+ BigTIFF IFD:
+   8 bytes: number of records
+   For each record, 20 bytes:
+     2 bytes: Tag ID
+     2 bytes: Data type
+     8 bytes: Data count
+     8 bytes: Data offset (if the count is <= 8, then this is the data)
+   8 bytes: offset to next IFD
+
+ Everything else (walking, signing, verifying) is the same.
+
  =====
  For signing...
 
@@ -137,6 +162,7 @@
 
 #define Read16(x) ((Endian==1234) ? readle16(x) : readbe16(x))
 #define Read32(x) ((Endian==1234) ? readle32(x) : readbe32(x))
+#define Read64(x) ((Endian==1234) ? readle64(x) : readbe64(x))
 
 #pragma GCC visibility push(hidden)
 
@@ -144,9 +170,14 @@
  _TIFFwalk(): Given a TIFF, walk the structures.
  Evaluate any SEAL or text chunks.
  Data and Pos may change during recursion, but Mmap is always source file.
+ IsBig: true for BigTIFF (64-bit offsets), false for classic TIFF.
+ The endian is a template parameter so Read16/Read32/Read64 are resolved
+ at compile time; there is no endian test inside the entry loop.
+ Use _TIFFwalkEndian() to dispatch.
  NOTE: This is recursive!
  **************************************/
-sealfield *	_TIFFwalk	(sealfield *Args, int Endian, mmapfile *Mmap)
+template <int Endian>
+sealfield *	_TIFFwalk	(sealfield *Args, bool IsBig, mmapfile *Mmap)
 {
   /*****
    If the code got here, then we already know the header is valid.
@@ -159,11 +190,15 @@ sealfield *	_TIFFwalk	(sealfield *Args, int Endian, mmapfile *Mmap)
    *****/
   size_t LinkIFDoffset,IFDoffset;
   int IFDnum=0;
-  uint16_t EntryCount,e;
-  uint32_t DataOffset,DataSize;
+  uint64_t EntryCount,e;
+  uint64_t DataOffset,DataSize;
+  /* Classic TIFF and BigTIFF only differ by field sizes */
+  const size_t CountSize = (IsBig ? 8 : 2); // number of entries
+  const size_t EntrySize = (IsBig ? 20 : 12); // size of each entry
+  const size_t ValueSize = (IsBig ? 8 : 4); // entry count, entry offset, next IFD
 
-  LinkIFDoffset = 4;
-  IFDoffset = Read32(Mmap->mem + LinkIFDoffset);
+  LinkIFDoffset = (IsBig ? 8 : 4);
+  IFDoffset = (IsBig ? Read64(Mmap->mem + LinkIFDoffset) : (uint32_t)Read32(Mmap->mem + LinkIFDoffset));
 
   while(IFDoffset > 0)
     {
@@ -172,20 +207,21 @@ sealfield *	_TIFFwalk	(sealfield *Args, int Endian, mmapfile *Mmap)
       printf("  WARNING: IFD%d is not word-aligned.\n",IFDnum);
       }
 
-    if (IFDoffset+6 >= Mmap->memsize) // overflow
+    if ((Mmap->memsize < CountSize+ValueSize) ||
+	(IFDoffset > Mmap->memsize - (CountSize+ValueSize))) // overflow
       {
       printf("  ERROR: IFD%d is truncated. Aborting.\n",IFDnum);
       return(Args);
       }
 
-    EntryCount = Read16(Mmap->mem + IFDoffset);
-    IFDoffset += 2;
+    EntryCount = (IsBig ? Read64(Mmap->mem + IFDoffset) : (uint64_t)Read16(Mmap->mem + IFDoffset));
+    IFDoffset += CountSize;
 
     // Process every entry; look for tag 0xcea1
-    // Every entry is 12 bytes
+    // Every entry is 12 bytes (20 bytes for BigTIFF)
     for(e=0; e < EntryCount; e++)
       {
-      if (IFDoffset+12 > Mmap->memsize) // overflow
+      if ((Mmap->memsize < EntrySize) || (IFDoffset > Mmap->memsize - EntrySize)) // overflow
 	{
 	printf("  ERROR: IFD%d is truncated. Aborting.\n",IFDnum);
 	return(Args);
@@ -201,13 +237,24 @@ sealfield *	_TIFFwalk	(sealfield *Args, int Endian, mmapfile *Mmap)
 		break;
 	  default: // unknown encoding
 		{
-		printf("  WARNING: IFD%d entry %u contains a SEAL record with unknown encoding. Assuming binary..\n",IFDnum,e);
+		printf("  WARNING: IFD%d entry %u contains a SEAL record with unknown encoding. Assuming binary..\n",IFDnum,(unsigned int)e);
 		}
 		break;
 	  }
-	DataSize = Read32(Mmap->mem + IFDoffset + 4);
-	DataOffset = Read32(Mmap->mem + IFDoffset + 8);
-	if (DataOffset+ DataSize > Mmap->memsize) // truncated!
+	if (IsBig)
+	  {
+	  DataSize = Read64(Mmap->mem + IFDoffset + 4);
+	  DataOffset = Read64(Mmap->mem + IFDoffset + 12);
+	  }
+	else
+	  {
+	  DataSize = (uint32_t)Read32(Mmap->mem + IFDoffset + 4);
+	  DataOffset = (uint32_t)Read32(Mmap->mem + IFDoffset + 8);
+	  }
+	// Small data is stored in the offset field.
+	if (DataSize <= ValueSize) { DataOffset = IFDoffset + EntrySize - ValueSize; }
+
+	if ((DataSize > Mmap->memsize) || (DataOffset > Mmap->memsize - DataSize)) // truncated!
 	  {
 	  long signum;
 	  signum = SealGetIindex(Args,"@s",2);
@@ -220,18 +267,23 @@ sealfield *	_TIFFwalk	(sealfield *Args, int Endian, mmapfile *Mmap)
 	  Args = SealVerifyBlock(Args, DataOffset, DataOffset+DataSize, Mmap);
 	  }
 	} // if SEAL tag
-      IFDoffset += 12;
+      IFDoffset += EntrySize;
       }
 
     // Next IFD!
-    if (IFDoffset+4 > Mmap->memsize)
+    if ((Mmap->memsize < ValueSize) || (IFDoffset > Mmap->memsize - ValueSize))
 	{
 	printf("  ERROR: IFD%d is truncated. Aborting.\n",IFDnum);
 	return(Args);
 	}
     LinkIFDoffset = IFDoffset;
-    IFDoffset = Read32(Mmap->mem+IFDoffset);
+    IFDoffset = (IsBig ? Read64(Mmap->mem+IFDoffset) : (uint32_t)Read32(Mmap->mem+IFDoffset));
     if (IFDoffset == 0) { ; } // found end! Handled later
+    else if (IFDoffset >= Mmap->memsize) // link is past the end
+	{
+	printf("  ERROR: IFD%d links past the end of the file. Aborting.\n",IFDnum);
+	return(Args);
+	}
     else if (IFDoffset < LinkIFDoffset) // loop found
 	{
 	printf("  ERROR: IFD%d contains a loop. Aborting.\n",IFDnum);
@@ -247,6 +299,24 @@ sealfield *	_TIFFwalk	(sealfield *Args, int Endian, mmapfile *Mmap)
   return(Args);
 } /* _TIFFwalk() */
 
+/**************************************
+ _TIFFwalkEndian(): Select the endian-specific walker.
+ **************************************/
+sealfield *	_TIFFwalkEndian	(sealfield *Args, int Endian, bool IsBig, mmapfile *Mmap)
+{
+  if (Endian == 1234) { return(_TIFFwalk<1234>(Args, IsBig, Mmap)); }
+  return(_TIFFwalk<4321>(Args, IsBig, Mmap));
+} /* _TIFFwalkEndian() */
+
+/**************************************
+ _TIFFisBig(): Is this TIFF a BigTIFF?
+ Assumes Seal_isTIFF() already validated the header.
+ **************************************/
+bool	_TIFFisBig	(int Endian, mmapfile *Mmap)
+{
+  return(Read16(Mmap->mem+2) == 0x002b);
+} /* _TIFFisBig() */
+
 #pragma GCC visibility pop
 
 /**************************************
@@ -270,13 +340,25 @@ int	Seal_isTIFF	(mmapfile *Mmap)
     /* http://www.sno.phy.queensu.ca/~phil/exiftool/TagNames/Panasonic.html */
     case 0x0055: break; /* Panasonic and Leica camera RAW format */
 
+    /* BigTIFF: Type 43 with 64-bit offsets */
+    case 0x002b:
+	{
+	uint64_t u64;
+	if (Read16(Mmap->mem+4) != 8) { return(0); } // offsets must be 8 bytes
+	if (Read16(Mmap->mem+6) != 0) { return(0); } // reserved
+	u64 = Read64(Mmap->mem+8);
+	if (u64 % 2) { return(0); } // must be word aligned
+	if ((u64 < 16) || (u64 > Mmap->memsize - 8)) { return(0); } // first IFD is overflow
+	return(Endian);
+	}
+
     default: return(0); // not TIFF
     }
 
   uint32_t u32;
   u32 = Read32(Mmap->mem+4);
   if (u32 % 2) { return(0); } // must be word aligned
-  if (u32+2 > Mmap->memsize) { return(0); } // first IFD is overflow
+  if ((uint64_t)u32+2 > Mmap->memsize) { return(0); } // first IFD is overflow
   return(Endian);
 } /* Seal_isTIFF() */
 
@@ -284,13 +366,13 @@ int	Seal_isTIFF	(mmapfile *Mmap)
  Seal_TIFFsign(): Sign a TIFF.
  Insert a TIFF signature.
  **************************************/
-sealfield *	Seal_TIFFsign	(sealfield *Args, int Endian, mmapfile *MmapIn)
+sealfield *	Seal_TIFFsign	(sealfield *Args, int Endian, bool IsBig, mmapfile *MmapIn)
 {
   char *Opt;
   sealfield *rec, *block; // SEAL record
   mmapfile *MmapOut;
   const char *fname;
-  uint32_t IFDlink,IFDoffset;
+  size_t IFDlink,IFDoffset,IFDsize,RecSize;
 
   /*****
    To insert:
@@ -350,26 +432,56 @@ sealfield *	Seal_TIFFsign	(sealfield *Args, int Endian, mmapfile *MmapIn)
      4 bytes for next IFD (zero)
      and SEAL record padded to 16-bit boundary.
    That's 18 bytes + record size
+   BigTIFF uses 8 + 20 + 8 = 36 bytes + record size.
    *****/
   rec = SealSearch(Args,"@record");
   Args = SealDel(Args,"@BLOCK");
+  RecSize = rec->ValueLen + (rec->ValueLen % 2);
+  IFDsize = (IsBig ? 36 : 18);
+
+  if (!IsBig && (MmapIn->memsize + RecSize + IFDsize > 0xffffffff))
+	{
+	// Classic TIFF cannot point past 4G
+	printf(" ERROR: TIFF is too large to sign; must be BigTIFF. Skipping.\n");
+	return(Args);
+	}
 
-  Args = SealAlloc(Args,"@BLOCK",18 + rec->ValueLen + (rec->ValueLen % 2),'x');
+  Args = SealAlloc(Args,"@BLOCK",IFDsize + RecSize,'x');
   block = SealSearch(Args,"@BLOCK");
 
   // Store record *before* the IFD
   memcpy(block->Value,rec->Value,rec->ValueLen);
   // Make "@s" relative to the start of the block (Already done!)
-  IFDoffset = rec->ValueLen + (rec->ValueLen % 2);
+  IFDoffset = RecSize;
 
   // Now fill it using the correct endian!
-  if (Endian == 1234) // little endian
+  if (IsBig)
+	{
+	if (Endian == 1234) // little endian
+	  {
+	  writele64(block->Value+IFDoffset+0,(uint64_t)1); // 1 entry in the IFD
+	  writele16(block->Value+IFDoffset+8,0xcea1); // tag 0xcea1
+	  writele16(block->Value+IFDoffset+10,2); // type 2: ascii text
+	  writele64(block->Value+IFDoffset+12,(uint64_t)RecSize); // data size with padding
+	  writele64(block->Value+IFDoffset+20,(uint64_t)MmapIn->memsize); // data offset is right before this IFD
+	  }
+	else // big endian
+	  {
+	  writebe64(block->Value+IFDoffset+0,(uint64_t)1); // 1 entry in the IFD
+	  writebe16(block->Value+IFDoffset+8,0xcea1); // tag 0xcea1
+	  writebe16(block->Value+IFDoffset+10,2); // type 2: ascii text
+	  writebe64(block->Value+IFDoffset+12,(uint64_t)RecSize); // data size with padding
+	  writebe64(block->Value+IFDoffset+20,(uint64_t)MmapIn->memsize); // data offset is right before this IFD
+	  }
+	// Don't need to write 0 for next IFD
+	}
+  else if (Endian == 1234) // little endian
 	{
 	writele16(block->Value+IFDoffset+0,1); // 1 entry in the IFD
 	writele16(block->Value+IFDoffset+2,0xcea1); // tag 0xcea1
 	writele16(block->Value+IFDoffset+4,2); // type 2: ascii text
-	writele32(block->Value+IFDoffset+6,rec->ValueLen + (rec->ValueLen % 2)); // data size with padding
-	writele32(block->Value+IFDoffset+10,MmapIn->memsize); // data offset is right after this IFD
+	writele32(block->Value+IFDoffset+6,RecSize); // data size with padding
+	writele32(block->Value+IFDoffset+10,MmapIn->memsize); // data offset is right before this IFD
 	// Don't need to write 0 for next IFD
 	}
   else // big endian
@@ -377,8 +489,8 @@ sealfield *	Seal_TIFFsign	(sealfield *Args, int Endian, mmapfile *MmapIn)
 	writebe16(block->Value+IFDoffset+0,1); // 1 entry in the IFD
 	writebe16(block->Value+IFDoffset+2,0xcea1); // tag 0xcea1
 	writebe16(block->Value+IFDoffset+4,2); // type 2: ascii text
-	writebe32(block->Value+IFDoffset+6,rec->ValueLen + (rec->ValueLen % 2)); // data size with padding
-	writebe32(block->Value+IFDoffset+10,MmapIn->memsize); // data offset is right after this IFD
+	writebe32(block->Value+IFDoffset+6,RecSize); // data size with padding
+	writebe32(block->Value+IFDoffset+10,MmapIn->memsize); // data offset is right before this IFD
 	// Don't need to write 0 for next IFD
 	}
   IFDoffset += MmapIn->memsize; // make the new offset relative to the new file
@@ -388,7 +500,12 @@ sealfield *	Seal_TIFFsign	(sealfield *Args, int Endian, mmapfile *MmapIn)
   if (MmapOut)
     {
     // Update previous "next IFD" with current IFD location
-    if (Endian == 1234) { writele32(MmapOut->mem + IFDlink, IFDoffset); }
+    if (IsBig)
+      {
+      if (Endian == 1234) { writele64(MmapOut->mem + IFDlink, (uint64_t)IFDoffset); }
+      else { writebe64(MmapOut->mem + IFDlink, (uint64_t)IFDoffset); }
+      }
+    else if (Endian == 1234) { writele32(MmapOut->mem + IFDlink, IFDoffset); }
     else { writebe32(MmapOut->mem + IFDlink, IFDoffset); }
     // Sign it!
     SealSign(Args,MmapOut);
@@ -410,12 +527,15 @@ sealfield *	Seal_TIFF	(sealfield *Args, mmapfile *Mmap)
   Endian = Seal_isTIFF(Mmap);
   if (!Endian) { return(Args); }
 
-  Args = _TIFFwalk(Args, Endian, Mmap);
+  bool IsBig;
+  IsBig = _TIFFisBig(Endian, Mmap);
+
+  Args = _TIFFwalkEndian(Args, Endian, IsBig, Mmap);
 
   /*****
    Sign as needed
    *****/
-  Args = Seal_TIFFsign(Args, Endian, Mmap); // Add a signature as needed
+  Args = Seal_TIFFsign(Args, Endian, IsBig, Mmap); // Add a signature as needed
   if (SealGetIindex(Args,"@s",2)==0) // no signatures
     {
     printf(" No SEAL signatures found.\n");
@@ -12,6 +12,7 @@
 #include "files.hpp"
 
 sealfield *	Seal_Manual	(sealfield *Args);
+sealfield *	Seal_ManualStream	(sealfield *Args);
 
 bool		Seal_isPNG	(mmapfile *Mmap);
 sealfield *	Seal_PNG	(sealfield *Args, mmapfile *MmapIn);
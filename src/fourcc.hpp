@@ -0,0 +1,95 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Compile-time lookup tables for FourCC codes.
+
+ Many formats identify chunks by a four character code (FourCC).
+ Rather than scanning a list with memcmp for every chunk, the list
+ is turned into a perfect hash when compiling:
+   - The key is the FourCC as a big-endian 32-bit value.
+   - The slot is a multiplicative hash: (key*Seed) >> (32-Bits).
+   - The builder tries seeds until no two keys share a slot.
+ A lookup is one multiply, one load, and one compare.
+
+ The tables remain the source of truth. Each table has a
+ static_assert that every entry is found by its hash.
+ ************************************************/
+#ifndef FOURCC_HPP
+#define FOURCC_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* FourCC as a big-endian 32-bit value; usable at compile time */
+constexpr uint32_t	FourCC	(const char *s)
+{
+  return( ((uint32_t)(uint8_t)s[0]<<24) | ((uint32_t)(uint8_t)s[1]<<16) |
+	  ((uint32_t)(uint8_t)s[2]<<8) | (uint32_t)(uint8_t)s[3] );
+}
+
+/**************************************
+ fourcchash: A perfect hash with 2^Bits slots.
+ Value 0 means "not found", so stored values must be non-zero.
+ **************************************/
+template <unsigned int Bits>
+struct fourcchash
+  {
+  uint32_t Seed;
+  uint32_t Key[1<<Bits];
+  uint8_t Value[1<<Bits];
+
+  constexpr uint32_t	Slot	(uint32_t k) const { return( (uint32_t)(k*Seed) >> (32-Bits) ); }
+  constexpr uint8_t	Find	(uint32_t k) const
+    {
+    uint32_t s = Slot(k);
+    return( (Key[s]==k) ? Value[s] : 0 );
+    }
+  };
+
+/**************************************
+ FourCCHashBuild(): Build a perfect hash from a table.
+ KeyOf(entry) returns the key; ValueOf(entry,index) returns the value.
+ Duplicate keys keep the first entry (same as a linear scan).
+ **************************************/
+template <unsigned int Bits, typename T, size_t N, typename K, typename V>
+constexpr fourcchash<Bits>	FourCCHashBuild	(const T (&Table)[N], K KeyOf, V ValueOf)
+{
+  fourcchash<Bits> H{};
+  bool Ok=false;
+  for(uint32_t Seed=0x9e3779b1; !Ok; Seed += 2)
+    {
+    H = fourcchash<Bits>{};
+    H.Seed = Seed;
+    Ok = true;
+    for(size_t i=0; Ok && (i < N); i++)
+      {
+      uint32_t k = KeyOf(Table[i]);
+      uint32_t s = H.Slot(k);
+      if (H.Value[s] == 0) { H.Key[s]=k; H.Value[s]=ValueOf(Table[i],i); }
+      else if (H.Key[s] != k) { Ok=false; } // collision; try another seed
+      }
+    }
+  return(H);
+} /* FourCCHashBuild() */
+
+/**************************************
+ FourCCHashCheck(): Every table entry finds the first entry with its key.
+ For use in static_assert().
+ **************************************/
+template <unsigned int Bits, typename T, size_t N, typename K, typename V>
+constexpr bool	FourCCHashCheck	(const fourcchash<Bits> &H, const T (&Table)[N], K KeyOf, V ValueOf)
+{
+  for(size_t i=0; i < N; i++)
+    {
+    size_t First=i;
+    for(size_t j=0; j < i; j++)
+      {
+      if (KeyOf(Table[j]) == KeyOf(Table[i])) { First=j; break; }
+      }
+    if (H.Find(KeyOf(Table[i])) != ValueOf(Table[First],First)) { return(false); }
+    }
+  return(true);
+} /* FourCCHashCheck() */
+
+#endif
@@ -0,0 +1,414 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Offline key store (--keystore).
+
+ A dnsfile holds one TXT record. A key store holds any number of
+ them, for any number of domains and key versions. It is loaded
+ once into a hash table keyed by (seal, domain, kv, ka, uid) and
+ consulted before any DNS query.
+
+ The text form is zone-file-like; one record per line:
+   domain [ttl] [IN] [TXT] seal=1 ka=rsa kv=1 p=...
+   domain [ttl] [IN] [TXT] "seal=1 ka=rsa kv=1 p=..." "..."
+ Quoted strings are joined (like a long TXT record).
+ Blank lines and lines starting with '#' or ';' are ignored.
+ The first record for a key wins, just like with DNS.
+
+ The loaded table can be saved as an index (--keystore-index).
+ The index is the table itself, so loading it is a single mmap:
+   keystorehead
+   uint64_t Bucket[Buckets]  (offset of the entry; 0 = empty)
+   keystoreentry + Key\0 Public\0 Revoke\0 (8-byte aligned), ...
+ --keystore accepts either form.
+ ************************************************/
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h> // strncasecmp
+#include <ctype.h>
+
+#include "seal.hpp"
+#include "seal-parse.hpp"
+#include "files.hpp"
+#include "keystore.hpp"
+
+#define KEYSTORE_MAGIC "SEALKS1\n"
+#define KEYSTORE_ENDIAN 0x01020304
+#define KEYSTORE_NOREVOKE 0xffffffff
+
+typedef struct
+  {
+  char Magic[8];
+  uint32_t Endian; // detects an index from a different byte order
+  uint32_t Buckets; // power of 2
+  uint32_t Entries;
+  uint32_t Pad;
+  uint64_t Size; // total bytes
+  } keystorehead;
+
+typedef struct
+  {
+  uint64_t Hash;
+  uint32_t KeyLen;
+  uint32_t PubLen; // 0 = no public key (revoked)
+  uint32_t RevLen; // KEYSTORE_NOREVOKE = no revocation
+  uint32_t Pad;
+  } keystoreentry;
+
+#pragma GCC visibility push(hidden)
+
+static byte *Keystore=NULL; // the table (malloc or mmap)
+static mmapfile *KeystoreMmap=NULL;
+
+/**************************************
+ _KeystoreHash(): FNV-1a.
+ **************************************/
+static uint64_t	_KeystoreHash	(const char *Key, size_t KeyLen)
+{
+  uint64_t Hash = 0xcbf29ce484222325ULL;
+  size_t i;
+  for(i=0; i < KeyLen; i++)
+    {
+    Hash ^= (byte)Key[i];
+    Hash *= 0x100000001b3ULL;
+    }
+  return(Hash);
+} /* _KeystoreHash() */
+
+/**************************************
+ _KeystoreKey(): Generate the lookup key.
+ Domains are not case sensitive and may end with a '.'.
+ Returns: key length, or 0 if it does not fit.
+ **************************************/
+static size_t	_KeystoreKey	(char *Key, size_t KeyMax, const char *Seal,
+	const char *Domain, const char *Kv, const char *Ka, const char *Uid)
+{
+  size_t DomainLen, i;
+  int Len;
+
+  DomainLen = strlen(Domain);
+  if (DomainLen && (Domain[DomainLen-1]=='.')) { DomainLen--; }
+  Len = snprintf(Key,KeyMax,"%s:%.*s:%s:%s:%s",Seal,(int)DomainLen,Domain,Kv,Ka,Uid);
+  if ((Len < 0) || ((size_t)Len >= KeyMax)) { return(0); }
+  for(i=strlen(Seal)+1; i < strlen(Seal)+1+DomainLen; i++) { Key[i] = tolower(Key[i]); }
+  return(Len);
+} /* _KeystoreKey() */
+
+/**************************************
+ _KeystoreFind(): Find a key in the table.
+ Returns: entry or NULL.
+ **************************************/
+static keystoreentry *	_KeystoreFind	(const char *Key, size_t KeyLen)
+{
+  keystorehead *Head = (keystorehead*)Keystore;
+  uint64_t *Bucket;
+  keystoreentry *E;
+  uint64_t Hash, Off;
+  uint32_t Mask, i, n;
+
+  if (!Keystore) { return(NULL); }
+  Bucket = (uint64_t*)(Keystore + sizeof(keystorehead));
+  Mask = Head->Buckets - 1;
+  Hash = _KeystoreHash(Key,KeyLen);
+  for(i = Hash & Mask, n=0; n < Head->Buckets; i = (i+1) & Mask, n++)
+    {
+    Off = Bucket[i];
+    if (!Off) { return(NULL); } // not found
+    // An index file may be damaged; never read past the end.
+    if (Off + sizeof(keystoreentry) > Head->Size) { return(NULL); }
+    E = (keystoreentry*)(Keystore + Off);
+    if ((E->Hash != Hash) || (E->KeyLen != KeyLen)) { continue; }
+    // Key\0 Public\0 and, if there is a revoke, Revoke\0
+    if (Off + sizeof(keystoreentry) + (uint64_t)E->KeyLen + E->PubLen +
+	((E->RevLen==KEYSTORE_NOREVOKE) ? 2 : E->RevLen+3) > Head->Size) { return(NULL); }
+    if (!memcmp(E+1,Key,KeyLen)) { return(E); }
+    }
+  return(NULL);
+} /* _KeystoreFind() */
+
+/**************************************
+ _KeystoreTxt(): Get the TXT value from a key store line.
+ Returns: Txt (new sealfield "txt") or NULL if no value.
+ Sets Domain (new sealfield "d").
+ **************************************/
+static sealfield *	_KeystoreTxt	(const char *Line, size_t LineLen, sealfield **Domain)
+{
+  sealfield *Txt=NULL;
+  size_t i=0, j;
+
+  // Domain
+  for(j=i; (j < LineLen) && !isspace(Line[j]); j++) { ; }
+  *Domain = SealSetTextLen(NULL,"d",j-i,Line+i);
+  i=j;
+
+  // Skip optional ttl, class, and type
+  while(i < LineLen)
+    {
+    while((i < LineLen) && isspace(Line[i])) { i++; }
+    for(j=i; (j < LineLen) && !isspace(Line[j]); j++) { ; }
+    if ((j-i == 2) && !strncasecmp(Line+i,"IN",2)) { i=j; continue; }
+    if ((j-i == 3) && !strncasecmp(Line+i,"TXT",3)) { i=j; continue; }
+    size_t d;
+    for(d=i; (d < j) && isdigit(Line[d]); d++) { ; }
+    if ((d==j) && (j > i)) { i=j; continue; } // ttl
+    break;
+    }
+  while((LineLen > i) && isspace(Line[LineLen-1])) { LineLen--; }
+  if (i >= LineLen) { return(NULL); }
+
+  // Unquoted: the rest of the line
+  if (Line[i] != '"') { return(SealSetTextLen(NULL,"txt",LineLen-i,Line+i)); }
+
+  // Quoted: join the strings
+  Txt = SealSetText(NULL,"txt","");
+  while(i < LineLen)
+    {
+    if (isspace(Line[i])) { i++; continue; }
+    if (Line[i] != '"') { break; } // junk after the strings
+    for(i++; (i < LineLen) && (Line[i] != '"'); i++)
+      {
+      if ((Line[i]=='\\') && (i+1 < LineLen)) { i++; }
+      Txt = SealAddC(Txt,"txt",Line[i]);
+      }
+    i++; // skip the closing quote
+    }
+  return(Txt);
+} /* _KeystoreTxt() */
+
+/**************************************
+ _KeystoreAdd(): Parse one TXT value and append it to the entries.
+ Returns: updated Entries buffer.
+ **************************************/
+static sealfield *	_KeystoreAdd	(sealfield *Entries, const char *Domain, sealfield *Txt)
+{
+  sealfield *R, *Reply;
+  sealfield *vf;
+  keystoreentry E;
+  char Key[1024];
+  const char *Pub, *Rev=NULL;
+  size_t KeyLen, a, b;
+  const byte Zero[8]={0,0,0,0,0,0,0,0};
+
+  // Same as a DNS reply: "<seal TXT />"
+  R = SealSetText(NULL,"r","<seal ");
+  R = SealAddBin(R,"r",Txt->ValueLen,Txt->Value);
+  R = SealAddText(R,"r"," />");
+  Reply = SealParse(R->ValueLen,R->Value,0,NULL);
+  SealFree(R);
+  if (!Reply || !SealSearch(Reply,"seal") || !SealSearch(Reply,"p"))
+	{
+	if (Reply) { SealFree(Reply); }
+	return(Entries); // not a SEAL record
+	}
+
+  while(SealGetSize(Reply,"p")%4) { Reply=SealAddC(Reply,"p",'='); } // base64 padding
+  if (!SealSearch(Reply,"kv")) { Reply=SealSetText(Reply,"kv","1"); }
+  if (!SealSearch(Reply,"uid")) { Reply=SealSetText(Reply,"uid",""); }
+  if (!SealSearch(Reply,"ka")) { Reply=SealSetText(Reply,"ka",""); }
+
+  KeyLen = _KeystoreKey(Key,sizeof(Key),SealGetText(Reply,"seal"),Domain,
+	SealGetText(Reply,"kv"),SealGetText(Reply,"ka"),SealGetText(Reply,"uid"));
+  if (!KeyLen) { SealFree(Reply); return(Entries); }
+
+  // Revocation, reduced to digits (see SealGetDNS)
+  Pub = SealGetText(Reply,"p");
+  if (!Pub[0] || !strcmp(Pub,"revoke")) { Pub=""; Rev="0"; }
+  vf = SealSearch(Reply,"r");
+  if (vf && !Rev)
+    {
+    for(a=b=0; a < vf->ValueLen; a++)
+      {
+      if (isdigit(vf->Value[a])) { vf->Value[b++] = vf->Value[a]; }
+      }
+    vf->Value[b]='\0';
+    vf->ValueLen=b;
+    Rev = (char*)vf->Value;
+    }
+
+  memset(&E,0,sizeof(E));
+  E.Hash = _KeystoreHash(Key,KeyLen);
+  E.KeyLen = KeyLen;
+  E.PubLen = strlen(Pub);
+  E.RevLen = Rev ? strlen(Rev) : KEYSTORE_NOREVOKE;
+  Entries = SealAddBin(Entries,"e",sizeof(E),(byte*)&E);
+  Entries = SealAddBin(Entries,"e",KeyLen+1,(byte*)Key);
+  Entries = SealAddBin(Entries,"e",E.PubLen+1,(byte*)Pub);
+  if (Rev) { Entries = SealAddBin(Entries,"e",E.RevLen+1,(byte*)Rev); }
+  Entries = SealAddBin(Entries,"e",(8 - Entries->ValueLen%8)%8,Zero);
+  SealFree(Reply);
+  return(Entries);
+} /* _KeystoreAdd() */
+
+/**************************************
+ _KeystoreBuild(): Turn the entries into the table.
+ **************************************/
+static void	_KeystoreBuild	(sealfield *Entries, uint32_t Count)
+{
+  keystorehead *Head;
+  keystoreentry *E;
+  uint64_t *Bucket;
+  uint64_t Base, Off;
+  uint32_t Buckets=16, Mask, i;
+
+  while(Buckets < Count*2) { Buckets <<= 1; } // at most half full
+
+  Base = sizeof(keystorehead) + Buckets*sizeof(uint64_t);
+  Keystore = (byte*)calloc(Base + Entries->ValueLen,1);
+  memcpy(Keystore+Base,Entries->Value,Entries->ValueLen);
+  Head = (keystorehead*)Keystore;
+  memcpy(Head->Magic,KEYSTORE_MAGIC,8);
+  Head->Endian = KEYSTORE_ENDIAN;
+  Head->Buckets = Buckets;
+  Head->Size = Base + Entries->ValueLen;
+
+  Bucket = (uint64_t*)(Keystore + sizeof(keystorehead));
+  Mask = Buckets-1;
+  for(Off=Base; Off < Head->Size; )
+    {
+    E = (keystoreentry*)(Keystore + Off);
+    if (!_KeystoreFind((char*)(E+1),E->KeyLen)) // first one wins
+      {
+      for(i = E->Hash & Mask; Bucket[i]; i = (i+1) & Mask) { ; }
+      Bucket[i] = Off;
+      Head->Entries++;
+      }
+    Off += sizeof(keystoreentry) + E->KeyLen + 1 + E->PubLen + 1;
+    if (E->RevLen != KEYSTORE_NOREVOKE) { Off += E->RevLen + 1; }
+    Off = (Off+7) & ~(uint64_t)7;
+    }
+} /* _KeystoreBuild() */
+
+#pragma GCC visibility pop
+
+/**************************************
+ SealKeystoreLoad(): Load a key store (text or index).
+ **************************************/
+void	SealKeystoreLoad	(const char *Filename)
+{
+  keystorehead *Head;
+  sealfield *Entries=NULL, *Domain, *Txt;
+  uint32_t Count=0;
+  size_t Start, End;
+  mmapfile *Mmap;
+
+  Mmap = MmapFile(Filename,PROT_READ);
+  if (!Mmap)
+	{
+	fprintf(stderr,"ERROR: Cannot open key store (%s). Aborting.\n",Filename);
+	exit(0x80);
+	}
+
+  // Prebuilt index: use it in place
+  Head = (keystorehead*)Mmap->mem;
+  if ((Mmap->memsize >= sizeof(keystorehead)) && !memcmp(Head->Magic,KEYSTORE_MAGIC,8))
+    {
+    if ((Head->Endian != KEYSTORE_ENDIAN) || (Head->Size != Mmap->memsize) ||
+	!Head->Buckets || (Head->Buckets & (Head->Buckets-1)) ||
+	(sizeof(keystorehead) + (uint64_t)Head->Buckets*sizeof(uint64_t) > Head->Size))
+	{
+	fprintf(stderr,"ERROR: Invalid key store index (%s). Aborting.\n",Filename);
+	exit(0x80);
+	}
+    KeystoreMmap = Mmap;
+    Keystore = Mmap->mem;
+    return;
+    }
+
+  // Text: one record per line
+  Entries = SealSetBin(NULL,"e",0,NULL);
+  for(Start=0; Start < Mmap->memsize; Start=End+1)
+    {
+    const char *Line = (const char*)Mmap->mem + Start;
+    for(End=Start; (End < Mmap->memsize) && (Mmap->mem[End] != '\n'); End++) { ; }
+    while((Start < End) && isspace(*Line)) { Start++; Line++; }
+    if ((Start==End) || (Line[0]=='#') || (Line[0]==';')) { continue; }
+
+    Txt = _KeystoreTxt(Line,End-Start,&Domain);
+    if (Txt)
+      {
+      uint64_t Before = Entries->ValueLen;
+      Entries = _KeystoreAdd(Entries,SealGetText(Domain,"d"),Txt);
+      if (Entries->ValueLen > Before) { Count++; }
+      SealFree(Txt);
+      }
+    SealFree(Domain);
+    }
+  MmapFree(Mmap);
+
+  _KeystoreBuild(Entries,Count);
+  SealFree(Entries);
+  if (!((keystorehead*)Keystore)->Entries)
+	{
+	printf(" WARNING: No SEAL records in key store (%s).\n",Filename);
+	}
+} /* SealKeystoreLoad() */
+
+/**************************************
+ SealKeystoreWrite(): Save the loaded key store as an index.
+ **************************************/
+void	SealKeystoreWrite	(const char *Filename)
+{
+  keystorehead *Head = (keystorehead*)Keystore;
+  FILE *Fout;
+
+  if (!Keystore)
+	{
+	fprintf(stderr,"ERROR: --keystore-index requires --keystore. Aborting.\n");
+	exit(0x80);
+	}
+  Fout = fopen(Filename,"wb");
+  if (!Fout || (fwrite(Keystore,1,Head->Size,Fout) != Head->Size) || fclose(Fout))
+	{
+	fprintf(stderr,"ERROR: Cannot write key store index (%s). Aborting.\n",Filename);
+	exit(0x80);
+	}
+  printf("Key store index: %s (%u records)\n",Filename,Head->Entries);
+} /* SealKeystoreWrite() */
+
+/**************************************
+ SealKeystoreGet(): Find the public key for a record.
+ Returns: Rec with '@public' and any '@revoke', or NULL if not found.
+ **************************************/
+sealfield *	SealKeystoreGet	(sealfield *Rec)
+{
+  keystoreentry *E;
+  char Key[1024];
+  const char *s;
+  size_t KeyLen;
+
+  if (!Keystore) { return(NULL); }
+  const char *Field[5] = { "seal","d","kv","ka","uid" };
+  const char *Value[5];
+  for(int i=0; i < 5; i++)
+    {
+    Value[i] = SealGetText(Rec,Field[i]);
+    if (!Value[i]) { Value[i]=""; }
+    }
+  KeyLen = _KeystoreKey(Key,sizeof(Key),Value[0],Value[1],Value[2],Value[3],Value[4]);
+  if (!KeyLen) { return(NULL); }
+  E = _KeystoreFind(Key,KeyLen);
+  if (!E) { return(NULL); }
+
+  s = (const char*)(E+1) + E->KeyLen + 1;
+  if (E->PubLen) { Rec = SealSetTextLen(Rec,"@public",E->PubLen,s); }
+  s += E->PubLen + 1;
+  if (E->RevLen != KEYSTORE_NOREVOKE) { Rec = SealSetTextLen(Rec,"@revoke",E->RevLen,s); }
+  return(Rec);
+} /* SealKeystoreGet() */
+
+/**************************************
+ SealKeystoreInit(): Load any key store from the arguments.
+ **************************************/
+void	SealKeystoreInit	(sealfield *Args)
+{
+  const char *s;
+
+  s = SealGetText(Args,"keystore");
+  if (s && s[0]) { SealKeystoreLoad(s); }
+  s = SealGetText(Args,"keystore-index");
+  if (s && s[0]) { SealKeystoreWrite(s); }
+} /* SealKeystoreInit() */
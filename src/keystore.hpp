@@ -0,0 +1,23 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Offline key store: many DNS TXT records, loaded once.
+ ************************************************/
+#ifndef KEYSTORE_HPP
+#define KEYSTORE_HPP
+
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "seal.hpp"
+
+void	SealKeystoreInit	(sealfield *Args);
+void	SealKeystoreLoad	(const char *Filename);
+void	SealKeystoreWrite	(const char *Filename);
+sealfield *	SealKeystoreGet	(sealfield *Rec);
+
+#endif
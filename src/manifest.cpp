@@ -0,0 +1,346 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Resumable batch runs (--manifest FILE).
+
+ The manifest is an append-only log of completed files:
+   outcome <tab> size <tab> mtime <tab> inode <tab> path
+ outcome is ok, invalid, unsigned, or mixed (the ReturnCode bits
+ 0x01 and 0x02 for the file). mtime is seconds.nanoseconds.
+ In the path, '\' tab and newline are escaped as \\ \t \n.
+
+ On start, the manifest is loaded and every file whose path, size,
+ mtime, and inode still match is skipped; its recorded outcome still
+ counts toward the exit code. Changed files are processed again (the
+ newer line wins). New lines are buffered and appended with a single
+ write() every 64 files or 2 seconds (and at exit), then synced, so a
+ preempted run loses at most one batch. A torn last line is ignored.
+ Several processes may append to the same manifest.
+
+ Sharding (--shard i/N): each host takes the files whose path hash
+ modulo N is i (0 to N-1). The same file list splits the same way
+ everywhere, without coordination.
+ ************************************************/
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "seal.hpp"
+#include "stats.hpp"
+#include "manifest.hpp"
+
+#define MANIFEST_BATCH 64 // files per write
+#define MANIFEST_BATCH_NS (2ULL*1000000000ULL) // or this long
+
+#pragma GCC visibility push(hidden)
+
+typedef struct
+  {
+  char *Path; // NULL = empty slot
+  uint64_t Size;
+  uint64_t Mtime; // ns
+  uint64_t Inode;
+  int Rc;
+  } manifestentry;
+
+static int ManifestFd=-1;
+static manifestentry *Manifest=NULL;
+static size_t ManifestLen=0, ManifestMax=0; // hash table (power of 2)
+static sealfield *ManifestBuf=NULL; // lines not yet written
+static int ManifestBufLines=0;
+static uint64_t ManifestBufTime=0;
+static uint32_t ShardI=0, ShardN=0; // 0 = no sharding
+
+// File being processed
+static struct stat ManifestStat;
+static const char *ManifestPath=NULL;
+
+/**************************************
+ _ManifestHash(): FNV-1a.
+ **************************************/
+static uint64_t	_ManifestHash	(const char *Str)
+{
+  uint64_t Hash = 0xcbf29ce484222325ULL;
+  for( ; *Str; Str++)
+    {
+    Hash ^= (byte)*Str;
+    Hash *= 0x100000001b3ULL;
+    }
+  return(Hash);
+} /* _ManifestHash() */
+
+/**************************************
+ _ManifestFind(): Find a path's slot in the table.
+ Returns: the entry, or the empty slot for it.
+ **************************************/
+static manifestentry *	_ManifestFind	(const char *Path)
+{
+  size_t i;
+  for(i = _ManifestHash(Path) & (ManifestMax-1); Manifest[i].Path; i = (i+1) & (ManifestMax-1))
+    {
+    if (!strcmp(Manifest[i].Path,Path)) { break; }
+    }
+  return(Manifest+i);
+} /* _ManifestFind() */
+
+/**************************************
+ _ManifestSet(): Add or replace a path in the table.
+ **************************************/
+static void	_ManifestSet	(const char *Path, uint64_t Size, uint64_t Mtime, uint64_t Inode, int Rc)
+{
+  manifestentry *E;
+
+  if (ManifestLen*2 >= ManifestMax) // grow; keep at most half full
+    {
+    manifestentry *Old = Manifest;
+    size_t OldMax = ManifestMax, i;
+    ManifestMax = (ManifestMax ? ManifestMax*2 : 1024);
+    Manifest = (manifestentry*)calloc(ManifestMax,sizeof(manifestentry));
+    for(i=0; i < OldMax; i++)
+      {
+      if (Old[i].Path) { *_ManifestFind(Old[i].Path) = Old[i]; }
+      }
+    free(Old);
+    }
+
+  E = _ManifestFind(Path);
+  if (!E->Path) { E->Path = strdup(Path); ManifestLen++; }
+  E->Size = Size;
+  E->Mtime = Mtime;
+  E->Inode = Inode;
+  E->Rc = Rc;
+} /* _ManifestSet() */
+
+/**************************************
+ _ManifestOutcome(): ReturnCode bits to/from the outcome word.
+ **************************************/
+static const char *ManifestOutcome[4] = { "ok", "invalid", "unsigned", "mixed" };
+static int	_ManifestRc	(const char *Word, size_t Len)
+{
+  int i;
+  for(i=0; i < 4; i++)
+    {
+    if ((strlen(ManifestOutcome[i])==Len) && !memcmp(ManifestOutcome[i],Word,Len)) { return(i); }
+    }
+  return(-1);
+} /* _ManifestRc() */
+
+/**************************************
+ _ManifestLoad(): Load the completed files.
+ **************************************/
+static void	_ManifestLoad	(FILE *Fin)
+{
+  char *Line=NULL, *Path, *s, *f[4];
+  size_t LineMax=0, i, j;
+  ssize_t LineLen;
+  int Rc, n;
+
+  while((LineLen = getline(&Line,&LineMax,Fin)) > 0)
+    {
+    if (Line[0]=='#') { continue; }
+    if (Line[LineLen-1] != '\n') { break; } // torn last line
+    Line[--LineLen]='\0';
+
+    // Four fields and the path
+    s=Line;
+    for(n=0; n < 4; n++)
+      {
+      f[n]=s;
+      s = strchr(s,'\t');
+      if (!s) { break; }
+      *s++ = '\0';
+      }
+    if (n < 4) { continue; } // malformed
+    Rc = _ManifestRc(f[0],strlen(f[0]));
+    if (Rc < 0) { continue; }
+
+    // Unescape the path in place
+    Path=s;
+    for(i=j=0; Path[i]; i++, j++)
+      {
+      if ((Path[i]=='\\') && Path[i+1])
+	{
+	i++;
+	if (Path[i]=='n') { Path[j]='\n'; }
+	else if (Path[i]=='t') { Path[j]='\t'; }
+	else { Path[j]=Path[i]; }
+	}
+      else { Path[j]=Path[i]; }
+      }
+    Path[j]='\0';
+
+    // mtime is seconds.nanoseconds
+    char *Dot;
+    uint64_t Mtime = strtoull(f[2],&Dot,10) * 1000000000ULL;
+    if (*Dot=='.') { Mtime += strtoull(Dot+1,NULL,10); }
+    _ManifestSet(Path,strtoull(f[1],NULL,10),Mtime,strtoull(f[3],NULL,10),Rc);
+    }
+  free(Line);
+} /* _ManifestLoad() */
+
+/**************************************
+ _ManifestExit(): Write any buffered lines at exit.
+ **************************************/
+static void	_ManifestExit	()
+{
+  ManifestFlush();
+} /* _ManifestExit() */
+
+#pragma GCC visibility pop
+
+/**************************************
+ ManifestInit(): Open the manifest and set up any sharding.
+ **************************************/
+void	ManifestInit	(sealfield *Args)
+{
+  const char *s;
+  FILE *Fin;
+
+  s = SealGetText(Args,"shard");
+  if (s && s[0])
+    {
+    char *End;
+    ShardI = strtoul(s,&End,10);
+    if (*End=='/') { ShardN = strtoul(End+1,&End,10); }
+    if (*End || !ShardN || (ShardI >= ShardN))
+	{
+	fprintf(stderr,"ERROR: --shard must be i/N with i from 0 to N-1. Aborting.\n");
+	exit(0x80);
+	}
+    }
+
+  s = SealGetText(Args,"manifest");
+  if (!s || !s[0]) { return; }
+
+  ManifestFd = open(s,O_WRONLY|O_APPEND|O_CREAT,0644);
+  if (ManifestFd < 0)
+	{
+	fprintf(stderr,"ERROR: Cannot open manifest (%s). Aborting.\n",s);
+	exit(0x80);
+	}
+  Fin = fopen(s,"rb");
+  if (Fin) { _ManifestLoad(Fin); }
+  off_t End = lseek(ManifestFd,0,SEEK_END);
+  char Last='\n';
+  if (End==0)
+    {
+    ManifestBuf = SealSetText(ManifestBuf,"m","# SEAL manifest: outcome size mtime inode path\n");
+    }
+  else if (Fin && (pread(fileno(Fin),&Last,1,End-1)==1) && (Last != '\n'))
+    {
+    ManifestBuf = SealSetText(ManifestBuf,"m","\n"); // end the torn line
+    }
+  if (Fin) { fclose(Fin); }
+  atexit(_ManifestExit);
+} /* ManifestInit() */
+
+/**************************************
+ ManifestFilter(): Remove files for other shards and completed files.
+ Files is changed in place; order is kept.
+ Returns: number of files left.
+ **************************************/
+int	ManifestFilter	(int Count, char **Files)
+{
+  manifestentry *E;
+  struct stat Stat;
+  int i, Keep=0, Done=0;
+
+  for(i=0; i < Count; i++)
+    {
+    if (ShardN && (_ManifestHash(Files[i]) % ShardN != ShardI)) { continue; }
+    if (Manifest && !stat(Files[i],&Stat))
+      {
+      E = _ManifestFind(Files[i]);
+      if (E->Path && (E->Size == (uint64_t)Stat.st_size) &&
+	  (E->Mtime == (uint64_t)Stat.st_mtim.tv_sec*1000000000ULL + Stat.st_mtim.tv_nsec) &&
+	  (E->Inode == (uint64_t)Stat.st_ino))
+	{
+	ReturnCode |= E->Rc;
+	Done++;
+	continue;
+	}
+      }
+    Files[Keep++] = Files[i];
+    }
+  if (Done) { printf("Manifest: %d completed files skipped.\n",Done); }
+  return(Keep);
+} /* ManifestFilter() */
+
+/**************************************
+ ManifestFileBegin(): Note the identity of a file before processing.
+ **************************************/
+void	ManifestFileBegin	(const char *Path)
+{
+  if (ManifestFd < 0) { return; }
+  ManifestPath = stat(Path,&ManifestStat) ? NULL : Path;
+} /* ManifestFileBegin() */
+
+/**************************************
+ ManifestFileEnd(): Record the file as completed.
+ Rc is the file's ReturnCode bits.
+ **************************************/
+void	ManifestFileEnd	(int Rc)
+{
+  char Num[96];
+  const char *s;
+
+  if ((ManifestFd < 0) || !ManifestPath) { return; }
+  Rc &= 0x03;
+  ManifestBuf = SealAddText(ManifestBuf,"m",ManifestOutcome[Rc]);
+  snprintf(Num,sizeof(Num),"\t%lu\t%lu.%09lu\t%lu\t",
+	(unsigned long)ManifestStat.st_size,
+	(unsigned long)ManifestStat.st_mtim.tv_sec,(unsigned long)ManifestStat.st_mtim.tv_nsec,
+	(unsigned long)ManifestStat.st_ino);
+  ManifestBuf = SealAddText(ManifestBuf,"m",Num);
+  if (!strpbrk(ManifestPath,"\\\n\t")) { ManifestBuf = SealAddText(ManifestBuf,"m",ManifestPath); }
+  else for(s=ManifestPath; *s; s++)
+    {
+    if (*s=='\\') { ManifestBuf = SealAddText(ManifestBuf,"m","\\\\"); }
+    else if (*s=='\n') { ManifestBuf = SealAddText(ManifestBuf,"m","\\n"); }
+    else if (*s=='\t') { ManifestBuf = SealAddText(ManifestBuf,"m","\\t"); }
+    else { ManifestBuf = SealAddC(ManifestBuf,"m",*s); }
+    }
+  ManifestBuf = SealAddC(ManifestBuf,"m",'\n');
+  ManifestPath=NULL;
+
+  ManifestBufLines++;
+  if (!ManifestBufTime) { ManifestBufTime = StatNow(); }
+  if ((ManifestBufLines >= MANIFEST_BATCH) || (StatNow() - ManifestBufTime >= MANIFEST_BATCH_NS))
+    {
+    ManifestFlush();
+    }
+} /* ManifestFileEnd() */
+
+/**************************************
+ ManifestFlush(): Append the buffered lines to the manifest.
+ One write(), so lines from several processes do not mix.
+ **************************************/
+void	ManifestFlush	()
+{
+  size_t Done=0;
+  ssize_t rc;
+
+  if ((ManifestFd < 0) || !ManifestBuf || !ManifestBuf->ValueLen) { return; }
+  while(Done < ManifestBuf->ValueLen)
+    {
+    rc = write(ManifestFd,ManifestBuf->Value+Done,ManifestBuf->ValueLen-Done);
+    if ((rc < 0) && (errno == EINTR)) { continue; }
+    if (rc <= 0)
+	{
+	printf(" WARNING: Cannot write the manifest.\n");
+	break;
+	}
+    Done += rc;
+    }
+  fdatasync(ManifestFd);
+  SealFree(ManifestBuf); ManifestBuf=NULL;
+  ManifestBufLines=0;
+  ManifestBufTime=0;
+} /* ManifestFlush() */
@@ -0,0 +1,23 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Resumable batch runs (--manifest) and sharding (--shard).
+ ************************************************/
+#ifndef MANIFEST_HPP
+#define MANIFEST_HPP
+
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "seal.hpp"
+
+void	ManifestInit	(sealfield *Args);
+int	ManifestFilter	(int Count, char **Files);
+void	ManifestFileBegin	(const char *Path);
+void	ManifestFileEnd	(int Rc);
+void	ManifestFlush	();
+
+#endif
@@ -0,0 +1,349 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Prometheus text-format metrics (--metrics).
+
+ Counters: files per format, signatures (valid, invalid, revoked),
+ DNS lookups and cache hits, bytes hashed/read/written, time per
+ phase, and remote signing requests with a latency histogram.
+ Gauges: files, DNS lookups, and remote signing requests in flight.
+
+ Each thread increments its own counters (relaxed atomics; no
+ locks). The counters are summed when the file is written.
+ A background thread rewrites the file every Interval seconds,
+ and it is written one last time when the program ends.
+ Each write goes to a temporary file that is renamed over the
+ old one, so a scraper never sees a partial file.
+ ************************************************/
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "seal.hpp"
+#include "stats.hpp"
+#include "process.hpp"
+#include "metrics.hpp"
+
+bool MetricsEnabled=false;
+
+#pragma GCC visibility push(hidden)
+
+// Remote signing latency buckets (seconds); the last bucket is +Inf
+#define METRICBUCKETS 10
+static const double MetricBucket[METRICBUCKETS-1] = { 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30 };
+
+// Every per-thread value is in one array; these are the offsets.
+#define MetricFiles	(MetricCounters) // by FileFormat code (128)
+#define MetricPhaseCalls	(MetricFiles+128)
+#define MetricPhaseNs	(MetricPhaseCalls+StatPhases)
+#define MetricPhaseBytes	(MetricPhaseNs+StatPhases)
+#define MetricRemoteBucket	(MetricPhaseBytes+StatPhases)
+#define MetricRemoteNs	(MetricRemoteBucket+METRICBUCKETS)
+#define MetricValues	(MetricRemoteNs+1)
+
+typedef struct metricthread
+  {
+  struct metricthread *Next; // list of all threads
+  std::atomic<uint64_t> Value[MetricValues];
+  std::atomic<int64_t> Gauge[MetricGauges];
+  } metricthread;
+
+static std::atomic<metricthread*> MetricThreads(NULL);
+static thread_local metricthread *MetricLocal=NULL;
+
+static char *MetricFilename=NULL;
+static char *MetricTmpname=NULL;
+static int MetricInterval=10;
+static time_t MetricStart=0;
+static bool MetricWarned=false;
+static std::mutex MetricWriteLock; // one writer at a time
+static std::mutex MetricWakeLock;
+static std::condition_variable MetricWake;
+static bool MetricStop=false;
+static std::thread *MetricWriter=NULL;
+
+/**************************************
+ _MetricThread(): Get this thread's counters.
+ Counters are never freed; they outlive their thread.
+ **************************************/
+static metricthread *	_MetricThread	()
+{
+  if (MetricLocal) { return(MetricLocal); }
+  MetricLocal = new metricthread(); // zeroed
+  MetricLocal->Next = MetricThreads.load(std::memory_order_relaxed);
+  while(!MetricThreads.compare_exchange_weak(MetricLocal->Next,MetricLocal,
+	std::memory_order_release,std::memory_order_relaxed)) { ; }
+  return(MetricLocal);
+} /* _MetricThread() */
+
+/**************************************
+ _MetricSum(): Sum one value over all threads.
+ **************************************/
+static uint64_t	_MetricSum	(int Value)
+{
+  uint64_t Sum=0;
+  metricthread *T;
+  for(T=MetricThreads.load(std::memory_order_acquire); T; T=T->Next)
+    {
+    Sum += T->Value[Value].load(std::memory_order_relaxed);
+    }
+  return(Sum);
+} /* _MetricSum() */
+
+/**************************************
+ _MetricHead(): Write the HELP and TYPE lines.
+ **************************************/
+static void	_MetricHead	(FILE *Fout, const char *Name, const char *Type, const char *Help)
+{
+  fprintf(Fout,"# HELP %s %s\n",Name,Help);
+  fprintf(Fout,"# TYPE %s %s\n",Name,Type);
+} /* _MetricHead() */
+
+/**************************************
+ _MetricCounter(): Write a counter without labels.
+ **************************************/
+static void	_MetricCounter	(FILE *Fout, const char *Name, const char *Help, uint64_t Value)
+{
+  _MetricHead(Fout,Name,"counter",Help);
+  fprintf(Fout,"%s %lu\n",Name,(unsigned long)Value);
+} /* _MetricCounter() */
+
+/**************************************
+ _MetricLoop(): Background writer.
+ **************************************/
+static void	_MetricLoop	()
+{
+  std::unique_lock<std::mutex> Lock(MetricWakeLock);
+  while(!MetricStop)
+    {
+    MetricWake.wait_for(Lock,std::chrono::seconds(MetricInterval));
+    if (MetricStop) { break; }
+    Lock.unlock();
+    MetricsWrite();
+    Lock.lock();
+    }
+} /* _MetricLoop() */
+
+#pragma GCC visibility pop
+
+/**************************************
+ MetricsOpen(): Start writing metrics to a file.
+ The file is written now so errors are found early.
+ **************************************/
+bool	MetricsOpen	(const char *Filename, int Interval)
+{
+  FILE *Fout;
+
+  if (!Filename || !Filename[0]) { return(false); }
+  MetricFilename = strdup(Filename);
+  MetricTmpname = (char*)calloc(strlen(Filename)+8,1);
+  sprintf(MetricTmpname,"%s.tmp",Filename);
+  Fout = fopen(MetricTmpname,"wb");
+  if (!Fout)
+	{
+	fprintf(stderr,"ERROR: Cannot create metrics file (%s). Aborting.\n",MetricTmpname);
+	exit(0x80);
+	}
+  fclose(Fout);
+
+  MetricInterval = (Interval > 0) ? Interval : 10;
+  MetricStart = time(NULL);
+  MetricsEnabled = true;
+  _MetricThread(); // the main thread is always listed
+  MetricsWrite();
+  MetricWriter = new std::thread(_MetricLoop);
+  atexit(MetricsClose); // write even after an error
+  return(true);
+} /* MetricsOpen() */
+
+/**************************************
+ MetricsClose(): Stop the writer and write the final values.
+ **************************************/
+void	MetricsClose	()
+{
+  if (!MetricsEnabled) { return; }
+  if (MetricWriter)
+    {
+    {
+    std::lock_guard<std::mutex> Lock(MetricWakeLock);
+    MetricStop=true;
+    }
+    MetricWake.notify_all();
+    MetricWriter->join();
+    delete MetricWriter;
+    MetricWriter=NULL;
+    }
+  MetricsWrite();
+  MetricsEnabled=false;
+  free(MetricFilename); MetricFilename=NULL;
+  free(MetricTmpname); MetricTmpname=NULL;
+} /* MetricsClose() */
+
+/**************************************
+ MetricsWrite(): Write every metric (Prometheus text format).
+ Writes to a temporary file and renames it over the old one.
+ **************************************/
+void	MetricsWrite	()
+{
+  std::lock_guard<std::mutex> Lock(MetricWriteLock);
+  metricthread *T;
+  FILE *Fout;
+  int i;
+
+  if (!MetricFilename) { return; }
+  Fout = fopen(MetricTmpname,"wb");
+  if (!Fout)
+    {
+    if (!MetricWarned) { fprintf(stderr," WARNING: Cannot write metrics file (%s).\n",MetricTmpname); }
+    MetricWarned=true;
+    return;
+    }
+
+  _MetricHead(Fout,"seal_build_info","gauge","Version of sealtool.");
+  fprintf(Fout,"seal_build_info{version=\"%s\"} 1\n",SEAL_VERSION);
+  _MetricHead(Fout,"seal_start_time_seconds","gauge","Start time of the process (Unix time).");
+  fprintf(Fout,"seal_start_time_seconds %ld\n",(long)MetricStart);
+
+  // Files
+  _MetricHead(Fout,"seal_files_total","counter","Files processed, by format.");
+  for(i=0; i < 128; i++)
+    {
+    uint64_t n = _MetricSum(MetricFiles+i);
+    if (n) { fprintf(Fout,"seal_files_total{format=\"%s\"} %lu\n",FormatName(i),(unsigned long)n); }
+    }
+  _MetricCounter(Fout,"seal_files_unsigned_total","Files without any signature.",_MetricSum(MetricUnsigned));
+  _MetricCounter(Fout,"seal_file_errors_total","Files that could not be read.",_MetricSum(MetricFileErrors));
+
+  // Signatures
+  _MetricHead(Fout,"seal_signatures_total","counter","Signatures checked, by result.");
+  fprintf(Fout,"seal_signatures_total{result=\"valid\"} %lu\n",(unsigned long)_MetricSum(MetricSigValid));
+  fprintf(Fout,"seal_signatures_total{result=\"invalid\"} %lu\n",(unsigned long)_MetricSum(MetricSigInvalid));
+  fprintf(Fout,"seal_signatures_total{result=\"revoked\"} %lu\n",(unsigned long)_MetricSum(MetricSigRevoked));
+
+  // DNS
+  _MetricHead(Fout,"seal_dns_lookups_total","counter","Public key lookups, by source.");
+  fprintf(Fout,"seal_dns_lookups_total{source=\"dns\"} %lu\n",(unsigned long)_MetricSum(MetricDNSLookups));
+  fprintf(Fout,"seal_dns_lookups_total{source=\"dnsfile\"} %lu\n",(unsigned long)_MetricSum(MetricDNSFile));
+  fprintf(Fout,"seal_dns_lookups_total{source=\"keystore\"} %lu\n",(unsigned long)_MetricSum(MetricDNSKeystore));
+  _MetricCounter(Fout,"seal_dns_failures_total","DNS lookups without a reply.",_MetricSum(MetricDNSFailures));
+  _MetricCounter(Fout,"seal_dns_cache_hits_total","Public keys reused without a lookup.",_MetricSum(MetricDNSCacheHits));
+
+  // Bytes
+  _MetricCounter(Fout,"seal_bytes_hashed_total","Bytes included in digests.",_MetricSum(MetricPhaseBytes+StatDigest));
+  _MetricCounter(Fout,"seal_bytes_read_total","Bytes in the files that were read.",_MetricSum(MetricPhaseBytes+StatMmap));
+  _MetricCounter(Fout,"seal_bytes_written_total","Bytes in the signed files that were written.",_MetricSum(MetricPhaseBytes+StatWrite));
+
+  // Phases
+  _MetricHead(Fout,"seal_phase_seconds_total","counter","Time in each processing phase (exclusive of nested phases).");
+  for(i=0; i < StatPhases; i++)
+    {
+    fprintf(Fout,"seal_phase_seconds_total{phase=\"%s\"} %.6f\n",StatName(i),(double)_MetricSum(MetricPhaseNs+i)/1e9);
+    }
+  _MetricHead(Fout,"seal_phase_calls_total","counter","Calls to each processing phase.");
+  for(i=0; i < StatPhases; i++)
+    {
+    fprintf(Fout,"seal_phase_calls_total{phase=\"%s\"} %lu\n",StatName(i),(unsigned long)_MetricSum(MetricPhaseCalls+i));
+    }
+
+  // Remote signing
+  _MetricCounter(Fout,"seal_remote_sign_requests_total","Remote signing requests.",_MetricSum(MetricRemoteCalls));
+  _MetricCounter(Fout,"seal_remote_sign_errors_total","Remote signing requests that failed.",_MetricSum(MetricRemoteErrors));
+  {
+  uint64_t Cumulative=0;
+  _MetricHead(Fout,"seal_remote_sign_duration_seconds","histogram","Remote signing request latency.");
+  for(i=0; i < METRICBUCKETS; i++)
+    {
+    Cumulative += _MetricSum(MetricRemoteBucket+i);
+    if (i < METRICBUCKETS-1) { fprintf(Fout,"seal_remote_sign_duration_seconds_bucket{le=\"%g\"} %lu\n",MetricBucket[i],(unsigned long)Cumulative); }
+    else { fprintf(Fout,"seal_remote_sign_duration_seconds_bucket{le=\"+Inf\"} %lu\n",(unsigned long)Cumulative); }
+    }
+  fprintf(Fout,"seal_remote_sign_duration_seconds_sum %.6f\n",(double)_MetricSum(MetricRemoteNs)/1e9);
+  fprintf(Fout,"seal_remote_sign_duration_seconds_count %lu\n",(unsigned long)Cumulative);
+  }
+
+  // Work in flight
+  {
+  static const char *Name[MetricGauges] = { "seal_files_in_flight", "seal_dns_in_flight", "seal_remote_sign_in_flight" };
+  static const char *Help[MetricGauges] = { "Files being processed.", "DNS lookups waiting for a reply.", "Remote signing requests waiting for a reply." };
+  for(i=0; i < MetricGauges; i++)
+    {
+    int64_t Sum=0;
+    for(T=MetricThreads.load(std::memory_order_acquire); T; T=T->Next)
+      {
+      Sum += T->Gauge[i].load(std::memory_order_relaxed);
+      }
+    _MetricHead(Fout,Name[i],"gauge",Help[i]);
+    fprintf(Fout,"%s %ld\n",Name[i],(long)Sum);
+    }
+  }
+
+  if (fclose(Fout) || rename(MetricTmpname,MetricFilename))
+    {
+    if (!MetricWarned) { fprintf(stderr," WARNING: Cannot replace metrics file (%s).\n",MetricFilename); }
+    MetricWarned=true;
+    unlink(MetricTmpname);
+    }
+} /* MetricsWrite() */
+
+/**************************************
+ MetricAdd(): Add to a counter.
+ **************************************/
+void	MetricAdd	(int Counter, uint64_t Value)
+{
+  if (!MetricsEnabled) { return; }
+  _MetricThread()->Value[Counter].fetch_add(Value,std::memory_order_relaxed);
+} /* MetricAdd() */
+
+/**************************************
+ MetricGauge(): Change a gauge.
+ **************************************/
+void	MetricGauge	(int Gauge, int Delta)
+{
+  if (!MetricsEnabled) { return; }
+  _MetricThread()->Gauge[Gauge].fetch_add(Delta,std::memory_order_relaxed);
+} /* MetricGauge() */
+
+/**************************************
+ MetricFile(): Count a processed file by format.
+ FileFormat is the code from SealFileFormat() (0 = unknown).
+ **************************************/
+void	MetricFile	(int FileFormat)
+{
+  if (!MetricsEnabled) { return; }
+  _MetricThread()->Value[MetricFiles + (FileFormat & 0x7f)].fetch_add(1,std::memory_order_relaxed);
+} /* MetricFile() */
+
+/**************************************
+ MetricPhase(): Count a finished phase (from StatEnd).
+ **************************************/
+void	MetricPhase	(int Phase, uint64_t Ns, uint64_t Bytes)
+{
+  if (!MetricsEnabled) { return; }
+  metricthread *T = _MetricThread();
+  T->Value[MetricPhaseCalls+Phase].fetch_add(1,std::memory_order_relaxed);
+  T->Value[MetricPhaseNs+Phase].fetch_add(Ns,std::memory_order_relaxed);
+  T->Value[MetricPhaseBytes+Phase].fetch_add(Bytes,std::memory_order_relaxed);
+} /* MetricPhase() */
+
+/**************************************
+ MetricRemote(): Count a remote signing request.
+ **************************************/
+void	MetricRemote	(uint64_t Ns, bool Ok)
+{
+  int b;
+  if (!MetricsEnabled) { return; }
+  metricthread *T = _MetricThread();
+  for(b=0; (b < METRICBUCKETS-1) && ((double)Ns/1e9 > MetricBucket[b]); b++) { ; }
+  T->Value[MetricRemoteBucket+b].fetch_add(1,std::memory_order_relaxed);
+  T->Value[MetricRemoteNs].fetch_add(Ns,std::memory_order_relaxed);
+  T->Value[MetricRemoteCalls].fetch_add(1,std::memory_order_relaxed);
+  if (!Ok) { T->Value[MetricRemoteErrors].fetch_add(1,std::memory_order_relaxed); }
+} /* MetricRemote() */
@@ -0,0 +1,69 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Prometheus text-format metrics (--metrics).
+ ************************************************/
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "seal.hpp"
+
+// Counters
+enum
+  {
+  MetricSigValid=0,	// signature verified
+  MetricSigInvalid,	// signature failed (not revoked)
+  MetricSigRevoked,	// public key or signature revoked
+  MetricUnsigned,	// file without a signature
+  MetricFileErrors,	// file could not be read
+  MetricDNSLookups,	// DNS TXT queries
+  MetricDNSFailures,	// DNS TXT queries with no reply
+  MetricDNSFile,	// keys from a dnsfile
+  MetricDNSKeystore,	// keys from a key store
+  MetricDNSCacheHits,	// keys reused from the previous record
+  MetricSignLocal,	// local signatures
+  MetricRemoteCalls,	// remote signing requests
+  MetricRemoteErrors,	// remote signing requests that failed
+  MetricCounters	// number of counters
+  };
+
+// Gauges (work in progress)
+enum
+  {
+  MetricFilesInFlight=0,
+  MetricDNSInFlight,
+  MetricRemoteInFlight,
+  MetricGauges	// number of gauges
+  };
+
+extern bool MetricsEnabled;
+
+bool	MetricsOpen	(const char *Filename, int Interval);
+void	MetricsClose	();
+void	MetricsWrite	();
+
+// Per-thread; cheap (relaxed atomics, no locks)
+void	MetricAdd	(int Counter, uint64_t Value);
+void	MetricGauge	(int Gauge, int Delta);
+void	MetricFile	(int FileFormat);
+void	MetricPhase	(int Phase, uint64_t Ns, uint64_t Bytes);
+void	MetricRemote	(uint64_t Ns, bool Ok);
+
+/**************************************
+ metricgauge: Count work in flight until the end of the scope.
+ **************************************/
+struct metricgauge
+  {
+  int Gauge;
+  metricgauge(int G) : Gauge(G) { if (MetricsEnabled) { MetricGauge(Gauge,1); } }
+  ~metricgauge() { if (MetricsEnabled) { MetricGauge(Gauge,-1); } }
+  };
+
+#endif
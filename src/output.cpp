@@ -0,0 +1,319 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Structured results (--format=json).
+
+ One JSON object per file (NDJSON) on stdout:
+   {"file":"x.png","records":[{"signum":1,"sig_offset":[123,467],
+    "b":"F~S,s~f","ranges":[[0,122],[468,1023]],"da":"sha256",
+    "ka":"rsa","alg":"RSA","bits":2048,"sigdate":"2024-09-05T12:39:00Z",
+    "d":"example.com","verdict":"valid"}],"format":"png",
+    "signatures":1,"finalized":true,"verdict":"valid"}
+ File verdicts: valid, invalid, revoked, unsigned, error.
+ Records add "error" when invalid; files add "error" when they
+ cannot be read.
+
+ Objects are built in a large per-thread buffer and written with
+ write() when it fills (and at exit), not one printf per field.
+ Human text (warnings, --stats) moves to stderr so stdout stays JSON.
+ ************************************************/
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <mutex>
+
+#include "seal.hpp"
+#include "output.hpp"
+
+bool OutputJSON=false;
+
+#pragma GCC visibility push(hidden)
+
+#define OUTBUF (4*1024*1024) // flush threshold
+
+static int OutputFd=-1; // the real stdout
+static std::mutex OutputLock; // whole buffers; lines never interleave
+
+static thread_local struct
+  {
+  char *Buf;
+  size_t Len, Max;
+  size_t Done; // end of the last complete object
+  // Current file
+  int Records;
+  bool Invalid, Revoked;
+  } Out;
+
+/**************************************
+ _OutWrite(): Write the complete objects to the real stdout.
+ A partial object (e.g., exit during a file) is never written.
+ **************************************/
+static void	_OutWrite	()
+{
+  size_t Done=0;
+  ssize_t rc;
+
+  if (!Out.Done) { return; }
+  {
+  std::lock_guard<std::mutex> Lock(OutputLock);
+  while(Done < Out.Done)
+    {
+    rc = write(OutputFd,Out.Buf+Done,Out.Done-Done);
+    if ((rc < 0) && (errno == EINTR)) { continue; }
+    if (rc <= 0) { break; } // e.g., closed pipe; nothing else to do
+    Done += rc;
+    }
+  }
+  memmove(Out.Buf,Out.Buf+Out.Done,Out.Len-Out.Done);
+  Out.Len -= Out.Done;
+  Out.Done = 0;
+} /* _OutWrite() */
+
+/**************************************
+ _OutReserve(): Ensure space for Len more bytes.
+ **************************************/
+static inline void	_OutReserve	(size_t Len)
+{
+  if (Out.Len + Len <= Out.Max) { return; }
+  Out.Max = Out.Max*2;
+  if (Out.Max < Out.Len+Len+OUTBUF/4) { Out.Max = Out.Len+Len+OUTBUF/4; }
+  Out.Buf = (char*)realloc(Out.Buf,Out.Max);
+} /* _OutReserve() */
+
+/**************************************
+ _OutRaw(): Append bytes.
+ **************************************/
+static inline void	_OutRaw	(const char *Str, size_t Len)
+{
+  _OutReserve(Len);
+  memcpy(Out.Buf+Out.Len,Str,Len);
+  Out.Len += Len;
+} /* _OutRaw() */
+#define _OutLit(s)	_OutRaw(s,sizeof(s)-1)
+
+/**************************************
+ _OutNum(): Append an unsigned number.
+ **************************************/
+static void	_OutNum	(uint64_t Num)
+{
+  char Tmp[24];
+  int i=sizeof(Tmp);
+  do { Tmp[--i] = '0' + (Num % 10); Num /= 10; } while(Num);
+  _OutRaw(Tmp+i,sizeof(Tmp)-i);
+} /* _OutNum() */
+
+/**************************************
+ _OutStr(): Append a quoted, escaped string.
+ **************************************/
+static void	_OutStr	(const char *Str, size_t Len)
+{
+  static const char Hex[]="0123456789abcdef";
+  size_t i, Run;
+
+  _OutReserve(Len*6+2); // worst case: every byte is \u00XX
+  Out.Buf[Out.Len++]='"';
+  for(i=0; i < Len; )
+    {
+    // Copy runs of plain characters at once
+    for(Run=i; (Run < Len) && ((byte)Str[Run] >= 0x20) && (Str[Run]!='"') && (Str[Run]!='\\'); Run++) { ; }
+    memcpy(Out.Buf+Out.Len,Str+i,Run-i);
+    Out.Len += Run-i;
+    if (Run >= Len) { break; }
+    i=Run;
+    Out.Buf[Out.Len++]='\\';
+    switch(Str[i])
+      {
+      case '"': Out.Buf[Out.Len++]='"'; break;
+      case '\\': Out.Buf[Out.Len++]='\\'; break;
+      case '\n': Out.Buf[Out.Len++]='n'; break;
+      case '\r': Out.Buf[Out.Len++]='r'; break;
+      case '\t': Out.Buf[Out.Len++]='t'; break;
+      default:
+	memcpy(Out.Buf+Out.Len,"u00",3); Out.Len+=3;
+	Out.Buf[Out.Len++]=Hex[((byte)Str[i])>>4];
+	Out.Buf[Out.Len++]=Hex[((byte)Str[i])&0xf];
+      }
+    i++;
+    }
+  Out.Buf[Out.Len++]='"';
+} /* _OutStr() */
+
+/**************************************
+ _OutField(): Append ,"Name":"text" if the field is set.
+ **************************************/
+static void	_OutField	(const char *Name, sealfield *Rec, const char *Field)
+{
+  sealfield *vf = SealSearch(Rec,Field);
+  if (!vf) { return; }
+  _OutLit(",\"");
+  _OutRaw(Name,strlen(Name));
+  _OutLit("\":");
+  _OutStr((char*)vf->Value,strnlen((char*)vf->Value,vf->ValueLen));
+} /* _OutField() */
+
+/**************************************
+ _OutExit(): Flush at exit.
+ **************************************/
+static void	_OutExit	()
+{
+  OutputFlush();
+} /* _OutExit() */
+
+#pragma GCC visibility pop
+
+/**************************************
+ OutputOpen(): Select the output format ("text" or "json").
+ **************************************/
+void	OutputOpen	(const char *Format)
+{
+  if (!Format || !strcmp(Format,"text")) { return; }
+  if (strcmp(Format,"json"))
+	{
+	fprintf(stderr,"ERROR: Unknown output format '%s' (use text or json). Aborting.\n",Format);
+	exit(0x80);
+	}
+
+  // JSON gets the real stdout; everything else printed goes to stderr.
+  fflush(stdout);
+  OutputFd = dup(1);
+  if ((OutputFd < 0) || (dup2(2,1) < 0))
+	{
+	fprintf(stderr,"ERROR: Cannot redirect output for --format=json. Aborting.\n");
+	exit(0x80);
+	}
+  OutputJSON=true;
+  atexit(_OutExit);
+} /* OutputOpen() */
+
+/**************************************
+ OutputFlush(): Write this thread's buffered output.
+ **************************************/
+void	OutputFlush	()
+{
+  if (OutputJSON) { _OutWrite(); }
+} /* OutputFlush() */
+
+/**************************************
+ OutputFileBegin(): Start the object for a file.
+ **************************************/
+void	OutputFileBegin	(const char *Filename)
+{
+  if (!OutputJSON) { return; }
+  Out.Records=0;
+  Out.Invalid=Out.Revoked=false;
+  _OutLit("{\"file\":");
+  _OutStr(Filename,strlen(Filename));
+  _OutLit(",\"records\":[");
+} /* OutputFileBegin() */
+
+/**************************************
+ OutputRecord(): Add one verified record to the file's object.
+ **************************************/
+void	OutputRecord	(sealfield *Rec, long signum, const char *ErrorMsg, bool IsRevoked)
+{
+  sealfield *vf;
+  const char *Txt;
+  size_t i;
+
+  if (!OutputJSON) { return; }
+  if (Out.Records) { _OutLit(","); }
+  Out.Records++;
+  if (ErrorMsg && IsRevoked) { Out.Revoked=true; }
+  else if (ErrorMsg) { Out.Invalid=true; }
+
+  _OutLit("{\"signum\":");
+  _OutNum(signum);
+  _OutLit(",\"sig_offset\":[");
+  _OutNum(SealGetIindex(Rec,"@s",0));
+  _OutLit(",");
+  _OutNum(SealGetIindex(Rec,"@s",1));
+  _OutLit("]");
+  _OutField("b",Rec,"b");
+
+  vf = SealSearch(Rec,"@digestrange");
+  if (vf && (vf->ValueLen >= 2*sizeof(size_t)))
+    {
+    size_t *Range = (size_t*)vf->Value;
+    _OutLit(",\"ranges\":[");
+    for(i=0; i+1 < vf->ValueLen/sizeof(size_t); i+=2)
+      {
+      if (i) { _OutLit(","); }
+      _OutLit("[");
+      _OutNum(Range[i]);
+      _OutLit(",");
+      _OutNum(Range[i+1] ? Range[i+1]-1 : 0); // inclusive end, like the text output
+      _OutLit("]");
+      }
+    _OutLit("]");
+    }
+
+  _OutField("da",Rec,"da");
+  _OutField("ka",Rec,"ka");
+  _OutField("alg",Rec,"@PublicAlgName");
+  if (SealSearch(Rec,"@PublicAlgBits"))
+    {
+    _OutLit(",\"bits\":");
+    _OutNum(SealGetIindex(Rec,"@PublicAlgBits",0));
+    }
+
+  // YYYYMMDDhhmmss[.fff] to ISO 8601
+  Txt = SealGetText(Rec,"@sigdate");
+  if (Txt && (strlen(Txt) >= 14))
+    {
+    char Date[20];
+    memcpy(Date,Txt,4); Date[4]='-';
+    memcpy(Date+5,Txt+4,2); Date[7]='-';
+    memcpy(Date+8,Txt+6,2); Date[10]='T';
+    memcpy(Date+11,Txt+8,2); Date[13]=':';
+    memcpy(Date+14,Txt+10,2); Date[16]=':';
+    memcpy(Date+17,Txt+12,2);
+    _OutLit(",\"sigdate\":\"");
+    _OutRaw(Date,19);
+    if (Txt[14]=='.') { _OutRaw(Txt+14,strspn(Txt+15,"0123456789")+1); }
+    _OutLit("Z\"");
+    }
+
+  _OutField("d",Rec,"d");
+  _OutField("id",Rec,"id");
+  if (!ErrorMsg) { _OutLit(",\"verdict\":\"valid\"}"); return; }
+  if (IsRevoked) { _OutLit(",\"verdict\":\"revoked\",\"error\":"); }
+  else { _OutLit(",\"verdict\":\"invalid\",\"error\":"); }
+  _OutStr(ErrorMsg,strlen(ErrorMsg));
+  _OutLit("}");
+} /* OutputRecord() */
+
+/**************************************
+ OutputFileEnd(): Finish the object for a file.
+ Format is the file format's name.
+ Error is set if the file could not be processed.
+ Finalized is true if the signatures cover the end of the file.
+ **************************************/
+void	OutputFileEnd	(const char *Format, const char *Error, bool Finalized)
+{
+  if (!OutputJSON) { return; }
+  _OutLit("],\"format\":");
+  _OutStr(Format,strlen(Format));
+  _OutLit(",\"signatures\":");
+  _OutNum(Out.Records);
+  if (Out.Records)
+    {
+    if (Finalized) { _OutLit(",\"finalized\":true"); }
+    else { _OutLit(",\"finalized\":false"); }
+    }
+  if (Error)
+    {
+    _OutLit(",\"verdict\":\"error\",\"error\":");
+    _OutStr(Error,strlen(Error));
+    }
+  else if (!Out.Records) { _OutLit(",\"verdict\":\"unsigned\""); }
+  else if (Out.Invalid) { _OutLit(",\"verdict\":\"invalid\""); }
+  else if (Out.Revoked) { _OutLit(",\"verdict\":\"revoked\""); }
+  else { _OutLit(",\"verdict\":\"valid\""); }
+  _OutLit("}\n");
+  Out.Done = Out.Len;
+  if (Out.Len >= OUTBUF) { _OutWrite(); }
+} /* OutputFileEnd() */
@@ -0,0 +1,25 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Structured results (--format=json).
+ ************************************************/
+#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "seal.hpp"
+
+extern bool OutputJSON; // one JSON object per file on stdout
+
+void	OutputOpen	(const char *Format);
+void	OutputFlush	();
+void	OutputFileBegin	(const char *Filename);
+void	OutputRecord	(sealfield *Rec, long signum, const char *ErrorMsg, bool IsRevoked);
+void	OutputFileEnd	(const char *Format, const char *Error, bool Finalized);
+
+#endif
@@ -0,0 +1,360 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Processing one file: detect the format, then sign or verify.
+ Used by sealtool (for each file on the command line) and sealbench.
+ ************************************************/
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#ifndef __WIN32__
+  #include <sys/mman.h> /* for PROT_READ */
+#endif
+
+#include "seal.hpp"
+#include "files.hpp"
+#include "formats.hpp"
+#include "sign.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include "metrics.hpp"
+#include "output.hpp"
+#include "process.hpp"
+
+// Extra signers (--also-sign); each adds one more record per file
+// Each pass but the last copies the file to memory, so large files are refused.
+#define ALSOSIGN_MAX ((size_t)1<<30) // 1 GB
+static sealfield **Signers=NULL;
+static int SignersCount=0;
+
+/**************************************
+ SealArgsInit(): Create the default parameters.
+ Config files and command-line options are applied after this.
+ **************************************/
+sealfield *	SealArgsInit	()
+{
+  sealfield *Args=NULL;
+
+  Args = SealSetText(Args,"seal","1"); // SEAL version; currently always '1'
+  Args = SealSetText(Args,"b","F~S,s~f"); // default byte range is everything
+  Args = SealSetText(Args,"digestalg","sha256");
+  Args = SealSetText(Args,"keyalg","rsa");
+  Args = SealSetText(Args,"keybits","2048");
+  Args = SealSetText(Args,"keyfile","./seal-private.pem");
+  Args = SealSetText(Args,"outfile","./%b-seal%e");
+  Args = SealSetText(Args,"options","");
+  Args = SealSetText(Args,"kv","1");
+  Args = SealSetText(Args,"sf","HEX");
+  Args = SealSetText(Args,"domain","localhost.localdomain");
+  Args = SealSetText(Args,"dnsfile","");
+  Args = SealSetText(Args,"copyright","");
+  Args = SealSetText(Args,"comment","");
+  Args = SealSetText(Args,"info","");
+  Args = SealSetText(Args,"id","");
+  Args = SealSetText(Args,"apiurl","");
+  Args = SealSetText(Args,"apikey","");
+#ifdef __CYGWIN__
+  Args = SealSetText(Args,"cacert","./cacert.crt");
+#endif
+
+  // p and s are used with b to generate the hash.
+  Args = SealSetIindex(Args,"@s",2,0); // sig offset in file [0]=start, [1]=end, [2]=number of signatures; default:zeros
+  Args = SealSetIindex(Args,"@p",1,0); // previous sig offset in file [0]=start, [1]=end; default:[0,0]
+  Args = SealSetText(Args,"@sflags"," "); // total range flags, set by SealDigest()
+  Args = SealSetText(Args,"@sflags0"," "); // starting range flags, set by SealDigest()
+  Args = SealSetText(Args,"@sflags1"," "); // ending range flags, set by SealDigest()
+
+  return(Args);
+} /* SealArgsInit() */
+
+/**************************************
+ SealFileFormat(): Identify the file format.
+ Returns: the FileFormat code, or 0 if unknown.
+ **************************************/
+int	SealFileFormat	(mmapfile *Mmap)
+{
+  int FileFormat=0;
+  statscope Stat(StatDetect);
+  if (Seal_isPNG(Mmap)) { FileFormat='P'; } // PNG
+  else if (Seal_isJPEG(Mmap)) { FileFormat='J'; } // JPEG
+  else if (Seal_isGIF(Mmap)) { FileFormat='G'; } // GIF
+  else if (Seal_isRIFF(Mmap)) { FileFormat='R'; } // RIFF
+  else if (Seal_isMatroska(Mmap)) { FileFormat='M'; } // Matroska
+  else if (Seal_isBMFF(Mmap)) { FileFormat='B'; } // BMFF
+  else if (Seal_isPDF(Mmap)) { FileFormat='p'; } // PDF
+  else if (Seal_isTIFF(Mmap)) { FileFormat='T'; } // TIFF
+  else if (Seal_isPPM(Mmap)) { FileFormat='m'; } // PPM/PGM
+  else if (Seal_isDICOM(Mmap)) { FileFormat='D'; } // DICOM
+  else if (Seal_isMPEG(Mmap)) { FileFormat='a'; } // MPEG
+  else if (Seal_isAAC(Mmap)) { FileFormat='A'; } // AAC
+  else if (Seal_isText(Mmap)) { FileFormat='x'; } // Text
+  return(FileFormat);
+} /* SealFileFormat() */
+
+/**************************************
+ FormatName(): Given a FileFormat code, return the name.
+ **************************************/
+const char *	FormatName	(int FileFormat)
+{
+  switch(FileFormat)
+    {
+    case 'A': return("AAC");
+    case 'a': return("MPEG");
+    case 'B': return("BMFF");
+    case 'D': return("DICOM");
+    case 'G': return("GIF");
+    case 'J': return("JPEG");
+    case 'M': return("Matroska");
+    case 'm': return("PPM");
+    case 'P': return("PNG");
+    case 'p': return("PDF");
+    case 'R': return("RIFF");
+    case 'T': return("TIFF");
+    case 'x': return("Text");
+    default: break;
+    }
+  return("unknown");
+} /* FormatName() */
+
+/**************************************
+ SealFormatProcess(): Sign or verify based on the file format.
+ Returns: updated Args.
+ **************************************/
+sealfield *	SealFormatProcess	(sealfield *Args, int FileFormat, mmapfile *Mmap)
+{
+  statscope Stat(StatWalk);
+  switch(FileFormat)
+    {
+    case 'A': Args = Seal_AAC(Args,Mmap); break; // AAC
+    case 'a': Args = Seal_MPEG(Args,Mmap); break; // MPEG
+    case 'B': Args = Seal_BMFF(Args,Mmap); break; // BMFF
+    case 'D': Args = Seal_DICOM(Args,Mmap); break; // DICOM
+    case 'G': Args = Seal_GIF(Args,Mmap); break; // GIF
+    case 'J': Args = Seal_JPEG(Args,Mmap); break; // JPEG
+    case 'M': Args = Seal_Matroska(Args,Mmap); break; // Matroska
+    case 'm': Args = Seal_PPM(Args,Mmap); break; // PPM/PGM
+    case 'P': Args = Seal_PNG(Args,Mmap); break; // PNG
+    case 'p': Args = Seal_PDF(Args,Mmap); break; // PDF
+    case 'R': Args = Seal_RIFF(Args,Mmap); break; // RIFF
+    case 'T': Args = Seal_TIFF(Args,Mmap); break; // TIFF
+    case 'x': Args = Seal_Text(Args,Mmap); break; // Text
+    default: break; // should never happen
+    }
+  return(Args);
+} /* SealFormatProcess() */
+
+/**************************************
+ SealSignerAdd(): Add another signer for every file.
+ Signer is a complete set of parameters (with '@sigsize' and
+ '@mode'); it is owned (and freed) by SealSignerFree().
+ **************************************/
+void	SealSignerAdd	(sealfield *Signer)
+{
+  Signers = (sealfield**)realloc(Signers,(SignersCount+1)*sizeof(sealfield*));
+  if (!Signers) // should never happen
+    {
+    fprintf(stderr,"ERROR: Unable to allocate signer list. Aborting.\n");
+    exit(0x80);
+    }
+  Signers[SignersCount++] = Signer;
+} /* SealSignerAdd() */
+
+/**************************************
+ SealSignerFree(): Release every extra signer.
+ **************************************/
+void	SealSignerFree	()
+{
+  int i;
+  for(i=0; i < SignersCount; i++) { SealFree(Signers[i]); }
+  if (Signers) { free(Signers); }
+  Signers=NULL;
+  SignersCount=0;
+} /* SealSignerFree() */
+
+#pragma GCC visibility push(hidden)
+/**************************************
+ _SealSignPasses(): Sign with every signer.
+ CleanArgs signs first, then each extra signer, in order.
+ Every pass except the last builds the file in memory
+ ('@InMemory') and forces "append" so the next record can
+ follow it. Only the last pass writes the output file.
+ Each pass hands its record digests ('@statelog') to the next,
+ so records that were just made are not hashed again.
+ The "record added" reports ('@signedlog') also move forward and
+ are only shown when the last pass writes the file.
+ Records restored from the previous pass ('@statetrust') are not
+ verified or reported again.
+ Memory: every pass before the last holds the whole file on the
+ heap, and two copies are alive while one pass hands off to the
+ next. Files over ALSOSIGN_MAX are refused by SealProcessFile().
+ Returns: the last pass's Args (caller must free).
+ **************************************/
+sealfield *	_SealSignPasses	(sealfield *CleanArgs, const char *Filename, const char *Outname, int FileFormat, mmapfile *Mmap)
+{
+  sealfield *Args=NULL, *Prev=NULL, *Mem;
+  mmapfile *Pass=Mmap;
+  int i;
+
+  for(i=0; i <= SignersCount; i++)
+    {
+    Args = SealClone(i ? Signers[i-1] : CleanArgs);
+    Args = SealSetText(Args,"@FilenameOut",Outname);
+    if (i==0) { Args = SealStateLoad(Args,Filename,Mmap); } // --append-state
+    else
+      {
+      Args = SealSetText(Args,"@statecache","\n");
+      Args = SealAddText(Args,"@statecache",SealGetText(Prev,"@statelog"));
+      Args = SealSetText(Args,"@signedlog",SealGetText(Prev,"@signedlog"));
+      Args = SealSetText(Args,"@statetrust","1"); // already reported
+      }
+
+    if (i == SignersCount) // last pass writes the file
+      {
+      Args = SealFormatProcess(Args,FileFormat,Pass);
+      break;
+      }
+
+    Args = SealAddText(Args,"options",",append");
+    Args = SealSetText(Args,"@InMemory","");
+    Args = SealSetText(Args,"@statelog","");
+    if (!SealSearch(Args,"@signedlog")) { Args = SealSetText(Args,"@signedlog",""); }
+    Args = SealFormatProcess(Args,FileFormat,Pass);
+
+    // Done with the previous pass
+    if (Pass != Mmap) { MmapFree(Pass); }
+    if (Prev) { SealFree(Prev); }
+    Prev = Args;
+
+    Mem = SealSearch(Args,"@InMemory");
+    if (!Mem || !Mem->ValueLen) // did not sign; error already shown
+      {
+      Prev = NULL;
+      return(Args);
+      }
+    Pass = MmapMem(Mem->Value,Mem->ValueLen);
+    }
+
+  if (Pass != Mmap) { MmapFree(Pass); }
+  if (Prev) { SealFree(Prev); }
+  return(Args);
+} /* _SealSignPasses() */
+#pragma GCC visibility pop
+
+/**************************************
+ SealProcessFile(): Sign or verify one file.
+ CleanArgs is not modified; each file starts with a copy.
+ Mode is 'v' (verify), 's' (local sign), or 'S' (remote sign).
+ Sets ReturnCode.
+ **************************************/
+void	SealProcessFile	(sealfield *CleanArgs, const char *Filename, int Mode)
+{
+  sealfield *Args;
+  mmapfile *Mmap=NULL;
+  int FileFormat;
+  bool Finalized=false;
+  metricgauge InFlight(MetricFilesInFlight);
+
+  // Memory map the file; needed for finding the SEAL record's location.
+  StatFileBegin(Filename);
+  OutputFileBegin(Filename);
+  {
+  statscope Stat(StatMmap);
+  Mmap = MmapFile(Filename,PROT_READ); // read-only
+  if (Mmap) { Stat.Bytes = Mmap->memsize; }
+  }
+  if (!Mmap)
+	{
+	fprintf(stdout," ERROR: Unknown file '%s'. Skipping.\n",Filename);
+	MetricAdd(MetricFileErrors,1);
+	OutputFileEnd("error","cannot open file",false);
+	StatFileEnd("error");
+	return;
+	}
+
+  // Identify the filename format
+  FileFormat = SealFileFormat(Mmap);
+  TraceSetFormat(FormatName(FileFormat));
+  if (!FileFormat)
+	{
+	fprintf(stdout," ERROR: Unknown file format '%s'. Skipping.\n",Filename);
+	ReturnCode |= 0x02; // at least one file has no signature
+	MetricAdd(MetricUnsigned,1);
+	MetricFile(FileFormat);
+	MmapFree(Mmap);
+	OutputFileEnd(FormatName(FileFormat),"unknown file format",false);
+	StatFileEnd(FormatName(FileFormat));
+	return;
+	}
+
+  // Start off with a clean set of parameters
+  Args = SealClone(CleanArgs);
+
+  // File exists! Now process it!
+  if (strchr("sS",Mode)) // if signing local/remote
+    {
+    char *Outname, *Template;
+    Template = (char*)(SealSearch(Args,"outfile")->Value);
+    Outname = MakeFilename(Template,Filename);
+    if (!Outname)
+      {
+      SealFree(Args);
+      MmapFree(Mmap);
+      MetricFile(FileFormat);
+      OutputFileEnd(FormatName(FileFormat),"cannot create output file",false);
+      StatFileEnd(FormatName(FileFormat));
+      return;
+      }
+    if (SignersCount && (Mmap->memsize > ALSOSIGN_MAX)) // --also-sign memory limit
+      {
+      fprintf(stdout," ERROR: '%s' is too large for --also-sign (over %lu MB). Skipping.\n",Filename,(unsigned long)(ALSOSIGN_MAX>>20));
+      ReturnCode |= 0x80;
+      MetricAdd(MetricFileErrors,1);
+      SealFree(Args);
+      MmapFree(Mmap);
+      free(Outname);
+      MetricFile(FileFormat);
+      OutputFileEnd(FormatName(FileFormat),"file is too large for --also-sign",false);
+      StatFileEnd(FormatName(FileFormat));
+      return;
+      }
+    if (SignersCount) // --also-sign
+      {
+      SealFree(Args);
+      Args = _SealSignPasses(CleanArgs,Filename,Outname,FileFormat,Mmap);
+      }
+    else
+      {
+      Args = SealSetText(Args,"@FilenameOut",Outname);
+      Args = SealStateLoad(Args,Filename,Mmap); // --append-state
+      Args = SealFormatProcess(Args,FileFormat,Mmap); // process based on file format
+      }
+    SealStateFinish(); // --append-state: the output is complete
+    free(Outname);
+    }
+  else
+    {
+    // Process based on file format
+    Args = SealFormatProcess(Args,FileFormat,Mmap);
+    }
+
+  if (SealGetIindex(Args,"@s",2)==0) // no signatures
+	{
+	ReturnCode |= 0x02; // at least one file has no signature
+	MetricAdd(MetricUnsigned,1);
+	}
+  else if (Mode=='v') // Check final
+	{
+	Finalized = SealVerifyFinal(Args);
+	}
+
+  if (Verbose > 1) { DEBUGWALK("Post-File Parameters",Args); } // DEBUGGING
+
+  MmapFree(Mmap);
+  MetricFile(FileFormat);
+  OutputFileEnd(FormatName(FileFormat),NULL,Finalized);
+  StatFileEnd(FormatName(FileFormat));
+  SealFree(Args);
+} /* SealProcessFile() */
@@ -0,0 +1,26 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Processing one file: detect the format, then sign or verify.
+ ************************************************/
+#ifndef PROCESS_HPP
+#define PROCESS_HPP
+
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "seal.hpp"
+#include "files.hpp"
+
+sealfield *	SealArgsInit	();
+int	SealFileFormat	(mmapfile *Mmap);
+const char *	FormatName	(int FileFormat);
+sealfield *	SealFormatProcess	(sealfield *Args, int FileFormat, mmapfile *Mmap);
+void	SealSignerAdd	(sealfield *Signer);
+void	SealSignerFree	();
+void	SealProcessFile	(sealfield *CleanArgs, const char *Filename, int Mode);
+
+#endif
@@ -23,13 +23,13 @@
 #include <string.h>
 #include <ctype.h>
 
-// For Base64
-#include <openssl/bio.h>
-#include <openssl/buffer.h>
-#include <openssl/evp.h>
+#if defined(__x86_64__)
+  #include <immintrin.h>
+#endif
 
 #include "seal.hpp"
 #include "seal-parse.hpp"
+#include "stats.hpp"
 
 struct {
   int len;
@@ -260,6 +260,247 @@ void	SealXmlEncode	(sealfield *Data)
     }
 } /* SealXmlEncode() */
 
+/**************************************
+ Hex and base64 codecs.
+ Signatures, digests, and public keys all pass through these,
+ and bulk signing/verifying calls them for every file.
+   - Decoding tables are generated at compile time.
+   - x86-64 with SSSE3/SSE4.1: 16 input bytes per step.
+     (Base64 kernels follow Muła and Lemire, "Faster Base64 Encoding
+     and Decoding Using AVX2 Instructions".)
+   - Everything else uses the scalar tables.
+ The kernel is selected once at runtime.
+ Decoding is strict: any invalid character returns nothing.
+ Base64 decoding ignores whitespace and missing "=" padding
+ (the same as the OpenSSL decoder that it replaced).
+ **************************************/
+#pragma GCC visibility push(hidden)
+
+struct _codectables
+  {
+  int8_t Hex[256];  // -1 = invalid
+  int8_t B64[256];  // -1 = invalid, -2 = whitespace
+  };
+static constexpr _codectables _CodecInit()
+{
+  _codectables T{};
+  for(int i=0; i < 256; i++) { T.Hex[i]=-1; T.B64[i]=-1; }
+  for(int i=0; i < 10; i++) { T.Hex['0'+i]=i; }
+  for(int i=0; i < 6; i++) { T.Hex['a'+i]=10+i; T.Hex['A'+i]=10+i; }
+  for(int i=0; i < 26; i++) { T.B64['A'+i]=i; T.B64['a'+i]=26+i; }
+  for(int i=0; i < 10; i++) { T.B64['0'+i]=52+i; }
+  T.B64['+']=62; T.B64['/']=63;
+  T.B64[' ']=-2; T.B64['\t']=-2; T.B64['\r']=-2; T.B64['\n']=-2;
+  return(T);
+}
+static constexpr _codectables _CodecTables = _CodecInit();
+static constexpr char _HexLower[]="0123456789abcdef";
+static constexpr char _HexUpper[]="0123456789ABCDEF";
+static constexpr char _B64Chars[]="ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static_assert(_CodecTables.Hex['f']==15 && _CodecTables.Hex['G']==-1, "hex table");
+static_assert(_CodecTables.B64['/']==63 && _CodecTables.B64['=']==-1, "base64 table");
+
+/*****
+ Each kernel processes as many whole blocks as it can and returns
+ the number of input bytes consumed. The caller finishes the tail
+ with the scalar code. Decoders return early at the first block
+ with an invalid character; the scalar code then decides.
+ Decoders may write up to 16 bytes past the output position,
+ but never past the input that has been read (safe for in-place).
+ *****/
+typedef size_t (*_HexEncodeFunc)(const byte *In, size_t InLen, byte *Out, bool IsUpper);
+typedef size_t (*_HexDecodeFunc)(const byte *In, size_t InLen, byte *Out);
+typedef size_t (*_B64EncodeFunc)(const byte *In, size_t InLen, byte *Out);
+typedef size_t (*_B64DecodeFunc)(const byte *In, size_t InLen, byte *Out, size_t *OutLen);
+
+static size_t	_HexEncodeNone	(const byte *, size_t, byte *, bool) { return(0); }
+static size_t	_HexDecodeNone	(const byte *, size_t, byte *) { return(0); }
+static size_t	_B64EncodeNone	(const byte *, size_t, byte *) { return(0); }
+static size_t	_B64DecodeNone	(const byte *, size_t, byte *, size_t *OutLen) { *OutLen=0; return(0); }
+
+#if defined(__x86_64__)
+/**************************************
+ _HexEncodeSSSE3(): 16 bytes become 32 characters.
+ Each nibble indexes a 16-character table with pshufb.
+ **************************************/
+__attribute__((target("ssse3")))
+static size_t	_HexEncodeSSSE3	(const byte *In, size_t InLen, byte *Out, bool IsUpper)
+{
+  const __m128i Lut = _mm_loadu_si128((const __m128i*)(IsUpper ? _HexUpper : _HexLower));
+  const __m128i Mask = _mm_set1_epi8(0x0f);
+  size_t i;
+  for(i=0; i+16 <= InLen; i+=16)
+    {
+    __m128i v = _mm_loadu_si128((const __m128i*)(In+i));
+    __m128i Hi = _mm_shuffle_epi8(Lut,_mm_and_si128(_mm_srli_epi16(v,4),Mask));
+    __m128i Lo = _mm_shuffle_epi8(Lut,_mm_and_si128(v,Mask));
+    _mm_storeu_si128((__m128i*)(Out+i*2),_mm_unpacklo_epi8(Hi,Lo));
+    _mm_storeu_si128((__m128i*)(Out+i*2+16),_mm_unpackhi_epi8(Hi,Lo));
+    }
+  return(i);
+} /* _HexEncodeSSSE3() */
+
+/**************************************
+ _HexNibblesSSSE3(): Convert 16 hex characters to nibbles.
+ Sets Valid to false if any character is not hex.
+ **************************************/
+__attribute__((target("ssse3")))
+static inline __m128i	_HexNibblesSSSE3	(__m128i v, bool &Valid)
+{
+  // Signed compares: bytes >= 0x80 are negative and fail both ranges.
+  __m128i Digit = _mm_sub_epi8(v,_mm_set1_epi8('0'));
+  __m128i IsDigit = _mm_and_si128(_mm_cmpgt_epi8(v,_mm_set1_epi8('0'-1)),
+				  _mm_cmplt_epi8(v,_mm_set1_epi8('9'+1)));
+  __m128i Lower = _mm_or_si128(v,_mm_set1_epi8(0x20));
+  __m128i Alpha = _mm_sub_epi8(Lower,_mm_set1_epi8('a'-10));
+  __m128i IsAlpha = _mm_and_si128(_mm_cmpgt_epi8(Lower,_mm_set1_epi8('a'-1)),
+				  _mm_cmplt_epi8(Lower,_mm_set1_epi8('f'+1)));
+  if (_mm_movemask_epi8(_mm_or_si128(IsDigit,IsAlpha)) != 0xffff) { Valid=false; }
+  return(_mm_or_si128(_mm_and_si128(IsDigit,Digit),_mm_and_si128(IsAlpha,Alpha)));
+} /* _HexNibblesSSSE3() */
+
+/**************************************
+ _HexDecodeSSSE3(): 32 characters become 16 bytes.
+ pmaddubsw combines each nibble pair: hi*16 + lo.
+ **************************************/
+__attribute__((target("ssse3")))
+static size_t	_HexDecodeSSSE3	(const byte *In, size_t InLen, byte *Out)
+{
+  const __m128i Mul = _mm_set1_epi16(0x0110);
+  size_t i;
+  for(i=0; i+32 <= InLen; i+=32)
+    {
+    bool Valid=true;
+    __m128i a = _HexNibblesSSSE3(_mm_loadu_si128((const __m128i*)(In+i)),Valid);
+    __m128i b = _HexNibblesSSSE3(_mm_loadu_si128((const __m128i*)(In+i+16)),Valid);
+    if (!Valid) { break; }
+    a = _mm_maddubs_epi16(a,Mul);
+    b = _mm_maddubs_epi16(b,Mul);
+    _mm_storeu_si128((__m128i*)(Out+i/2),_mm_packus_epi16(a,b));
+    }
+  return(i);
+} /* _HexDecodeSSSE3() */
+
+/**************************************
+ _B64EncodeSSSE3(): 12 bytes become 16 characters.
+ Reads 16 bytes per step, so it stops 4 bytes early.
+ **************************************/
+__attribute__((target("ssse3")))
+static size_t	_B64EncodeSSSE3	(const byte *In, size_t InLen, byte *Out)
+{
+  const __m128i Shuf = _mm_set_epi8(10,11,9,10, 7,8,6,7, 4,5,3,4, 1,2,0,1);
+  const __m128i Shift = _mm_setr_epi8('a'-26,'0'-52,'0'-52,'0'-52,'0'-52,'0'-52,
+	'0'-52,'0'-52,'0'-52,'0'-52,'0'-52,'+'-62,'/'-63,'A',0,0);
+  size_t i,o;
+  for(i=o=0; i+16 <= InLen; i+=12, o+=16)
+    {
+    __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(In+i)),Shuf);
+    // Split each 3 bytes into four 6-bit indexes
+    __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(v,_mm_set1_epi32(0x0fc0fc00)),_mm_set1_epi32(0x04000040));
+    __m128i t1 = _mm_mullo_epi16(_mm_and_si128(v,_mm_set1_epi32(0x003f03f0)),_mm_set1_epi32(0x01000010));
+    __m128i Idx = _mm_or_si128(t0,t1);
+    // Map index ranges to ASCII offsets
+    __m128i r = _mm_subs_epu8(Idx,_mm_set1_epi8(51));
+    __m128i Less = _mm_cmpgt_epi8(_mm_set1_epi8(26),Idx);
+    r = _mm_or_si128(r,_mm_and_si128(Less,_mm_set1_epi8(13)));
+    r = _mm_add_epi8(_mm_shuffle_epi8(Shift,r),Idx);
+    _mm_storeu_si128((__m128i*)(Out+o),r);
+    }
+  return(i);
+} /* _B64EncodeSSSE3() */
+
+/**************************************
+ _B64DecodeSSE41(): 16 characters become 12 bytes.
+ Validation uses nibble lookup tables; any bit in common
+ between the low-nibble and high-nibble classes is invalid.
+ **************************************/
+__attribute__((target("ssse3,sse4.1")))
+static size_t	_B64DecodeSSE41	(const byte *In, size_t InLen, byte *Out, size_t *OutLen)
+{
+  const __m128i LutLo = _mm_setr_epi8(0x15,0x11,0x11,0x11,0x11,0x11,0x11,0x11,
+	0x11,0x11,0x13,0x1a,0x1b,0x1b,0x1b,0x1a);
+  const __m128i LutHi = _mm_setr_epi8(0x10,0x10,0x01,0x02,0x04,0x08,0x04,0x08,
+	0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10);
+  const __m128i LutRoll = _mm_setr_epi8(0,16,19,4,-65,-65,-71,-71,0,0,0,0,0,0,0,0);
+  const __m128i Mask2F = _mm_set1_epi8(0x2f);
+  const __m128i Pack = _mm_setr_epi8(2,1,0,6,5,4,10,9,8,14,13,12,-1,-1,-1,-1);
+  size_t i,o;
+  for(i=o=0; i+16 <= InLen; i+=16, o+=12)
+    {
+    __m128i v = _mm_loadu_si128((const __m128i*)(In+i));
+    __m128i HiNib = _mm_and_si128(_mm_srli_epi32(v,4),Mask2F);
+    __m128i Lo = _mm_shuffle_epi8(LutLo,_mm_and_si128(v,Mask2F));
+    __m128i Hi = _mm_shuffle_epi8(LutHi,HiNib);
+    if (!_mm_testz_si128(Lo,Hi)) { break; } // invalid, padding, or whitespace
+    __m128i Roll = _mm_shuffle_epi8(LutRoll,_mm_add_epi8(_mm_cmpeq_epi8(v,Mask2F),HiNib));
+    v = _mm_add_epi8(v,Roll); // 6-bit values
+    // Merge four 6-bit values into three bytes
+    v = _mm_maddubs_epi16(v,_mm_set1_epi32(0x01400140));
+    v = _mm_madd_epi16(v,_mm_set1_epi32(0x00011000));
+    _mm_storeu_si128((__m128i*)(Out+o),_mm_shuffle_epi8(v,Pack));
+    }
+  *OutLen=o;
+  return(i);
+} /* _B64DecodeSSE41() */
+#endif
+
+/**************************************
+ _CodecSelect(): Pick the fastest kernels for this CPU.
+ **************************************/
+struct _codecfuncs
+  {
+  _HexEncodeFunc HexEncode;
+  _HexDecodeFunc HexDecode;
+  _B64EncodeFunc B64Encode;
+  _B64DecodeFunc B64Decode;
+  };
+static _codecfuncs	_CodecSelect	()
+{
+  _codecfuncs F = { _HexEncodeNone, _HexDecodeNone, _B64EncodeNone, _B64DecodeNone };
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("ssse3"))
+    {
+    F.HexEncode = _HexEncodeSSSE3;
+    F.HexDecode = _HexDecodeSSSE3;
+    F.B64Encode = _B64EncodeSSSE3;
+    if (__builtin_cpu_supports("sse4.1")) { F.B64Decode = _B64DecodeSSE41; }
+    }
+#endif
+  return(F);
+} /* _CodecSelect() */
+
+static const _codecfuncs &	_Codec	()
+{
+  // Selected once; thread-safe static initialization
+  static const _codecfuncs F = _CodecSelect();
+  return(F);
+} /* _Codec() */
+
+/**************************************
+ _CodecReplace(): Replace the value with a new buffer.
+ **************************************/
+static void	_CodecReplace	(sealfield *Data, byte *Value, size_t ValueLen, char Type)
+{
+  free(Data->Value);
+  Data->Value = Value;
+  Data->ValueLen = ValueLen;
+  Data->Type = Type;
+} /* _CodecReplace() */
+
+/**************************************
+ _CodecTruncate(): Shorten an inline-decoded value.
+ Clears the leftover input so the value stays null-terminated.
+ **************************************/
+static void	_CodecTruncate	(sealfield *Data, size_t ValueLen, char Type)
+{
+  if (ValueLen < Data->ValueLen) { memset(Data->Value+ValueLen,0,Data->ValueLen-ValueLen); }
+  Data->ValueLen = ValueLen;
+  Data->Type = Type;
+} /* _CodecTruncate() */
+
+#pragma GCC visibility pop
+
 /**************************************
  SealHexDecode(): Given a string, convert hex to binary
  NOTE: Invalid or odd-length returns noting.
@@ -268,127 +509,111 @@ void	SealHexDecode	(sealfield *Data)
 {
   // Do the decoding inline
   if (!Data || !Data->ValueLen) { return; }
+  if (Data->ValueLen % 2) { _CodecTruncate(Data,0,'x'); return; }
 
-  size_t i,j;
-  int c=0,bits=0;
-  for(i=j=0; i < Data->ValueLen; i++)
+  const byte *In = Data->Value;
+  size_t Len = Data->ValueLen;
+  size_t i = _Codec().HexDecode(In,Len,Data->Value);
+  for( ; i < Len; i+=2)
     {
-    c <<= 4; bits+=4;
-    if (!isxdigit(Data->Value[i])) { j=0; break; } // invalid
-    else if (isdigit(Data->Value[i])) { c |= (Data->Value[i]-'0'); }
-    else if (isupper(Data->Value[i])) { c |= (Data->Value[i]-'A'+10); }
-    else if (islower(Data->Value[i])) { c |= (Data->Value[i]-'a'+10); }
-    if (bits >= 8)
-	{
-	Data->Value[j] = c & 0xff;
-	j++;
-	bits=0;
-	}
-    }
-  if (bits != 0)
-    {
-    j=0;
+    int hi = _CodecTables.Hex[In[i]];
+    int lo = _CodecTables.Hex[In[i+1]];
+    if ((hi | lo) < 0) { _CodecTruncate(Data,0,'x'); return; } // invalid
+    Data->Value[i/2] = (hi << 4) | lo;
     }
-  Data->ValueLen = j;
-  Data->Type = 'x';
+  _CodecTruncate(Data,Len/2,'x');
 } /* SealHexDecode() */
 
 /**************************************
  SealHexEncode(): Given binary, convert to hex.
- NOTE: Odd values assume terminating "0".
- Stops at any non-hex values.
  **************************************/
 void	SealHexEncode	(sealfield *Data, bool IsUpper)
 {
-  sealfield *D=NULL;
-  char d[3];
-  size_t i;
-
-  // Do the decoding inline
   if (!Data || !Data->ValueLen) { return; }
 
-  for(i=0; i < Data->ValueLen; i++)
+  const char *Hex = (IsUpper ? _HexUpper : _HexLower);
+  size_t Len = Data->ValueLen;
+  byte *Out = (byte*)calloc(Len*2+4,1);
+  size_t i = _Codec().HexEncode(Data->Value,Len,Out,IsUpper);
+  for( ; i < Len; i++)
     {
-    if (IsUpper) { snprintf(d,3,"%02X",Data->Value[i]); }
-    else { snprintf(d,3,"%02x",Data->Value[i]); }
-    D = SealAddTextLen(D,"bin",2,d);
+    Out[i*2] = Hex[Data->Value[i] >> 4];
+    Out[i*2+1] = Hex[Data->Value[i] & 0x0f];
     }
-
-  // Replace inline
-  byte *tmp; // swap memory
-  tmp = Data->Value;
-  Data->Value = D->Value;
-  Data->ValueLen = D->ValueLen;
-  D->Value = tmp;
-  SealFree(D);
-  Data->Type = 'c';
+  _CodecReplace(Data,Out,Len*2,'c');
 } /* SealHexEncode() */
 
 /**************************************
  SealBase64Decode(): Given base64, decode to binary.
- Stops at any non-base64 values.
+ NOTE: Invalid characters return nothing.
+ Whitespace is skipped and "=" padding is optional.
  **************************************/
 void	SealBase64Decode	(sealfield *Data)
 {
-  BIO *bio, *b64;
-  sealfield *D=NULL;
-  byte d[16];
-  int dlen;
-
   // Do the decoding inline
   if (!Data || !Data->ValueLen) { return; }
 
-  // Make sure it ends with "=" padding
-  while(Data->ValueLen % 4) { Data = SealAddC(Data,Data->Field,'='); }
+  const byte *In = Data->Value;
+  size_t Len = Data->ValueLen;
+  size_t i,j,n;
+  uint32_t Bits=0;
+  int BitLen=0, Pad=0;
 
-  b64 = BIO_new(BIO_f_base64());
-  bio = BIO_new_mem_buf(Data->Value,Data->ValueLen);
-  bio = BIO_push(b64, bio);
-  BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
-  while((dlen = BIO_read(bio, d, 16)) > 0) // decode in small chunks
+  // Fast path stops at the first whitespace, padding, or invalid block
+  i = _Codec().B64Decode(In,Len,Data->Value,&j);
+  for(n=0; i < Len; i++)
     {
-    D = SealAddBin(D,"bin",dlen,d);
+    int v = _CodecTables.B64[In[i]];
+    if (v == -2) { continue; } // whitespace
+    if (In[i] == '=') { Pad++; continue; }
+    if ((v < 0) || Pad) { _CodecTruncate(Data,0,'x'); return; } // invalid
+    Bits = (Bits << 6) | v;
+    BitLen += 6;
+    n++;
+    if (BitLen >= 8)
+      {
+      BitLen -= 8;
+      Data->Value[j++] = (Bits >> BitLen) & 0xff;
+      }
     }
-  BIO_free_all(bio); // frees memory
-
-  if (!D) { Data->ValueLen=0; }
-
-  // Replace inline
-  byte *tmp; // swap memory
-  tmp = Data->Value;
-  Data->Value = D->Value;
-  Data->ValueLen = D->ValueLen;
-  D->Value = tmp;
-  SealFree(D);
-  Data->Type = 'x';
+
+  // A single leftover character cannot make a byte.
+  if ((n % 4 == 1) || (Pad > 2)) { j=0; }
+  _CodecTruncate(Data,j,'x');
 } /* SealBase64Decode() */
 
 /**************************************
- SealBase64Encode(): Given base64, decode to binary.
- Stops at any non-base64 values.
+ SealBase64Encode(): Given binary, encode as base64.
+ Always includes "=" padding; no newlines.
  **************************************/
 void	SealBase64Encode	(sealfield *Data)
 {
-  BIO *bio, *b64;
-  BUF_MEM *bptr;
-
   if (!Data || !Data->ValueLen) { return; }
 
-  b64 = BIO_new(BIO_f_base64());
-  bio = BIO_new(BIO_s_mem());
-  bio = BIO_push(b64, bio);
-  BIO_set_flags(b64, BIO_FLAGS_BASE64_NO_NL);
-  BIO_write(b64,Data->Value,Data->ValueLen);
-  (void)BIO_flush(b64);
-
-  BIO_get_mem_ptr(b64, &bptr);
-  Data->Value = (byte*)realloc(Data->Value,bptr->length+4);
-  Data->ValueLen = bptr->length;
-  memset(Data->Value,0,Data->ValueLen+4);
-  memcpy(Data->Value, bptr->data, bptr->length);
-
-  BIO_free_all(bio); // frees memory
-  Data->Type = 'c';
+  size_t Len = Data->ValueLen;
+  size_t OutLen = ((Len+2)/3)*4;
+  const byte *In = Data->Value;
+  byte *Out = (byte*)calloc(OutLen+4,1);
+  size_t i = _Codec().B64Encode(In,Len,Out);
+  size_t o = (i/3)*4;
+  for( ; i+3 <= Len; i+=3, o+=4)
+    {
+    uint32_t v = ((uint32_t)In[i] << 16) | ((uint32_t)In[i+1] << 8) | In[i+2];
+    Out[o]   = _B64Chars[(v >> 18) & 0x3f];
+    Out[o+1] = _B64Chars[(v >> 12) & 0x3f];
+    Out[o+2] = _B64Chars[(v >> 6) & 0x3f];
+    Out[o+3] = _B64Chars[v & 0x3f];
+    }
+  if (i < Len) // 1 or 2 bytes left
+    {
+    uint32_t v = (uint32_t)In[i] << 16;
+    if (i+1 < Len) { v |= (uint32_t)In[i+1] << 8; }
+    Out[o]   = _B64Chars[(v >> 18) & 0x3f];
+    Out[o+1] = _B64Chars[(v >> 12) & 0x3f];
+    Out[o+2] = (i+1 < Len) ? _B64Chars[(v >> 6) & 0x3f] : '=';
+    Out[o+3] = '=';
+    }
+  _CodecReplace(Data,Out,OutLen,'c');
 } /* SealBase64Encode() */
 
 /**************************************
@@ -417,8 +642,10 @@ sealfield *	SealParse	(size_t TextLen, const byte *Text, size_t Offset, sealfiel
   uint32_t fs=0,fe=0; // field start and end offsets
   uint32_t vs=0,ve=0; // value start and end offsets
   bool IsBad=false;
+  statscope Stat(StatParse);
 
   if (!Text || (TextLen < 10)) { return(NULL); }
+  Stat.Bytes = TextLen;
 
   for(i=0; i < TextLen; i++)
     {
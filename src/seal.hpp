@@ -92,8 +92,8 @@ void	DEBUGhexdump	(size_t DataLen, const byte *Data);
 #define readle16(buf)	( (((buf)[1]&0xff)<<8) | ((buf)[0]&0xff) )
 #define readbe32(buf)	( (((buf)[0]&0xff)<<24) | (((buf)[1]&0xff)<<16) | (((buf)[2]&0xff)<<8) | ((buf)[3]&0xff) )
 #define readle32(buf)	( (((buf)[3]&0xff)<<24) | (((buf)[2]&0xff)<<16) | (((buf)[1]&0xff)<<8) | ((buf)[0]&0xff) )
-#define readbe64(buf)	( ((uint64_t)(readbe32(buf))<<32) | (uint64_t)(readbe32((buf)+4)) )
-#define readle64(buf)	( ((uint64_t)(readbe32((buf)+4))<<32) | (uint64_t)(readbe32(buf)) )
+#define readbe64(buf)	( ((uint64_t)(uint32_t)(readbe32(buf))<<32) | (uint64_t)(uint32_t)(readbe32((buf)+4)) )
+#define readle64(buf)	( ((uint64_t)(uint32_t)(readle32((buf)+4))<<32) | (uint64_t)(uint32_t)(readle32(buf)) )
 
 // Writing raw bytes with a specific endian
 #define writebe16(buf,u16) { (buf)[0]=((u16)>>8)&0xff; (buf)[1]=(u16)&0xff; }
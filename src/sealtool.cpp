@@ -36,6 +36,15 @@
 #include "formats.hpp"
 #include "seal-parse.hpp"
 #include "sign.hpp"
+#include "process.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include "metrics.hpp"
+#include "dns.hpp"
+#include "keystore.hpp"
+#include "output.hpp"
+#include "manifest.hpp"
+#include "follow.hpp"
 
 /**************************************
  ReadCfg(): Read the config file.
@@ -319,6 +328,26 @@ void	Usage	(const char *progname)
   printf("  Verifying:\n");
   printf("  Verify any SEAL signature in the file(s)\n");
   printf("  -D, --dnsfile fname  :: Optional: text file with DNS TXT value. (default: unset; use DNS)\n");
+  printf("  --format fmt         :: Optional: text (default) or json (one JSON object per file).\n");
+  printf("  --check-crc          :: Optional: PNG: report any chunk with an invalid CRC.\n");
+  printf("  --keystore file      :: Optional: many DNS TXT records, checked before DNS. One per line:\n");
+  printf("                            domain [ttl] [IN] [TXT] \"seal=1 ...\"   (or a --keystore-index file)\n");
+  printf("  --keystore-index out :: Save the loaded --keystore as an index for instant loading.\n");
+  printf("  --dns-prefetch N     :: Optional: resolve DNS with N background threads, reading ahead in the files.\n");
+  printf("  --dns-record file    :: Optional: save every DNS TXT reply and its time to the file.\n");
+  printf("  --dns-replay file    :: Optional: use the replies saved by --dns-record; no network.\n");
+  printf("  --dns-latency ms     :: Optional: delay each replayed reply; 'recorded' uses the saved times.\n");
+  printf("\n");
+  printf("  Batch runs:\n");
+  printf("  --manifest file      :: Log completed files; on restart, skip unchanged completed files.\n");
+  printf("  --shard i/N          :: Only process the files whose path hash modulo N is i (0 to N-1).\n");
+  printf("\n");
+  printf("  Diagnostics:\n");
+  printf("  --stats              :: Show per-phase timing, page faults, and peak RSS.\n");
+  printf("                          Per-file details with -v.\n");
+  printf("  --trace file.json    :: Write a Chrome/Perfetto trace of every file and phase.\n");
+  printf("  --metrics file.prom  :: Write Prometheus metrics (counters and gauges) to the file.\n");
+  printf("                          Rewritten atomically every --metrics-interval seconds (default: 10).\n");
   printf("\n");
   printf("  Generate signature:\n");
   printf("  -g, --generate       :: Required: generate a signature\n");
@@ -353,6 +382,9 @@ void	Usage	(const char *progname)
   printf("  -M, --Manual ''      :: Generate the SEAL record with a stubbed value.\n");
   printf("  -M, --Manual digest  :: Given a hex digest, sign it using a remote service.\n");
   printf("  -m, --manual digest  :: Given a hex digest, sign it using a local key.\n");
+  printf("  -m - (or -M -)       :: Stream: read one digest per line from stdin; write one record per line.\n");
+  printf("                          Line: hexdigest [id=userid] [date=YYYYMMDDhhmmss[.fraction]]\n");
+  printf("  --manual-jobs N      :: Stream: sign with N threads (local signing only; default: 1)\n");
   printf("\n");
   printf("  Common signing options (for local and remote)\n");
   printf("  -d, --domain domain  :: DNS entry with the public key (default: localhost.localdomain)\n");
@@ -366,6 +398,21 @@ void	Usage	(const char *progname)
   printf("        -O text may contain a comma-separated list of options:\n");
   printf("        append  :: This is an appending signature; not final signature.\n");
   printf("        seAl,SEAL,teXt,tEXt,...  :: PNG: chunk name to use.\n");
+  printf("  --append-state       :: Save each record's digest in outfile.sealstate; when re-signing\n");
+  printf("                          the grown file, reuse them instead of re-hashing the old data.\n");
+  printf("                          Heuristic: the old data is only checked by size and a sampled\n");
+  printf("                          fingerprint. Use it only on append-only storage that you trust.\n");
+  printf("  --also-sign file.cfg :: Add another record with the settings in this config file\n");
+  printf("                          (keyfile, keyalg, domain, ...). Repeat for more. Records are added\n");
+  printf("                          in order in one write; all but the last use '-O append'.\n");
+  printf("                          Each extra record copies the file in memory (up to twice the\n");
+  printf("                          file size at once); files over 1 GB are skipped with an error.\n");
+  printf("  --follow             :: Sign one growing Text, MPEG, AAC, or Matroska file as it is written.\n");
+  printf("                          Copies it to the outfile and appends a SEAL record every interval.\n");
+  printf("                          Stops on Ctrl-C, when the file is moved or deleted, or when idle.\n");
+  printf("  --follow-seconds N   :: Seconds between --follow records (default: 10; 0 = bytes only)\n");
+  printf("  --follow-bytes N     :: Also add a record after N new bytes (default: 0 = seconds only)\n");
+  printf("  --follow-idle N      :: Stop after N seconds without new data (default: 0 = never)\n");
   printf("  -K, --keyalg alg     :: Key algorithm  (default: rsa)\n");
   printf("  -A, --digestalg alg    :: Digest (hash) algorithm  (default: sha256)\n");
   printf("               Supports: sha224, sha256, sha384, sha512\n");
@@ -388,34 +435,15 @@ void	Usage	(const char *progname)
 int main (int argc, char *argv[])
 {
   sealfield *Args=NULL, *CleanArgs;
-  int c;
+  sealfield **AlsoSign=NULL; // --also-sign signers
+  int AlsoSignCount=0;
+  int c, i;
   int Mode='v';
-  int FileFormat='@';
   bool IsURL=false; // for signing, use URL?
   bool IsLocal=false; // for signing, use local?
 
   // Set default values
-  Args = SealSetText(Args,"seal","1"); // SEAL version; currently always '1'
-  Args = SealSetText(Args,"b","F~S,s~f"); // default byte range is everything
-  Args = SealSetText(Args,"digestalg","sha256");
-  Args = SealSetText(Args,"keyalg","rsa");
-  Args = SealSetText(Args,"keybits","2048");
-  Args = SealSetText(Args,"keyfile","./seal-private.pem");
-  Args = SealSetText(Args,"outfile","./%b-seal%e");
-  Args = SealSetText(Args,"options","");
-  Args = SealSetText(Args,"kv","1");
-  Args = SealSetText(Args,"sf","HEX");
-  Args = SealSetText(Args,"domain","localhost.localdomain");
-  Args = SealSetText(Args,"dnsfile","");
-  Args = SealSetText(Args,"copyright","");
-  Args = SealSetText(Args,"comment","");
-  Args = SealSetText(Args,"info","");
-  Args = SealSetText(Args,"id","");
-  Args = SealSetText(Args,"apiurl","");
-  Args = SealSetText(Args,"apikey","");
-#ifdef __CYGWIN__
-  Args = SealSetText(Args,"cacert","./cacert.crt");
-#endif
+  Args = SealArgsInit();
 
   // Set default config file based on user's home.
   {
@@ -434,13 +462,6 @@ int main (int argc, char *argv[])
   Args = ReadCfg(Args);
   }
 
-  // p and s are used with b to generate the hash.
-  Args = SealSetIindex(Args,"@s",2,0); // sig offset in file [0]=start, [1]=end, [2]=number of signatures; default:zeros
-  Args = SealSetIindex(Args,"@p",1,0); // previous sig offset in file [0]=start, [1]=end; default:[0,0]
-  Args = SealSetText(Args,"@sflags"," "); // total range flags, set by SealDigest()
-  Args = SealSetText(Args,"@sflags0"," "); // starting range flags, set by SealDigest()
-  Args = SealSetText(Args,"@sflags1"," "); // ending range flags, set by SealDigest()
-
   // Read command-line
   int long_option_index;
   struct option long_options[] = {
@@ -468,6 +489,7 @@ int main (int argc, char *argv[])
     {"keyfile",   required_argument, NULL, 'k'},
     {"Manual",    required_argument, NULL, 'M'},
     {"manual",    required_argument, NULL, 'm'},
+    {"manual-jobs", required_argument, NULL, 1}, // threads for -m -
     {"outfile",   required_argument, NULL, 'o'},
     {"options",   required_argument, NULL, 'O'},
     {"Sign",      no_argument, NULL, 'S'},
@@ -476,6 +498,26 @@ int main (int argc, char *argv[])
     {"sf",        required_argument, NULL, 1},
     {"kv",        required_argument, NULL, 1}, // must be numeric >= 0
     {"uid",       required_argument, NULL, 1},
+    {"format",    required_argument, NULL, 1}, // text or json
+    {"manifest",  required_argument, NULL, 1}, // resumable runs
+    {"shard",     required_argument, NULL, 1}, // i/N
+    {"append-state", no_argument, NULL, 0}, // save/reuse digests when re-signing
+    {"also-sign", required_argument, NULL, 2}, // another signer's config (repeatable)
+    {"follow",    no_argument, NULL, 0}, // sign a growing file
+    {"follow-seconds", required_argument, NULL, 1}, // seconds between records
+    {"follow-bytes", required_argument, NULL, 1}, // bytes between records
+    {"follow-idle", required_argument, NULL, 1}, // stop after idle seconds
+    {"check-crc", no_argument, NULL, 0}, // validate every PNG chunk CRC
+    {"keystore",  required_argument, NULL, 1}, // offline keys
+    {"keystore-index", required_argument, NULL, 1}, // save the keystore index
+    {"dns-prefetch", required_argument, NULL, 1}, // DNS threads
+    {"dns-record", required_argument, NULL, 1}, // save DNS replies
+    {"dns-replay", required_argument, NULL, 1}, // replay saved DNS replies
+    {"dns-latency", required_argument, NULL, 1}, // replay delay (ms or "recorded")
+    {"stats",     no_argument, NULL, 0}, // per-phase timing
+    {"trace",     required_argument, NULL, 1}, // trace-event json
+    {"metrics",   required_argument, NULL, 1}, // prometheus textfile
+    {"metrics-interval", required_argument, NULL, 1}, // seconds between writes
     // modes
     {NULL,0,NULL,0}
     };
@@ -489,6 +531,11 @@ int main (int argc, char *argv[])
       case 1: // generic longopt with required_argument (and no single-letter mapping)
 	Args = SealSetText(Args,long_options[long_option_index].name,optarg);
 	break;
+      case 2: // --also-sign: a config file applied after all options
+	AlsoSign = (sealfield**)realloc(AlsoSign,(AlsoSignCount+1)*sizeof(sealfield*));
+	AlsoSign[AlsoSignCount] = SealSetText(NULL,"config",optarg);
+	AlsoSignCount++;
+	break;
       case 9: // read configuration file
 	Args = SealSetText(Args,"config",optarg);
 	Args = ReadCfg(Args);
@@ -513,7 +560,11 @@ int main (int argc, char *argv[])
       case 'M': // manual remote signing
       case 'm': // manual local signing
 	{
-	if (optarg[0])
+	if (!strcmp(optarg,"-")) // stream from stdin
+	  {
+	  Args = SealSetText(Args,"@manualstream","1");
+	  }
+	else if (optarg[0])
 	  {
 	  Args = SealSetText(Args,"@digest1",optarg);
 	  SealHexDecode(SealSearch(Args,"@digest1")); // hex to binary
@@ -543,8 +594,55 @@ int main (int argc, char *argv[])
       }
     } // while reading args
 
+  // Each --also-sign signer starts with these options, then reads its config
+  for(i=0; i < AlsoSignCount; i++)
+    {
+    sealfield *Cfg = AlsoSign[i];
+    if (access(SealGetText(Cfg,"config"),R_OK) != 0)
+	{
+	fprintf(stderr,"ERROR: Unable to read --also-sign configuration file: '%s'. Aborting.\n",SealGetText(Cfg,"config"));
+	exit(0x80);
+	}
+    AlsoSign[i] = SealCopy2(SealClone(Args),"config",Cfg,"config");
+    SealFree(Cfg);
+    AlsoSign[i] = ReadCfg(AlsoSign[i]);
+    AlsoSign[i] = SealParmCheck(AlsoSign[i]);
+    }
+
   // Idiot check values: No double-quotes!
   Args = SealParmCheck(Args);
+  StatsShow = (SealSearch(Args,"stats") != NULL);
+  if (SealSearch(Args,"trace")) { TraceOpen(SealGetText(Args,"trace")); }
+  if (SealSearch(Args,"metrics"))
+    {
+    int Interval = SealSearch(Args,"metrics-interval") ? atoi(SealGetText(Args,"metrics-interval")) : 10;
+    MetricsOpen(SealGetText(Args,"metrics"),Interval);
+    }
+  StatsEnabled = StatsShow || TraceEnabled || MetricsEnabled;
+  OutputOpen(SealGetText(Args,"format"));
+  if (OutputJSON && (Mode!='v'))
+	{
+	fprintf(stderr,"ERROR: --format=json is only for verifying. Aborting.\n");
+	exit(0x80);
+	}
+  if (SealSearch(Args,"follow") && !strchr("sS",Mode))
+	{
+	fprintf(stderr,"ERROR: --follow is only for signing (-s or -S). Aborting.\n");
+	exit(0x80);
+	}
+  if (AlsoSignCount && !strchr("sS",Mode))
+	{
+	fprintf(stderr,"ERROR: --also-sign is only for signing (-s or -S). Aborting.\n");
+	exit(0x80);
+	}
+  if (AlsoSignCount && SealSearch(Args,"follow"))
+	{
+	fprintf(stderr,"ERROR: --also-sign cannot be used with --follow. Aborting.\n");
+	exit(0x80);
+	}
+  SealDNSInit(Args);
+  SealKeystoreInit(Args);
+  ManifestInit(Args);
   IsURL = SealIsURL(Args);
   IsLocal = SealIsLocal(Args);
 
@@ -574,6 +672,21 @@ int main (int argc, char *argv[])
 	exit(0x80);
 	}
     Args = SealSetCindex(Args,"@mode",0,Mode);
+
+    // Each --also-sign signer has its own key and signature size
+    for(i=0; i < AlsoSignCount; i++)
+      {
+      if (SealIsURL(AlsoSign[i]) && strchr("SM",Mode)) { AlsoSign[i] = SealSignURL(AlsoSign[i]); }
+      else if (SealIsLocal(AlsoSign[i]) && strchr("sm",Mode)) { AlsoSign[i] = SealSignLocal(AlsoSign[i]); }
+      if (SealGetU32index(AlsoSign[i],"@sigsize",0)==0)
+	{
+	fprintf(stderr,"ERROR: Unable to determine the signature size for --also-sign '%s'. Aborting.\n",SealGetText(AlsoSign[i],"config"));
+	exit(0x80);
+	}
+      AlsoSign[i] = SealSetCindex(AlsoSign[i],"@mode",0,Mode);
+      SealSignerAdd(AlsoSign[i]); // now owned by SealSignerFree()
+      }
+    if (AlsoSign) { free(AlsoSign); }
     }
   else
     {
@@ -584,11 +697,15 @@ int main (int argc, char *argv[])
   // Manual processing (no files)
   if (strchr("Mm",Mode))
     {
-    Seal_Manual(Args);
+    if (SealSearch(Args,"@manualstream")) { Args = Seal_ManualStream(Args); }
+    else { Args = Seal_Manual(Args); }
+    SealFreePrivateKey(); // if a private key was allocated
+    SealFree(Args);
     return(ReturnCode); // done processing
     }
 
   // Process all args (files required)
+  if ((optind >= argc) && SealSearch(Args,"keystore-index")) { return(ReturnCode); } // only saved the index
   if (optind >= argc)
     {
     fprintf(stderr,"ERROR: No input files.\n");
@@ -599,97 +716,54 @@ int main (int argc, char *argv[])
   CleanArgs = Args;
   Args=NULL;
 
-  // Process command-line files.
-  bool First=true;
-  for( ; optind < argc; optind++)
+  // Follow one growing file until it stops
+  if (SealSearch(CleanArgs,"follow"))
     {
-    // Start off with a clean set of parameters
-    if (Args) { SealFree(Args); Args=NULL; }
-    Args = SealClone(CleanArgs);
-
-    // Show file being processed.
-    if (First) { First=false; } else { printf("\n"); }
-    printf("[%s]\n",argv[optind]);
-    fflush(stdout);
-
-    // Memory map the file; needed for finding the SEAL record's location.
-    mmapfile *Mmap=NULL;
-    Mmap = MmapFile(argv[optind],PROT_READ); // read-only
-    if (!Mmap)
+    if (argc-optind != 1)
 	{
-	fprintf(stdout," ERROR: Unknown file '%s'. Skipping.\n",argv[optind]);
-	continue;
+	fprintf(stderr,"ERROR: --follow takes exactly one file. Aborting.\n");
+	exit(0x80);
 	}
+    printf("[%s]\n",argv[optind]);
+    fflush(stdout);
+    SealFollow(CleanArgs,argv[optind]);
+    SealFreePrivateKey();
+    SealFree(CleanArgs);
+    return(ReturnCode);
+    }
 
-    // Identify the filename format
-    if (Seal_isPNG(Mmap)) { FileFormat='P'; } // PNG
-    else if (Seal_isJPEG(Mmap)) { FileFormat='J'; } // JPEG
-    else if (Seal_isGIF(Mmap)) { FileFormat='G'; } // GIF
-    else if (Seal_isRIFF(Mmap)) { FileFormat='R'; } // RIFF
-    else if (Seal_isMatroska(Mmap)) { FileFormat='M'; } // Matroska
-    else if (Seal_isBMFF(Mmap)) { FileFormat='B'; } // BMFF
-    else if (Seal_isPDF(Mmap)) { FileFormat='p'; } // PDF
-    else if (Seal_isTIFF(Mmap)) { FileFormat='T'; } // TIFF
-    else if (Seal_isPPM(Mmap)) { FileFormat='m'; } // PPM/PGM
-    else if (Seal_isDICOM(Mmap)) { FileFormat='D'; } // DICOM
-    else if (Seal_isMPEG(Mmap)) { FileFormat='a'; } // MPEG
-    else if (Seal_isAAC(Mmap)) { FileFormat='A'; } // AAC
-    else if (Seal_isText(Mmap)) { FileFormat='x'; } // Text
-    else
-	{
-	fprintf(stdout," ERROR: Unknown file format '%s'. Skipping.\n",argv[optind]);
-	ReturnCode |= 0x02; // at least one file has no signature
-	MmapFree(Mmap);
-	continue;
-	}
+  // Drop files for other shards and files already done
+  argc = optind + ManifestFilter(argc-optind,argv+optind);
 
-    // File exists! Now process it!
-    if (strchr("sS",Mode)) // if signing local/remote
+  // Process command-line files.
+  bool First=true;
+  int FirstFile=optind;
+  if (Mode=='v') { SealDNSPrefetchFiles(argc-optind,argv+optind); }
+  for( ; optind < argc; optind++)
+    {
+    SealDNSPrefetchProgress(optind-FirstFile);
+    // Show file being processed.
+    if (!OutputJSON)
       {
-      char *Outname, *Template;
-      Template = (char*)(SealSearch(Args,"outfile")->Value);
-      Outname = MakeFilename(Template,(char*)argv[optind]);
-      if (!Outname) { continue; }
-      Args = SealSetText(Args,"@FilenameOut",Outname);
-      free(Outname);
+      if (First) { First=false; } else { printf("\n"); }
+      printf("[%s]\n",argv[optind]);
+      fflush(stdout);
       }
 
-    // Process based on file format
-    switch(FileFormat)
-    	{
-	case 'A': Args = Seal_AAC(Args,Mmap); break; // AAC
-	case 'a': Args = Seal_MPEG(Args,Mmap); break; // MPEG
-	case 'B': Args = Seal_BMFF(Args,Mmap); break; // BMFF
-	case 'D': Args = Seal_DICOM(Args,Mmap); break; // DICOM
-	case 'G': Args = Seal_GIF(Args,Mmap); break; // GIF
-	case 'J': Args = Seal_JPEG(Args,Mmap); break; // JPEG
-	case 'M': Args = Seal_Matroska(Args,Mmap); break; // Matroska
-	case 'm': Args = Seal_PPM(Args,Mmap); break; // PPM/PGM
-	case 'P': Args = Seal_PNG(Args,Mmap); break; // PNG
-	case 'p': Args = Seal_PDF(Args,Mmap); break; // PDF
-	case 'R': Args = Seal_RIFF(Args,Mmap); break; // RIFF
-	case 'T': Args = Seal_TIFF(Args,Mmap); break; // TIFF
-	case 'x': Args = Seal_Text(Args,Mmap); break; // Text
-	default: break; // should never happen
-	}
-
-    if (SealGetIindex(Args,"@s",2)==0) // no signatures
-	{
-	ReturnCode |= 0x02; // at least one file has no signature
-	}
-    else if (Mode=='v') // Check final
-	{
-	SealVerifyFinal(Args);
-	}
-
-    if (Verbose > 1) { DEBUGWALK("Post-File Parameters",Args); } // DEBUGGING
-    
-    MmapFree(Mmap);
-    if (Args) { SealFree(Args); Args=NULL; }
+    // Track this file's result for the manifest
+    int PrevCode = ReturnCode;
+    ReturnCode = 0;
+    ManifestFileBegin(argv[optind]);
+    SealProcessFile(CleanArgs,argv[optind],Mode);
+    ManifestFileEnd(ReturnCode);
+    ReturnCode |= PrevCode;
     } // foreach command-line file
+  ManifestFlush();
+  StatReport();
 
   // Clean up
   SealFreePrivateKey(); // if a private key was allocated
+  SealSignerFree(); // if --also-sign
   if (Args) { SealFree(Args); Args=NULL; }
   SealFree(CleanArgs); // free memory for completeness
   return(ReturnCode); // done processing
@@ -16,6 +16,8 @@
 #include "seal.hpp"
 #include "files.hpp"
 #include "sign.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 
 // For openssl 3.x
 #include <openssl/decoder.h>
@@ -62,6 +64,7 @@ sealfield *	SealDigest	(sealfield *Rec, mmapfile *Mmap)
   size_t *p; // start and end of the previous signature
   uint32_t seg[2]; // for tracking the segment (debugging)
   int state; // finite state machine
+  statscope Stat(StatDigest);
 
   // Should never happen
   if (!Rec || !Mmap) { return(Rec); }
@@ -284,7 +287,12 @@ sealfield *	SealDigest	(sealfield *Rec, mmapfile *Mmap)
 	{
 	Rec = SealAddI(Rec,"@digestrange",sum[0]);
 	Rec = SealAddI(Rec,"@digestrange",sum[1]);
+	{
+	uint64_t t = (TraceEnabled ? StatNow() : 0);
 	EVP_DigestUpdate(ctx64,Mmap->mem+sum[0],sum[1]-sum[0]);
+	Stat.Bytes += sum[1]-sum[0];
+	if (TraceEnabled) { TraceRange("digest range",t,sum[0],sum[1]); }
+	}
 	//DEBUGPRINT("Segment: seg=%d '%.*s', range: %u-%u (0x%x - 0x%x)",state,(int)(seg[1]-seg[0]),b+seg[0],(uint)sum[0],(uint)sum[1],(uint)sum[0],(uint)sum[1]);
 	}
       state=acc=sum[0]=sum[1]=0; Addsym=1;
@@ -306,7 +314,12 @@ sealfield *	SealDigest	(sealfield *Rec, mmapfile *Mmap)
 	{
 	Rec = SealAddI(Rec,"@digestrange",sum[0]);
 	Rec = SealAddI(Rec,"@digestrange",sum[1]);
+	{
+	uint64_t t = (TraceEnabled ? StatNow() : 0);
 	EVP_DigestUpdate(ctx64,Mmap->mem+sum[0],sum[1]-sum[0]);
+	Stat.Bytes += sum[1]-sum[0];
+	if (TraceEnabled) { TraceRange("digest range",t,sum[0],sum[1]); }
+	}
 	//DEBUGPRINT("Segment: seg=%d '%.*s', range: %u-%u (0x%x - 0x%x)",state,(int)(seg[1]-seg[0]),b+seg[0],(uint)sum[0],(uint)sum[1],(uint)sum[0],(uint)sum[1]);
 	}
     }
@@ -40,11 +40,15 @@
 #include <sys/time.h> // for timestamp
 #include <math.h> // for pow
 #include <fcntl.h>  // for access()
+#include <mutex>
+#include <thread>
+#include <atomic>
 
 #include "seal.hpp"
 #include "files.hpp"
 #include "seal-parse.hpp"
 #include "sign.hpp"
+#include "stats.hpp"
 
 // For openssl 3.x
 #include <openssl/decoder.h>
@@ -58,14 +62,66 @@
 // Include ed25519? (Disabled; doesn't work yet.)
 #define INC_ED25519 0
 
-EVP_PKEY *PrivateKey=NULL;
+EVP_PKEY *PrivateKey=NULL; // the current signer's key
+
+// Every loaded key, by keyfile (--also-sign can use many keys)
+typedef struct
+  {
+  char *Keyfile;
+  EVP_PKEY *Key;
+  } privatekey;
+static privatekey *PrivateKeys=NULL;
+static int PrivateKeysCount=0;
+
+/*****
+ A prepared signer, one per (keyfile, ka, da, sf).
+ The template context is initialized once (sign_init, RSA padding,
+ digest) and duplicated for each signature, so threads can share it.
+ *****/
+struct localsigner
+  {
+  struct localsigner *Next;
+  char *Keyfile, *Keyalg, *Da, *Sf; // what it was prepared for
+  EVP_PKEY *Key;
+  EVP_PKEY_CTX *Template;
+  int Enc; // signature encoding: 'b'=base64, 'r'=raw binary, 'h'=hex, 'H'=HEX
+  int DateFract; // date subsecond digits, or -1 if sf has no date
+  size_t SigLen; // raw signature size
+  size_t EncLen; // encoded signature size, including the date ('@sigsize')
+  };
+static localsigner *LocalSigners=NULL;
+static std::mutex LocalSignersLock;
 
 /********************************************************
- SealFreePrivateKey(): release the private key.
+ SealFreePrivateKey(): release every loaded private key
+ and prepared signer.
  ********************************************************/
 void	SealFreePrivateKey	()
 {
-  if (PrivateKey) { EVP_PKEY_free(PrivateKey); }
+  localsigner *Signer;
+  int i;
+
+  // Signers use the keys
+  while(LocalSigners)
+    {
+    Signer = LocalSigners;
+    LocalSigners = Signer->Next;
+    EVP_PKEY_CTX_free(Signer->Template);
+    free(Signer->Keyfile);
+    free(Signer->Keyalg);
+    free(Signer->Da);
+    free(Signer->Sf);
+    free(Signer);
+    }
+
+  for(i=0; i < PrivateKeysCount; i++)
+    {
+    EVP_PKEY_free(PrivateKeys[i].Key);
+    free(PrivateKeys[i].Keyfile);
+    }
+  if (PrivateKeys) { free(PrivateKeys); }
+  PrivateKeys=NULL;
+  PrivateKeysCount=0;
   PrivateKey=NULL;
 } /* SealFreePrivateKey() */
 
@@ -87,6 +143,8 @@ bool    SealIsLocal       (sealfield *Args)
  Depends on OpenSSL 3.x.
  Returns: keypair or exits
  Stores keypair in global!
+ Each keyfile is only loaded (and password prompted) once;
+ after that, this only looks up the key and is thread-safe.
  Caller must call SealFreePrivateKey()!
  **************************************/
 EVP_PKEY *	SealLoadPrivateKey	(sealfield *Args)
@@ -94,9 +152,7 @@ EVP_PKEY *	SealLoadPrivateKey	(sealfield *Args)
   FILE *fp;
   OSSL_DECODER_CTX *decoder=NULL;
   char *keyfile, *keyalg;
-
-  // Only load it once
-  if (PrivateKey) { SealFreePrivateKey(); }
+  int i;
 
   keyfile = SealGetText(Args,"keyfile");
   if (!keyfile)
@@ -105,6 +161,13 @@ EVP_PKEY *	SealLoadPrivateKey	(sealfield *Args)
     exit(0x80);
     }
 
+  // Only load it once
+  for(i=0; i < PrivateKeysCount; i++)
+    {
+    if (!strcmp(PrivateKeys[i].Keyfile,keyfile)) { return(PrivateKeys[i].Key); }
+    }
+  PrivateKey=NULL;
+
   keyalg = SealGetText(Args,"ka");
   if (keyalg && !strcmp(keyalg,"rsa"))
     {
@@ -178,81 +241,93 @@ EVP_PKEY *	SealLoadPrivateKey	(sealfield *Args)
 
   // If it got here, then it worked.
   OSSL_DECODER_CTX_free(decoder);
+  PrivateKeys = (privatekey*)realloc(PrivateKeys,(PrivateKeysCount+1)*sizeof(privatekey));
+  if (!PrivateKeys) // should never happen
+    {
+    fprintf(stderr," ERROR: Unable to allocate the private key list.\n");
+    exit(0x80);
+    }
+  PrivateKeys[PrivateKeysCount].Keyfile = strdup(keyfile);
+  PrivateKeys[PrivateKeysCount].Key = PrivateKey;
+  PrivateKeysCount++;
   return(PrivateKey);
 } /* SealLoadPrivateKey() */
 
+#pragma GCC visibility push(hidden)
 /**************************************
- SealSignLocal(): Sign data using the private key!
- If there is no @digest1, then set the signature size (@sigsize).
- If there is @digest1, then set the signature (@signature).
+ _SignDate(): Format the current time for sf=date.
+ Fract is the number of subsecond digits.
+ datestr must hold at least 30 bytes.
  **************************************/
-sealfield *	SealSignLocal	(sealfield *Args)
+void	_SignDate	(char *datestr, int fract)
 {
-  EVP_PKEY_CTX *ctx;
-  const EVP_MD* (*mdf)(void);
-  char *digestalg=NULL;
-  char *sf; // signing format (date, hex, whatever)
-  char *keyalg; // rsa or ec
-  char datestr[30], *s;
-  int datestrlen=0;
-  size_t siglen=0; // raw signature length
-  size_t enclen=0; // encoded signature length
+  struct timeval tv;
+  struct tm tmbuf, *tmp; // time pointer
   int i;
 
-  // Keys must be loaded.
-  if (!PrivateKey) { SealLoadPrivateKey(Args); }
-
-  // Set the date string
+  // Get and generate the date
   memset(datestr,0,30);
-  sf = SealGetText(Args,"sf"); // SEAL's 'sf' parameter; signing format (date, hex, whatever)
-  if (!strncmp(sf,"date",4)) // if there's a date, compute it!
+  gettimeofday(&tv,NULL);
+  tmp = gmtime_r(&tv.tv_sec,&tmbuf);
+  snprintf(datestr,30,"%04u%02u%02u%02u%02u%02u",
+    (tmp->tm_year+1900) % 10000,
+    (tmp->tm_mon+1) % 100,
+    (tmp->tm_mday) % 100,
+    (tmp->tm_hour) % 100,
+    (tmp->tm_min) % 100,
+    (tmp->tm_sec) % 100);
+  if ((fract > 0) && (fract < 6))
     {
-    struct timeval tv;
-    struct tm *tmp; // time pointer
-
-    // How many fraction decimal places?
-    int fract=0;
-    s=sf+4;
-    if (isdigit(s[0]))
+    snprintf(datestr+14,fract+2,".%0*d",
+      fract, (int)(tv.tv_usec / powf(10,6-fract)));
+    }
+  else if (fract >= 6)
+    {
+    snprintf(datestr+14,fract+2,".%06ld",tv.tv_usec);
+    // I only have 6 decimal points! Pad with zeros!
+    for(i=7; i <= fract; i++)
       {
-      fract=s[0]-'0';
-      s++;
+      datestr[14+i]='0';
       }
+    }
+} /* _SignDate() */
+#pragma GCC visibility pop
 
-    // Get and generate the date
-    gettimeofday(&tv,NULL);
-    tmp = gmtime(&tv.tv_sec);
-    snprintf(datestr,30,"%04u%02u%02u%02u%02u%02u",
-      (tmp->tm_year+1900) % 10000,
-      (tmp->tm_mon+1) % 100,
-      (tmp->tm_mday) % 100,
-      (tmp->tm_hour) % 100,
-      (tmp->tm_min) % 100,
-      (tmp->tm_sec) % 100);
-    if ((fract > 0) && (fract < 6))
-      {
-      snprintf(datestr+14,fract+2,".%0*d",
-        fract, (int)(tv.tv_usec / powf(10,6-fract)));
-      }
-    else if (fract >= 6)
-      {
-      snprintf(datestr+14,fract+2,".%06ld",tv.tv_usec);
-      // I only have 6 decimal points! Pad with zeros!
-      for(i=7; i < fract; i++)
-        {
-	datestr[14+i]='0';
-	}
-      }
-    datestrlen = strlen(datestr);
-    Args = SealSetText(Args,"@sigdate",datestr);
-    } // set datestr
+/**************************************
+ SealLocalSigner(): Get the prepared signer for Args.
+ Prepared once per (keyfile, ka, da, sf); later calls (from
+ any thread) return the same signer.
+ Returns: signer or exits.
+ **************************************/
+localsigner *	SealLocalSigner	(sealfield *Args)
+{
+  std::lock_guard<std::mutex> L(LocalSignersLock);
+  localsigner *Signer;
+  const EVP_MD* (*mdf)(void);
+  char *keyfile, *keyalg, *digestalg, *sf;
+  EVP_PKEY_CTX *ctx;
 
-  // Apply double digest (date:userid:) as needed
-  // SealDoubleDigest uses @sigdate, so must be done AFTER date!
-  Args = SealDoubleDigest(Args);
+  keyfile = SealGetText(Args,"keyfile");
+  keyalg = SealGetText(Args,"ka");
+  digestalg = SealGetText(Args,"da"); // SEAL's 'da' parameter
+  sf = SealGetText(Args,"sf"); // SEAL's 'sf' parameter; signing format (date, hex, whatever)
+  if (!keyfile || !keyalg || !digestalg || !sf)
+    {
+    fprintf(stderr," ERROR: Signing needs keyfile, ka, da, and sf.\n");
+    exit(0x80);
+    }
+
+  // Already prepared?
+  for(Signer=LocalSigners; Signer; Signer=Signer->Next)
+    {
+    if (!strcmp(Signer->Keyfile,keyfile) && !strcmp(Signer->Keyalg,keyalg) &&
+	!strcmp(Signer->Da,digestalg) && !strcmp(Signer->Sf,sf))
+	{
+	return(Signer);
+	}
+    }
 
   // Set the digest algorithm
-  digestalg = SealGetText(Args,"da"); // SEAL's 'da' parameter
   if (!strcmp(digestalg,"sha224")) { mdf = EVP_sha224; }
   else if (!strcmp(digestalg,"sha256")) { mdf = EVP_sha256; } // default
   else if (!strcmp(digestalg,"sha384")) { mdf = EVP_sha384; }
@@ -264,7 +339,6 @@ sealfield *	SealSignLocal	(sealfield *Args)
     }
 
   // Set the encryption algorithm
-  keyalg = SealGetText(Args,"ka");
   if (!strcmp(keyalg,"rsa")) { ; }
 #if INC_ED25519
   else if (!strcmp(keyalg,"ed25519")) { ; }
@@ -276,8 +350,22 @@ sealfield *	SealSignLocal	(sealfield *Args)
     exit(0x80);
     }
 
+  Signer = (localsigner*)calloc(1,sizeof(localsigner));
+  if (!Signer) // should never happen
+    {
+    fprintf(stderr," ERROR: Unable to allocate the signer.\n");
+    exit(0x80);
+    }
+  Signer->Keyfile = strdup(keyfile);
+  Signer->Keyalg = strdup(keyalg);
+  Signer->Da = strdup(digestalg);
+  Signer->Sf = strdup(sf);
+
+  // Keys must be loaded.
+  Signer->Key = SealLoadPrivateKey(Args);
+
   // Allocated the context handle
-  ctx = EVP_PKEY_CTX_new_from_pkey(NULL, PrivateKey, NULL);
+  ctx = EVP_PKEY_CTX_new_from_pkey(NULL, Signer->Key, NULL);
   if (!ctx)
 	{
 	fprintf(stderr," ERROR: Unable to initialize the sign context.\n");
@@ -285,7 +373,7 @@ sealfield *	SealSignLocal	(sealfield *Args)
 	}
 
   // Initialize context handle
-   if (EVP_PKEY_sign_init(ctx) <= 0) // everyone else
+  if (EVP_PKEY_sign_init(ctx) <= 0) // everyone else
 	{
 	fprintf(stderr," ERROR: Initializing the sign context failed.\n");
 	exit(0x80);
@@ -301,88 +389,177 @@ sealfield *	SealSignLocal	(sealfield *Args)
 	exit(0x80);
 	}
     }
+  Signer->Template = ctx;
 
   // Find the key size
-  siglen = EVP_PKEY_size(PrivateKey);
+  Signer->SigLen = EVP_PKEY_size(Signer->Key);
   //EVP_PKEY_sign(ctx, NULL, &siglen, NULL, 0); // get size; does not work with ed25519
 
-  /*****
-   Convert it to the output format.
-   Binary signature is stored in sig!
-   *****/
-  enclen=0;
+  // Size of the encoded signature
   if (strstr(sf,"base64"))
     {
     // base64 is a 4/3 expansion with padding to a multiple of 4
-    enclen = ((siglen+2)/3) * 4;
+    Signer->Enc = 'b';
+    Signer->EncLen = ((Signer->SigLen+2)/3) * 4;
     }
-  else if (strstr(sf,"bin")) { enclen = siglen; } // bad choice
-  else if (strstr(sf,"hex")) { enclen = siglen*2; }
-  else if (strstr(sf,"HEX")) { enclen = siglen*2; }
+  else if (strstr(sf,"bin")) { Signer->Enc = 'r'; Signer->EncLen = Signer->SigLen; } // bad choice
+  else if (strstr(sf,"hex")) { Signer->Enc = 'h'; Signer->EncLen = Signer->SigLen*2; }
+  else if (strstr(sf,"HEX")) { Signer->Enc = 'H'; Signer->EncLen = Signer->SigLen*2; }
   else
     {
     fprintf(stderr," ERROR: Unknown signature format (%s).\n",sf);
     exit(0x80);
     }
-  if (datestrlen) { enclen += datestrlen+1; } // "date:"
-  Args = SealSetU32index(Args,"@sigsize",0,enclen);
 
-  /***** Signing! *****/
-  if (SealSearch(Args,"@digest1")) // if digest exists, then do signing!
+  // Date: "YYYYMMDDhhmmss[.fraction]:"
+  Signer->DateFract = -1;
+  if (!strncmp(sf,"date",4))
     {
-    sealfield *DigestBin;
-    sealfield *Sign;
-
-    Args = SealAlloc(Args,"@signaturebin",siglen,'x');
-    Sign = SealSearch(Args,"@signaturebin");
-    DigestBin = SealSearch(Args,"@digest2");
-    if (!DigestBin) { DigestBin = SealSearch(Args,"@digest1"); }
-    if (EVP_PKEY_sign(ctx, Sign->Value, &siglen, DigestBin->Value, DigestBin->ValueLen) != 1)
-      {
-      fprintf(stderr," ERROR: Failed to sign.\n");
-      exit(0x80);
-      }
+    Signer->DateFract = isdigit(sf[4]) ? sf[4]-'0' : 0;
+    Signer->EncLen += 14 + (Signer->DateFract ? 1+Signer->DateFract : 0) + 1;
+    }
 
-    // Check for padding
-    Sign->ValueLen = siglen; // size may be smaller
+  Signer->Next = LocalSigners;
+  LocalSigners = Signer;
+  return(Signer);
+} /* SealLocalSigner() */
 
-    // Encode the signature
-    Args = SealCopy(Args,"@enc","@signaturebin");
-    if (strstr(sf,"base64")) { SealBase64Encode(SealSearch(Args,"@enc")); }
-    else if (strstr(sf,"hex")) { SealHexEncode(SealSearch(Args,"@enc"),false); }
-    else if (strstr(sf,"HEX")) { SealHexEncode(SealSearch(Args,"@enc"),true); }
-    // else if (strstr(sf,"bin")) { ; } /* Already handled */
+/**************************************
+ SealSignWith(): Sign using a prepared signer.
+ Always sets the signature size (@sigsize).
+ If there is @digest1, then set the signature (@signatureenc).
+ If there is '@sigdatefixed', then it is the signing date.
+ Thread-safe: each call uses its own copy of the context.
+ **************************************/
+sealfield *	SealSignWith	(localsigner *Signer, sealfield *Args)
+{
+  EVP_PKEY_CTX *ctx;
+  sealfield *DigestBin;
+  sealfield *Sign;
+  char datestr[30];
+  int datestrlen=0;
+  size_t siglen, i;
+  statscope Stat(StatSign);
 
-    // Set the date as needed
-    if (datestrlen)
-      {
-      sealfield *enc;
-      enc = SealSearch(Args,"@enc");
-      Args = SealSetText(Args,"@signatureenc",datestr);
-      Args = SealAddC(Args,"@signatureenc",':');
-      Args = SealAddBin(Args,"@signatureenc",enc->ValueLen,enc->Value);
-      Args = SealDel(Args,"@enc");
-      }
-    else
-      {
-      Args = SealMove(Args,"@signatureenc","@enc");
-      }
+  Args = SealSetU32index(Args,"@sigsize",0,Signer->EncLen);
+  if (!SealSearch(Args,"@digest1")) { return(Args); } // only sizing
 
-    // Add padding as needed
-    size_t i;
-    siglen = SealGetU32index(Args,"@sigsize",0);
-    Sign = SealSearch(Args,"@signatureenc");
-    for(i=Sign->ValueLen; i < siglen; i++)
+  // Set the date string
+  if (Signer->DateFract >= 0)
+    {
+    if (SealSearch(Args,"@sigdatefixed")) // date was given
       {
-      Args = SealAddC(Args,"@signatureenc",' ');
+      memset(datestr,0,30);
+      snprintf(datestr,30,"%s",SealGetText(Args,"@sigdatefixed"));
       }
+    else { _SignDate(datestr,Signer->DateFract); }
+    datestrlen = strlen(datestr);
+    Args = SealSetText(Args,"@sigdate",datestr);
     }
 
-  // Clean up
+  // Apply double digest (date:userid:) as needed
+  // SealDoubleDigest uses @sigdate, so must be done AFTER date!
+  Args = SealDoubleDigest(Args);
+
+  /***** Signing! *****/
+  ctx = EVP_PKEY_CTX_dup(Signer->Template);
+  if (!ctx)
+	{
+	fprintf(stderr," ERROR: Unable to copy the sign context.\n");
+	exit(0x80);
+	}
+
+  siglen = Signer->SigLen;
+  Args = SealAlloc(Args,"@signaturebin",siglen,'x');
+  Sign = SealSearch(Args,"@signaturebin");
+  DigestBin = SealSearch(Args,"@digest2");
+  if (!DigestBin) { DigestBin = SealSearch(Args,"@digest1"); }
+  if (EVP_PKEY_sign(ctx, Sign->Value, &siglen, DigestBin->Value, DigestBin->ValueLen) != 1)
+    {
+    fprintf(stderr," ERROR: Failed to sign.\n");
+    exit(0x80);
+    }
   EVP_PKEY_CTX_free(ctx);
+
+  // Check for padding
+  Sign->ValueLen = siglen; // size may be smaller
+
+  // Encode the signature
+  Args = SealCopy(Args,"@enc","@signaturebin");
+  switch(Signer->Enc)
+    {
+    case 'b': SealBase64Encode(SealSearch(Args,"@enc")); break;
+    case 'h': SealHexEncode(SealSearch(Args,"@enc"),false); break;
+    case 'H': SealHexEncode(SealSearch(Args,"@enc"),true); break;
+    default: break; // 'r' is already handled
+    }
+
+  // Set the date as needed
+  if (datestrlen)
+    {
+    sealfield *enc;
+    enc = SealSearch(Args,"@enc");
+    Args = SealSetText(Args,"@signatureenc",datestr);
+    Args = SealAddC(Args,"@signatureenc",':');
+    Args = SealAddBin(Args,"@signatureenc",enc->ValueLen,enc->Value);
+    Args = SealDel(Args,"@enc");
+    }
+  else
+    {
+    Args = SealMove(Args,"@signatureenc","@enc");
+    }
+
+  // Add padding as needed
+  Sign = SealSearch(Args,"@signatureenc");
+  for(i=Sign->ValueLen; i < Signer->EncLen; i++)
+    {
+    Args = SealAddC(Args,"@signatureenc",' ');
+    }
+
   return(Args);
+} /* SealSignWith() */
+
+/**************************************
+ SealSignLocal(): Sign data using the private key!
+ If there is no @digest1, then set the signature size (@sigsize).
+ If there is @digest1, then set the signature (@signatureenc).
+ **************************************/
+sealfield *	SealSignLocal	(sealfield *Args)
+{
+  return(SealSignWith(SealLocalSigner(Args),Args));
 } /* SealSignLocal() */
 
+/**************************************
+ SealSignBulk(): Sign many records with one signer.
+ Each Recs[i] needs '@digest1' (and may set 'id' or '@sigdatefixed').
+ Recs[i] is replaced with the signed record ('@signatureenc').
+ Jobs is the number of threads to use, including this one.
+ For batch, daemon, and manual stream signing.
+ **************************************/
+void	SealSignBulk	(localsigner *Signer, size_t Count, sealfield **Recs, int Jobs)
+{
+  std::atomic<size_t> Next(0);
+  std::thread *Workers;
+  int w;
+  auto Work = [&]()
+    {
+    size_t i;
+    while((i = Next++) < Count) { Recs[i] = SealSignWith(Signer,Recs[i]); }
+    };
+
+  if ((size_t)Jobs > Count) { Jobs = Count; }
+  if (Jobs <= 1) { Work(); return; }
+
+  Workers = new std::thread[Jobs-1]; // this thread also signs
+  for(w=0; w < Jobs-1; w++)
+    {
+    Workers[w] = std::thread([&]{ StatThreadIgnore(); Work(); });
+    }
+  Work();
+  for(w=0; w < Jobs-1; w++) { Workers[w].join(); }
+  delete[] Workers;
+} /* SealSignBulk() */
+
 /**************************************
  PrintDNSstring(): Print a string for DNS.
  This includes smart quoting.
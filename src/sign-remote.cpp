@@ -16,6 +16,8 @@
 #include "seal.hpp"
 #include "seal-parse.hpp"
 #include "sign.hpp"
+#include "stats.hpp"
+#include "metrics.hpp"
 #include "json.hpp"
 
 /********************************************************
@@ -59,6 +61,7 @@ sealfield *	SealSignURL	(sealfield *Args)
   CURL *ch; // curl handle
   CURLcode crc; // curl return code
   char errbuf[CURL_ERROR_SIZE];
+  statscope Stat(StatSign);
 
   // Make sure there's a known API URL!
   if (!SealIsURL(Args)) // Caller should make sure this never happens
@@ -175,7 +178,12 @@ sealfield *	SealSignURL	(sealfield *Args)
   curl_easy_setopt(ch, CURLOPT_POSTFIELDS, Str);
 
   // Do the request!
+  {
+  metricgauge InFlight(MetricRemoteInFlight);
+  uint64_t t = StatNow();
   crc = curl_easy_perform(ch);
+  MetricRemote(StatNow()-t,crc==CURLE_OK);
+  }
   curl_easy_cleanup(ch);
 
   // Clean up
@@ -9,6 +9,8 @@
 #include "seal.hpp"
 #include "files.hpp"
 #include "sign.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 
 /**************************************
  SealInsert(): Add a signature block into the file.
@@ -17,6 +19,8 @@
    '@BLOCK' contains ready-to-go block containing SEAL record.
    '@s' is relative to '@BLOCK'.
    InsertOffset = where to insert.
+   If '@InMemory' exists, the output is built in that field
+   instead of the file (for --also-sign).
  Returns:  NULL on error, or:
    Updates '@s' to be relative to the file.
    Signature inserted.
@@ -29,6 +33,7 @@ mmapfile *	SealInsert	(sealfield *Rec, mmapfile *MmapIn, size_t InsertOffset)
   sealfield *block;
   mmapfile *MmapOut;
   size_t *v;
+  statscope Stat(StatWrite);
 
   fname = SealGetText(Rec,"@FilenameOut");
   if (!fname || !fname[0]) { return(NULL); } // not signing
@@ -44,6 +49,32 @@ mmapfile *	SealInsert	(sealfield *Rec, mmapfile *MmapIn, size_t InsertOffset)
 	return(NULL);
 	}
 
+  // Build in memory? (Another signer will add a record after this one.)
+  if (SealSearch(Rec,"@InMemory"))
+    {
+    sealfield *mem;
+    size_t MemSize;
+    MemSize = ((InsertOffset > MmapIn->memsize) ? InsertOffset : MmapIn->memsize) + block->ValueLen;
+    Rec = SealAlloc(Rec,"@InMemory",MemSize,'x'); // exists, so replaced in place; cleared
+    mem = SealSearch(Rec,"@InMemory");
+    if (InsertOffset > MmapIn->memsize) // padding is already zeros
+      {
+      memcpy(mem->Value, MmapIn->mem, MmapIn->memsize);
+      memcpy(mem->Value + InsertOffset, block->Value, block->ValueLen);
+      }
+    else
+      {
+      memcpy(mem->Value, MmapIn->mem, InsertOffset);
+      memcpy(mem->Value + InsertOffset, block->Value, block->ValueLen);
+      memcpy(mem->Value + InsertOffset + block->ValueLen, MmapIn->mem + InsertOffset, MmapIn->memsize - InsertOffset);
+      }
+    v = SealGetIarray(Rec,"@s");
+    v[0] += InsertOffset;
+    v[1] += InsertOffset;
+    Stat.Bytes = MemSize;
+    return(MmapMem(mem->Value,MemSize));
+    }
+
   // Open file for writing!
   Fout = SealFileOpen(fname,"w+b"); // returns handle or aborts
   if (!Fout)
@@ -59,28 +90,32 @@ mmapfile *	SealInsert	(sealfield *Rec, mmapfile *MmapIn, size_t InsertOffset)
     size_t i;
     SealFileWrite(Fout, MmapIn->memsize, MmapIn->mem);
     for(i=MmapIn->memsize; i < InsertOffset; i++) { fputc('\0',Fout); }
+    // Append signature block
+    SealFileWrite(Fout, block->ValueLen, block->Value);
     }
   else
     {
-    SealFileWrite(Fout, InsertOffset, MmapIn->mem);
+    // Write before, block, and after with one vectored write
+    struct iovec Iov[3];
+    Iov[0].iov_base = MmapIn->mem;
+    Iov[0].iov_len = InsertOffset;
+    Iov[1].iov_base = block->Value;
+    Iov[1].iov_len = block->ValueLen;
+    Iov[2].iov_base = MmapIn->mem + InsertOffset;
+    Iov[2].iov_len = MmapIn->memsize - InsertOffset;
+    SealFileWritev(Fout, 3, Iov);
     }
 
-  // Append signature block and update offsets
-  SealFileWrite(Fout, block->ValueLen, block->Value);
+  // Update offsets
   v = SealGetIarray(Rec,"@s");
   v[0] += InsertOffset;
   v[1] += InsertOffset;
 
-  // Store everything else
-  if (InsertOffset < MmapIn->memsize)
-    {
-    SealFileWrite(Fout, MmapIn->memsize - InsertOffset, MmapIn->mem + InsertOffset);
-    }
-
   SealFileClose(Fout);
 
   // Prepare mmap
   MmapOut = MmapFile(fname,PROT_WRITE);
+  if (MmapOut) { Stat.Bytes = MmapOut->memsize; }
   return(MmapOut);
 } /* SealInsert() */
 
@@ -97,8 +132,9 @@ mmapfile *	SealInsert	(sealfield *Rec, mmapfile *MmapIn, size_t InsertOffset)
 bool	SealSign	(sealfield *Rec, mmapfile *MmapOut)
 {
   const char *fname;
-  sealfield *sig, *sigparm;
+  sealfield *sig, *sigparm, *Msg;
   size_t *s, *p;
+  char Num[24];
 
   if (!MmapOut) { return(false); } // not signing
   fname = SealGetText(Rec,"@FilenameOut");
@@ -112,6 +148,7 @@ bool	SealSign	(sealfield *Rec, mmapfile *MmapOut)
 	}
 
   // Compute new digest
+  TraceSetRecord(SealGetIindex(Rec,"@s",2)+1);
   sigparm = SealClone(Rec);
   sigparm = SealDigest(sigparm,MmapOut);
 
@@ -143,8 +180,18 @@ bool	SealSign	(sealfield *Rec, mmapfile *MmapOut)
   p[1] = s[1];
   p[2] = s[2];
   Rec = SealIncIindex(Rec,"@s",2,1); // increase number of signatures
-
-  printf(" Signature record #%ld added: %s\n",(long)SealGetIindex(Rec,"@s",2),fname);
+  sigparm = SealStateSave(Rec,sigparm); // if saving --append-state
+
+  // Report the record.
+  // In memory, the file does not exist yet. The report waits in
+  // '@signedlog' and is shown by the pass that writes the file.
+  snprintf(Num,sizeof(Num),"%ld",(long)SealGetIindex(Rec,"@s",2));
+  Msg = SealSetText(NULL,"msg",SealGetText(Rec,"@signedlog"));
+  Msg = SealAddText(Msg,"msg"," Signature record #");
+  Msg = SealAddText(Msg,"msg",Num);
+  Msg = SealAddText(Msg,"msg"," added: ");
+  Msg = SealAddText(Msg,"msg",fname);
+  Msg = SealAddText(Msg,"msg","\n");
   if (Verbose) // if showing digest
     {
     sealfield *d;
@@ -152,18 +199,24 @@ bool	SealSign	(sealfield *Rec, mmapfile *MmapOut)
     d = SealSearch(sigparm,"@digest1");
     if (d) // should always exist!
 	{
-	printf("  Digest: ");
-	for(i=0; i < d->ValueLen; i++) { printf("%02x",d->Value[i]); }
-	printf("\n");
+	Msg = SealAddText(Msg,"msg","  Digest: ");
+	for(i=0; i < d->ValueLen; i++) { snprintf(Num,sizeof(Num),"%02x",d->Value[i]); Msg = SealAddText(Msg,"msg",Num); }
+	Msg = SealAddText(Msg,"msg","\n");
 	}
     d = SealSearch(sigparm,"@digest2");
     if (d) // may exist!
 	{
-	printf("  Double Digest: ");
-	for(i=0; i < d->ValueLen; i++) { printf("%02x",d->Value[i]); }
-	printf("\n");
+	Msg = SealAddText(Msg,"msg","  Double Digest: ");
+	for(i=0; i < d->ValueLen; i++) { snprintf(Num,sizeof(Num),"%02x",d->Value[i]); Msg = SealAddText(Msg,"msg",Num); }
+	Msg = SealAddText(Msg,"msg","\n");
 	}
     }
+  if (SealSearch(Rec,"@InMemory") && SealSearch(Rec,"@signedlog"))
+    {
+    Rec = SealSetText(Rec,"@signedlog",SealGetText(Msg,"msg")); // exists, so replaced in place
+    }
+  else { printf("%s",SealGetText(Msg,"msg")); }
+  SealFree(Msg);
 
   SealFree(sigparm);
   return(true);
@@ -0,0 +1,329 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Append state (--append-state): skip re-hashing signed data.
+
+ Re-signing a file that grew (logs, WORM archives, continued
+ recordings) verifies every existing record first. Each record's
+ digest covers its own range, so the old data is hashed again on
+ every run. Only the new P~S,s~f record is new work; its range
+ starts at the previous signature.
+
+ With --append-state, signing saves a sidecar next to the output:
+   outfile.sealstate
+ It holds the signed file's size, a fingerprint of those bytes,
+ and the digest of each record whose range does not depend on the
+ end of the file (e.g., b=F~S,s~s+3 from -O append):
+   # SEAL append state
+   size 1234567
+   fingerprint <sha256 hex>
+   record <signum> <s0> <s1> <b> <da> <sflags0> <sflags1> <digest hex>
+ The next signing run (with --append-state) loads infile.sealstate.
+ If the file is at least that size and the fingerprint matches,
+ those records reuse their saved digests; their signatures are
+ still checked. Only the appended bytes are hashed.
+
+ The fingerprint is a heuristic. Hashing every covered byte would
+ cost as much as re-verifying, so it samples them: the size, 64
+ spread 4K windows, and the last 64K (the newest records). It catches
+ truncation and rewrites, but not an edit between the samples; the
+ saved digests would still be trusted for it. It is for append-only
+ storage that you already trust; leave the option off to re-verify
+ everything.
+ The check fails closed: a missing header, size, or fingerprint, an
+ unknown line, a file shorter than the saved size, or a different
+ fingerprint discards the whole sidecar.
+
+ The same records pass digests between signers in one run
+ (--also-sign): each in-memory pass hands '@statelog' to the
+ next pass as its '@statecache'. No sidecar is written for them.
+ ************************************************/
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "seal.hpp"
+#include "files.hpp"
+#include "seal-parse.hpp"
+#include "sign.hpp"
+
+// For openssl 3.x
+#include <openssl/evp.h>
+
+#pragma GCC visibility push(hidden)
+
+#define STATEWINDOWS	64 // sampled windows
+#define STATEWINDOW	4096 // bytes per window
+#define STATETAIL	65536 // bytes before the end
+
+// The output's records, until the output is complete (per thread)
+static thread_local sealfield *StatePending=NULL;
+
+/**************************************
+ _StateFingerprint(): Fingerprint the first Size bytes.
+ Sets Hex (65 bytes) to the sha256 in hex.
+ **************************************/
+static void	_StateFingerprint	(mmapfile *Mmap, uint64_t Size, char *Hex)
+{
+  EVP_MD_CTX *ctx;
+  unsigned char md[EVP_MAX_MD_SIZE];
+  unsigned int mdsize=0, i;
+  byte Len[8];
+  uint64_t Start;
+
+  ctx = EVP_MD_CTX_new();
+  EVP_DigestInit(ctx, EVP_sha256());
+  writebe64(Len,Size);
+  EVP_DigestUpdate(ctx,Len,8);
+  for(i=0; i < STATEWINDOWS; i++)
+    {
+    Start = (Size / STATEWINDOWS) * i;
+    EVP_DigestUpdate(ctx,Mmap->mem+Start,Min((uint64_t)STATEWINDOW,Size-Start));
+    }
+  Start = (Size > STATETAIL) ? Size-STATETAIL : 0;
+  EVP_DigestUpdate(ctx,Mmap->mem+Start,Size-Start);
+  EVP_DigestFinal(ctx,md,&mdsize);
+  EVP_MD_CTX_free(ctx);
+  for(i=0; i < mdsize; i++) { sprintf(Hex+i*2,"%02x",md[i]); }
+  Hex[mdsize*2]='\0';
+} /* _StateFingerprint() */
+
+/**************************************
+ _StateKey(): The lookup key for a record.
+ "\nrecord signum s0 s1 b da "
+ **************************************/
+static sealfield *	_StateKey	(sealfield *Rec, const char *Field)
+{
+  char Num[80];
+  snprintf(Num,sizeof(Num),"\nrecord %ld %ld %ld ",
+    (long)SealGetIindex(Rec,"@s",2),(long)SealGetIindex(Rec,"@s",0),(long)SealGetIindex(Rec,"@s",1));
+  Rec = SealSetText(Rec,Field,Num);
+  Rec = SealAddText(Rec,Field,SealGetText(Rec,"b"));
+  Rec = SealAddC(Rec,Field,' ');
+  Rec = SealAddText(Rec,Field,SealGetText(Rec,"da"));
+  Rec = SealAddC(Rec,Field,' ');
+  return(Rec);
+} /* _StateKey() */
+
+#pragma GCC visibility pop
+
+/**************************************
+ SealStateLoad(): Load Filename's append state, if it matches.
+ Sets '@statecache' with the saved records.
+ **************************************/
+sealfield *	SealStateLoad	(sealfield *Args, const char *Filename, mmapfile *Mmap)
+{
+  FILE *fp;
+  char Line[1024], Hex[80], *End;
+  char *Sidecar;
+  unsigned long long Size=0;
+  bool Valid=false, Bad=false;
+  int Lines=0, Records=0;
+
+  if (!SealSearch(Args,"append-state")) { return(Args); }
+
+  Sidecar = (char*)calloc(strlen(Filename)+12,1);
+  sprintf(Sidecar,"%s.sealstate",Filename);
+  fp = fopen(Sidecar,"rb");
+  if (!fp) { free(Sidecar); return(Args); } // nothing saved
+
+  Args = SealSetText(Args,"@statecache","");
+  // Expect: header, size, fingerprint, then records
+  while(!Bad && fgets(Line,sizeof(Line),fp))
+    {
+    Line[strcspn(Line,"\r\n")]='\0';
+    Lines++;
+    if (Lines==1) { Bad = strcmp(Line,"# SEAL append state"); }
+    else if (Lines==2)
+      {
+      Bad = strncmp(Line,"size ",5) || !isdigit(Line[5]);
+      if (!Bad) { Size = strtoull(Line+5,&End,10); Bad = (*End != '\0') || !Size; }
+      }
+    else if (Lines==3)
+      {
+      Bad = strncmp(Line,"fingerprint ",12);
+      if (!Bad && (Size <= Mmap->memsize))
+	{
+	_StateFingerprint(Mmap,Size,Hex);
+	Valid = !strcmp(Line+12,Hex);
+	}
+      }
+    else if (!strncmp(Line,"record ",7))
+      {
+      Args = SealAddC(Args,"@statecache",'\n');
+      Args = SealAddText(Args,"@statecache",Line);
+      Records++;
+      }
+    else { Bad=true; }
+    }
+  fclose(fp);
+  if (Lines < 3) { Bad=true; }
+
+  if (Bad)
+    {
+    fprintf(stderr," WARNING: Append state (%s) is malformed; verifying every record.\n",Sidecar);
+    Args = SealDel(Args,"@statecache");
+    }
+  else if (!Valid)
+    {
+    fprintf(stderr," WARNING: Append state (%s) does not match the file; verifying every record.\n",Sidecar);
+    Args = SealDel(Args,"@statecache");
+    }
+  else
+    {
+    Args = SealAddC(Args,"@statecache",'\n');
+    if (Verbose) { printf(" Append state: %d saved digests for the first %llu bytes.\n",Records,Size); }
+    }
+  free(Sidecar);
+  return(Args);
+} /* SealStateLoad() */
+
+/**************************************
+ SealStateDigest(): Restore a record's saved digest.
+ Args has '@statecache'; Rec is the parsed record.
+ Sets '@digest1', '@sflags0', '@sflags1', and '@statedigest'.
+ With '@statetrust' (--also-sign passes after the first), also
+ sets '@statetrust' so SealVerify() skips the record: it was made
+ or reported earlier in this run.
+ **************************************/
+sealfield *	SealStateDigest	(sealfield *Rec, sealfield *Args)
+{
+  const char *Cache, *Found;
+  char Flags0[32], Flags1[32], Hex[2*64+2];
+
+  Cache = SealGetText(Args,"@statecache");
+  if (!Cache) { return(Rec); }
+  Rec = _StateKey(Rec,"@statekey");
+  Found = strstr(Cache,SealGetText(Rec,"@statekey"));
+  if (Found)
+    {
+    Found += SealGetSize(Rec,"@statekey");
+    if (sscanf(Found,"%31s %31s %129s",Flags0,Flags1,Hex) == 3)
+      {
+      Rec = SealSetText(Rec,"@digest1",Hex);
+      SealHexDecode(SealSearch(Rec,"@digest1"));
+      Rec = SealSetText(Rec,"@sflags0",strcmp(Flags0,"-") ? Flags0 : "");
+      Rec = SealSetText(Rec,"@sflags1",strcmp(Flags1,"-") ? Flags1 : "");
+      Rec = SealSetText(Rec,"@statedigest","1");
+      if (SealSearch(Args,"@statetrust")) { Rec = SealSetText(Rec,"@statetrust","1"); }
+      }
+    }
+  Rec = SealDel(Rec,"@statekey");
+  return(Rec);
+} /* SealStateDigest() */
+
+/**************************************
+ SealStateAdd(): Remember a verified record's digest.
+ Ranges that end at the end of the file ('f') are not saved;
+ they change when the file grows.
+ **************************************/
+sealfield *	SealStateAdd	(sealfield *Args, sealfield *Rec)
+{
+  sealfield *Digest;
+  const char *Flags;
+  uint i;
+
+  if (!SealSearch(Args,"append-state") && !SealSearch(Args,"@statelog")) { return(Args); }
+  Digest = SealSearch(Rec,"@digest1");
+  if (!Digest) { return(Args); } // digest failed
+  // Other errors (e.g., no public key) do not change the digest.
+  if (strchr(SealGetText(Rec,"@sflags0"),'f') || strchr(SealGetText(Rec,"@sflags1"),'f')) { return(Args); }
+
+  Rec = _StateKey(Rec,"@statekey");
+  if (!SealSearch(Args,"@statelog")) { Args = SealSetText(Args,"@statelog",""); }
+  Args = SealAddText(Args,"@statelog",SealGetText(Rec,"@statekey")+1); // skip "\n"
+  Flags = SealGetText(Rec,"@sflags0");
+  Args = SealAddText(Args,"@statelog",(Flags && Flags[0]) ? Flags : "-");
+  Args = SealAddC(Args,"@statelog",' ');
+  Flags = SealGetText(Rec,"@sflags1");
+  Args = SealAddText(Args,"@statelog",(Flags && Flags[0]) ? Flags : "-");
+  Args = SealAddC(Args,"@statelog",' ');
+  for(i=0; i < Digest->ValueLen; i++)
+    {
+    char Hex[3];
+    snprintf(Hex,3,"%02x",Digest->Value[i]);
+    Args = SealAddText(Args,"@statelog",Hex);
+    }
+  Args = SealAddC(Args,"@statelog",'\n');
+  Rec = SealDel(Rec,"@statekey");
+  return(Args);
+} /* SealStateAdd() */
+
+/**************************************
+ SealStateSave(): Remember the output's append state.
+ Sig is the new record (with '@digest1'), cloned from the
+ file's parameters, so it has the verified records ('@statelog').
+ Rec has the new signature's position and number ('@s').
+ When signing in memory ('@InMemory'), the records go back to
+ Rec's '@statelog' for the next signer instead.
+ Otherwise they wait for SealStateFinish(): formats may still
+ change the file after signing (e.g., the PNG CRC).
+ Returns: updated Sig.
+ **************************************/
+sealfield *	SealStateSave	(sealfield *Rec, sealfield *Sig)
+{
+  sealfield *Log;
+
+  if (SealSearch(Rec,"@InMemory") && SealSearch(Rec,"@statelog"))
+    {
+    Sig = SealCopy2(Sig,"@s",Rec,"@s");
+    Sig = SealStateAdd(Sig,Sig);
+    Log = SealSearch(Sig,"@statelog");
+    Rec = SealSetTextLen(Rec,"@statelog",Log->ValueLen,(char*)Log->Value); // exists, so replaced in place
+    return(Sig);
+    }
+
+  if (!SealSearch(Rec,"append-state")) { return(Sig); }
+  Sig = SealCopy2(Sig,"@s",Rec,"@s");
+  Sig = SealStateAdd(Sig,Sig);
+
+  // Replaces any earlier record for this output
+  SealFree(StatePending);
+  StatePending = SealSetText(NULL,"@FilenameOut",SealGetText(Rec,"@FilenameOut"));
+  StatePending = SealSetText(StatePending,"@statelog",SealGetText(Sig,"@statelog"));
+  return(Sig);
+} /* SealStateSave() */
+
+/**************************************
+ SealStateFinish(): Write the append state for the finished output.
+ Called after the output file is complete; does nothing if
+ SealStateSave() did not save anything.
+ **************************************/
+void	SealStateFinish	()
+{
+  const char *fname;
+  char *Sidecar, *Tmp;
+  char Hex[80];
+  FILE *Fout;
+  mmapfile *MmapOut;
+
+  if (!StatePending) { return; }
+  fname = SealGetText(StatePending,"@FilenameOut");
+  MmapOut = MmapFile(fname,PROT_READ);
+
+  Sidecar = (char*)calloc(strlen(fname)+12,1);
+  sprintf(Sidecar,"%s.sealstate",fname);
+  Tmp = (char*)calloc(strlen(fname)+16,1);
+  sprintf(Tmp,"%s.sealstate.tmp",fname);
+
+  _StateFingerprint(MmapOut,MmapOut->memsize,Hex);
+  Fout = SealFileOpen(Tmp,"wb");
+  fprintf(Fout,"# SEAL append state\n");
+  fprintf(Fout,"size %llu\n",(unsigned long long)MmapOut->memsize);
+  fprintf(Fout,"fingerprint %s\n",Hex);
+  fprintf(Fout,"%s",SealGetText(StatePending,"@statelog") ? SealGetText(StatePending,"@statelog") : "");
+  if (fclose(Fout) || rename(Tmp,Sidecar))
+	{
+	fprintf(stderr," ERROR: Cannot write append state (%s). Aborting.\n",Sidecar);
+	exit(0x80);
+	}
+  MmapFree(MmapOut);
+  free(Tmp);
+  free(Sidecar);
+  SealFree(StatePending);
+  StatePending=NULL;
+} /* SealStateFinish() */
@@ -27,31 +27,13 @@
 #include "seal.hpp"
 #include "seal-parse.hpp"
 #include "sign.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include "metrics.hpp"
 #include "files.hpp"
-
-#if defined(__linux__) && !defined(__GLIBC__)
-static inline int res_ninit(res_state statp)
-{
-	int rc = res_init();
-	if (statp != &_res) { memcpy(statp, &_res, sizeof(*statp)); }
-	return rc;
-}
-
-static inline int res_nclose(res_state statp)
-{
-	if (!statp) { return -1; }
-	if (statp != &_res) { memset(statp, 0, sizeof(*statp)); }
-	return 0;
-}
-
-static inline int res_nquery(res_state statp,
-	          const char *dname, int nclass, int type,
-	          unsigned char *answer, int anslen)
-{
-	if (!statp) { return -1; }
-	return(res_query(dname, nclass, type, answer, anslen));
-}
-#endif
+#include "dns.hpp"
+#include "keystore.hpp"
+#include "output.hpp"
 
 #pragma GCC visibility push(hidden)
 /********************************************************
@@ -242,6 +224,7 @@ sealfield *	SealGetDNSfile	(sealfield *Rec)
 sealfield *	SealGetDNS	(sealfield *Rec)
 {
   char *Domain;
+  statscope Stat(StatDNS);
   if (!Rec) { return(Rec); } // must be defined
   if (!SealSearch(Rec,"uid")) { Rec=SealSetText(Rec,"uid",""); } // default uid
   if (!SealSearch(Rec,"kv")) { Rec=SealSetText(Rec,"kv","1"); } // default key version
@@ -258,6 +241,7 @@ sealfield *	SealGetDNS	(sealfield *Rec)
   Rec = SealAddText(Rec,"@dnscache",SealGetText(Rec,"uid"));
   if (!SealCmp(Rec,"@dnscache","@dnscachelast"))
 	{
+	MetricAdd(MetricDNSCacheHits,1);
 	return(Rec);
 	}
 
@@ -282,24 +266,24 @@ sealfield *	SealGetDNS	(sealfield *Rec)
   int size;
   ns_msg nsMsg;
   ns_rr rr; // dns response record
-  struct __res_state dnsstate;
   int MsgMax, count, c;
 
   // Check for static file
   Reply = SealGetDNSfile(Rec);
-  if (Reply) { return(Reply); }
+  if (Reply) { MetricAdd(MetricDNSFile,1); return(Reply); }
 
-  // Do DNS
-  memset(&dnsstate, 0, sizeof(dnsstate));
-  if (res_ninit(&dnsstate) < 0)
-    {
-    // Should never happen
-    fprintf(stderr," ERROR: Unable to initialize DNS lookup. Aborting.\n");
-    exit(0x80);
-    }
+  // Check the key store
+  Reply = SealKeystoreGet(Rec);
+  if (Reply) { MetricAdd(MetricDNSKeystore,1); return(Reply); }
 
+  // Do DNS
   memset(&Buffer, 0, 16384);
-  MsgMax = res_nquery(&dnsstate, Domain, C_IN, T_TXT, Buffer, 16384-1);
+  {
+  metricgauge InFlight(MetricDNSInFlight);
+  MsgMax = SealDNSQuery(Domain, Buffer, 16384-1);
+  }
+  MetricAdd(MetricDNSLookups,1);
+  if (MsgMax <= 0) { MetricAdd(MetricDNSFailures,1); }
   if (MsgMax > 0) // found something!
     {
     /*****
@@ -438,7 +422,6 @@ sealfield *	SealGetDNS	(sealfield *Rec)
     } // if dns reply
 
 Done:
-  res_nclose(&dnsstate);
   if (Reply) { SealFree(Reply); }
   return(Rec);
 } /* SealGetDNS() */
@@ -651,6 +634,7 @@ sealfield *	SealValidateSig	(sealfield *Rec)
   char *keyalg, *digestalg;
   sealfield *sigbin, *digestbin, *pubkey;
   unsigned long e;
+  statscope Stat(StatVerify);
 
   /*****
    If you're calling this function, then we have:
@@ -809,6 +793,7 @@ sealfield *	SealVerify	(sealfield *Rec, mmapfile *Mmap)
 {
   char *ErrorMsg;
   long signum; // signature number
+  bool IsRevoked=false;
 
   if (!Rec) { return(Rec); }
 
@@ -823,6 +808,17 @@ sealfield *	SealVerify	(sealfield *Rec, mmapfile *Mmap)
     printf(" WARNING: Invalid SEAL record count (%ld).\n",signum);
     return(Rec);
     }
+  TraceSetRecord(signum);
+
+  // --also-sign: made or reported earlier in this run; only keep the flags
+  if (SealSearch(Rec,"@statetrust"))
+    {
+    Rec = SealSetText(Rec,"@sflags",SealGetText(Rec,"@sflags0"));
+    Rec = SealAddC(Rec,"@sflags",'~');
+    Rec = SealAddText(Rec,"@sflags",SealGetText(Rec,"@sflags1"));
+    Rec = SealAddC(Rec,"@sflags",'|');
+    return(Rec);
+    }
 
   /* Compute current digest */
   ErrorMsg = SealGetText(Rec,"@error");
@@ -861,7 +857,8 @@ sealfield *	SealVerify	(sealfield *Rec, mmapfile *Mmap)
   if (!ErrorMsg)
 	{
 	// @sigdate set by SealValidateDecodeParts
-	Rec = SealDigest(Rec,Mmap);
+	// (skipped if --append-state saved this record's digest)
+	if (!SealSearch(Rec,"@statedigest")) { Rec = SealDigest(Rec,Mmap); }
 
 	// Retain flags
 	Rec = SealSetText(Rec,"@sflags",SealGetText(Rec,"@sflags0"));
@@ -879,6 +876,7 @@ sealfield *	SealVerify	(sealfield *Rec, mmapfile *Mmap)
 	{
 	Rec = SealValidateRevoke(Rec);
 	ErrorMsg = SealGetText(Rec,"@error");
+	IsRevoked = (ErrorMsg != NULL);
 	}
 
   /* Check if the decoded digest matches the known digest. */
@@ -892,12 +890,14 @@ sealfield *	SealVerify	(sealfield *Rec, mmapfile *Mmap)
   if (ErrorMsg)
 	{
 	ReturnCode |= 0x01; // at least one file is invalid
-	_SealVerifyShow(Rec,signum,ErrorMsg);
+	MetricAdd(IsRevoked ? MetricSigRevoked : MetricSigInvalid,1);
 	}
   else
 	{
-	_SealVerifyShow(Rec,signum,NULL);
+	MetricAdd(MetricSigValid,1);
 	}
+  if (OutputJSON) { OutputRecord(Rec,signum,ErrorMsg,IsRevoked); }
+  else { _SealVerifyShow(Rec,signum,ErrorMsg); }
 
   return(Rec);
 } /* SealVerify() */
@@ -932,11 +932,14 @@ sealfield *	SealVerifyBlock	(sealfield *Args, size_t BlockStart, size_t BlockEnd
 
   while(BlockStart < BlockEnd) 
     {
+    TraceSetRecord(SealGetIindex(Args,"@s",2)+1); // the record, if one is found
     Rec = SealParse(BlockEnd-BlockStart, Mmap->mem+BlockStart, BlockStart, Args);
     if (!Rec) { return(Args); } // Nothing found
 
     // Found a signature!  Verify the data!
+    Rec = SealStateDigest(Rec,Args); // saved digest, if any
     Rec = SealVerify(Rec,Mmap);
+    Args = SealStateAdd(Args,Rec); // if saving the append state
 
     // Iterate on remainder
     RecEnd = SealGetIindex(Rec,"@RecEnd",0);
@@ -38,11 +38,22 @@ bool	SealSign	(sealfield *Rec, mmapfile *MmapOut);
 // Sign Local
 bool	SealIsLocal	(sealfield *Args);
 sealfield *	SealSignLocal	(sealfield *Args);
+typedef struct localsigner localsigner; // prepared key, context, and sizes
+localsigner *	SealLocalSigner	(sealfield *Args);
+sealfield *	SealSignWith	(localsigner *Signer, sealfield *Args);
+void	SealSignBulk	(localsigner *Signer, size_t Count, sealfield **Recs, int Jobs);
 
 // Sign Remote
 bool	SealIsURL	(sealfield *Args);
 sealfield *	SealSignURL	(sealfield *Args);
 
+// Append state (--append-state)
+sealfield *	SealStateLoad	(sealfield *Args, const char *Filename, mmapfile *Mmap);
+sealfield *	SealStateDigest	(sealfield *Rec, sealfield *Args);
+sealfield *	SealStateAdd	(sealfield *Args, sealfield *Rec);
+sealfield *	SealStateSave	(sealfield *Rec, sealfield *Sig);
+void	SealStateFinish	();
+
 // Verify
 sealfield *	SealGetDNS	(sealfield *Rec);
 sealfield *	SealVerify	(sealfield *Rec, mmapfile *Mmap);
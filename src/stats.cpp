@@ -0,0 +1,334 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Per-phase timing and resource statistics (--stats).
+
+ Each phase (mmap, detect, walk, parse, DNS, digest, verify, sign,
+ write) is timed with the monotonic clock. Phases nest: the walker
+ calls SealParse(), which may call SealGetDNS(), etc. Each phase
+ records exclusive time; nested time is charged to the inner phase.
+
+ Per file: phase times, byte counts, and page faults (getrusage).
+ With -v, each file's breakdown is shown after the file.
+ At the end: per-phase and per-format totals with p50/p90/p99
+ over the files, total page faults, and peak RSS.
+ With --trace, every phase and file also becomes a trace span.
+ With --metrics, every phase is also counted (see metrics.cpp).
+ ************************************************/
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h> // getrusage()
+
+#include "seal.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include "metrics.hpp"
+
+bool StatsEnabled=false;
+bool StatsShow=false;
+
+#pragma GCC visibility push(hidden)
+
+static const char *StatPhaseName[StatPhases] =
+  { "mmap", "detect", "walk", "parse", "dns", "digest", "verify", "sign", "write" };
+
+// Active phases (nested); each thread has its own
+#define STATSTACK 16
+static thread_local struct
+  {
+  int Phase;
+  uint64_t Start;
+  uint64_t Child; // time spent in nested phases
+  } StatStack[STATSTACK];
+static thread_local int StatDepth=0;
+static thread_local bool StatThreadOff=false; // helper threads are not timed
+
+// Run totals (including phases outside of any file)
+static uint64_t StatCalls[StatPhases];
+static uint64_t StatNs[StatPhases];
+static uint64_t StatBytes[StatPhases];
+
+// Per-file results
+typedef struct
+  {
+  const char *Format;
+  uint64_t Start, Ns;
+  uint64_t Calls[StatPhases];
+  uint64_t PhaseNs[StatPhases];
+  uint64_t Bytes[StatPhases];
+  long MinFlt, MajFlt;
+  } statfile;
+static statfile StatCur;
+static bool StatInFile=false;
+static statfile StatLast; // most recent file (for benchmarks)
+static bool StatHasLast=false;
+static statfile *StatFiles=NULL; // every file; only kept for --stats
+static size_t StatFilesLen=0, StatFilesMax=0;
+
+/**************************************
+ _StatMs(): Convert ns to ms for printing.
+ **************************************/
+static double	_StatMs	(uint64_t Ns)
+{
+  return((double)Ns / 1000000.0);
+} /* _StatMs() */
+
+/**************************************
+ _StatCmp(): For sorting times.
+ **************************************/
+static int	_StatCmp	(const void *a, const void *b)
+{
+  uint64_t A = *(const uint64_t*)a, B = *(const uint64_t*)b;
+  return( (A < B) ? -1 : (A > B) );
+} /* _StatCmp() */
+
+/**************************************
+ _StatPercentile(): Nearest-rank percentile of a sorted list.
+ **************************************/
+static uint64_t	_StatPercentile	(const uint64_t *Sorted, size_t Len, int Pct)
+{
+  if (!Len) { return(0); }
+  size_t Rank = (Len*Pct + 99) / 100; // ceil(Len*Pct/100)
+  if (Rank < 1) { Rank=1; }
+  return(Sorted[Rank-1]);
+} /* _StatPercentile() */
+
+/**************************************
+ _StatRow(): Print one report row.
+ Values holds one time per file; it is sorted in place.
+ **************************************/
+static void	_StatRow	(const char *Name, uint64_t Calls, uint64_t Ns, uint64_t Bytes,
+			 uint64_t *Values, size_t ValuesLen)
+{
+  qsort(Values,ValuesLen,sizeof(uint64_t),_StatCmp);
+  printf(" %-10s %8lu %11.3f %10.3f %10.3f %10.3f %14lu\n",
+	Name,(unsigned long)Calls,_StatMs(Ns),
+	_StatMs(_StatPercentile(Values,ValuesLen,50)),
+	_StatMs(_StatPercentile(Values,ValuesLen,90)),
+	_StatMs(_StatPercentile(Values,ValuesLen,99)),
+	(unsigned long)Bytes);
+} /* _StatRow() */
+
+#pragma GCC visibility pop
+
+/**************************************
+ StatNow(): Monotonic time in ns.
+ **************************************/
+uint64_t	StatNow	()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return((uint64_t)ts.tv_sec*1000000000ULL + (uint64_t)ts.tv_nsec);
+} /* StatNow() */
+
+/**************************************
+ StatName(): Name of a phase.
+ **************************************/
+const char *	StatName	(int Phase)
+{
+  if ((Phase < 0) || (Phase >= StatPhases)) { return("unknown"); }
+  return(StatPhaseName[Phase]);
+} /* StatName() */
+
+/**************************************
+ StatBegin(): Start timing a phase.
+ **************************************/
+void	StatBegin	(int Phase)
+{
+  if (StatThreadOff) { return; }
+  if (StatDepth < STATSTACK)
+    {
+    StatStack[StatDepth].Phase = Phase;
+    StatStack[StatDepth].Child = 0;
+    StatStack[StatDepth].Start = StatNow();
+    }
+  StatDepth++;
+} /* StatBegin() */
+
+/**************************************
+ StatEnd(): Stop timing the current phase.
+ Charges exclusive time to the phase and total time to the parent.
+ **************************************/
+void	StatEnd	(int Phase, uint64_t Bytes)
+{
+  uint64_t Elapsed, Self;
+
+  if (StatThreadOff) { return; }
+  if (StatDepth <= 0) { return; } // should never happen
+  StatDepth--;
+  if (StatDepth >= STATSTACK) { return; } // too deep; not tracked
+  Elapsed = StatNow() - StatStack[StatDepth].Start;
+  Self = Elapsed - Min(Elapsed,StatStack[StatDepth].Child);
+  if (StatDepth > 0) { StatStack[StatDepth-1].Child += Elapsed; }
+  if (TraceEnabled) { TraceSpan(StatPhaseName[Phase],StatStack[StatDepth].Start,Bytes); }
+  if (MetricsEnabled) { MetricPhase(Phase,Self,Bytes); }
+
+  StatCalls[Phase]++;
+  StatNs[Phase] += Self;
+  StatBytes[Phase] += Bytes;
+  if (StatInFile)
+    {
+    StatCur.Calls[Phase]++;
+    StatCur.PhaseNs[Phase] += Self;
+    StatCur.Bytes[Phase] += Bytes;
+    }
+} /* StatEnd() */
+
+/**************************************
+ StatThreadIgnore(): Do not time phases in this thread.
+ For background threads (e.g., DNS prefetch); the totals
+ and per-file results only describe the main thread.
+ **************************************/
+void	StatThreadIgnore	()
+{
+  StatThreadOff=true;
+} /* StatThreadIgnore() */
+
+/**************************************
+ StatFileBegin(): Start collecting for a new file.
+ Filename must remain allocated (for tracing).
+ **************************************/
+void	StatFileBegin	(const char *Filename)
+{
+  struct rusage ru;
+  if (!StatsEnabled) { return; }
+  TraceSetFile(Filename);
+  memset(&StatCur,0,sizeof(StatCur));
+  getrusage(RUSAGE_SELF,&ru);
+  StatCur.MinFlt = ru.ru_minflt;
+  StatCur.MajFlt = ru.ru_majflt;
+  StatCur.Start = StatNow();
+  StatInFile=true;
+} /* StatFileBegin() */
+
+/**************************************
+ StatFileEnd(): Finish collecting for a file.
+ Format is the file format's name.
+ With verbose, show the file's breakdown.
+ **************************************/
+void	StatFileEnd	(const char *Format)
+{
+  struct rusage ru;
+  int p;
+
+  if (!StatsEnabled || !StatInFile) { return; }
+  StatInFile=false;
+  StatCur.Ns = StatNow() - StatCur.Start;
+  StatCur.Format = Format;
+  getrusage(RUSAGE_SELF,&ru);
+  StatCur.MinFlt = ru.ru_minflt - StatCur.MinFlt;
+  StatCur.MajFlt = ru.ru_majflt - StatCur.MajFlt;
+  if (TraceEnabled)
+    {
+    TraceSetFormat(Format);
+    TraceSpan("file",StatCur.Start,StatCur.Bytes[StatMmap]);
+    }
+
+  if (StatsShow && Verbose)
+    {
+    printf(" Stats: %s, %lu bytes, %.3f ms, page faults %ld minor / %ld major, peak RSS %ld KB\n",
+	Format,(unsigned long)StatCur.Bytes[StatMmap],_StatMs(StatCur.Ns),
+	StatCur.MinFlt,StatCur.MajFlt,ru.ru_maxrss);
+    for(p=0; p < StatPhases; p++)
+      {
+      if (!StatCur.Calls[p]) { continue; }
+      printf("  %-8s %4lu call(s) %10.3f ms %14lu bytes\n",
+	StatPhaseName[p],(unsigned long)StatCur.Calls[p],
+	_StatMs(StatCur.PhaseNs[p]),(unsigned long)StatCur.Bytes[p]);
+      }
+    }
+
+  StatLast = StatCur;
+  StatHasLast=true;
+
+  // Only the --stats report needs every file.
+  // (Trace and metrics are written as each file ends.)
+  if (!StatsShow) { return; }
+  if (StatFilesLen >= StatFilesMax)
+    {
+    StatFilesMax += 64;
+    StatFiles = (statfile*)realloc(StatFiles,StatFilesMax*sizeof(statfile));
+    }
+  StatFiles[StatFilesLen++] = StatCur;
+} /* StatFileEnd() */
+
+/**************************************
+ StatReport(): Show the aggregate statistics.
+ Percentiles are over files (per-file time in each phase).
+ **************************************/
+void	StatReport	()
+{
+  struct rusage ru;
+  uint64_t *Values;
+  uint64_t Ns=0, Bytes=0;
+  long MinFlt=0, MajFlt=0;
+  size_t f,v;
+  int p;
+
+  if (!StatsShow) { return; }
+  Values = (uint64_t*)calloc(StatFilesLen+1,sizeof(uint64_t));
+  for(f=0; f < StatFilesLen; f++)
+    {
+    Ns += StatFiles[f].Ns;
+    Bytes += StatFiles[f].Bytes[StatMmap];
+    MinFlt += StatFiles[f].MinFlt;
+    MajFlt += StatFiles[f].MajFlt;
+    }
+
+  printf("\n[stats]\n");
+  printf(" Files: %lu, %lu bytes, %.3f ms\n",(unsigned long)StatFilesLen,(unsigned long)Bytes,_StatMs(Ns));
+  printf(" %-10s %8s %11s %10s %10s %10s %14s\n","Phase","Calls","Total ms","p50 ms","p90 ms","p99 ms","Bytes");
+  for(p=0; p < StatPhases; p++)
+    {
+    if (!StatCalls[p]) { continue; }
+    for(f=v=0; f < StatFilesLen; f++)
+      {
+      if (StatFiles[f].Calls[p]) { Values[v++] = StatFiles[f].PhaseNs[p]; }
+      }
+    _StatRow(StatPhaseName[p],StatCalls[p],StatNs[p],StatBytes[p],Values,v);
+    }
+
+  // Per format: each format is listed once, in order of first appearance
+  printf(" %-10s %8s %11s %10s %10s %10s %14s\n","Format","Files","Total ms","p50 ms","p90 ms","p99 ms","Bytes");
+  for(f=0; f < StatFilesLen; f++)
+    {
+    size_t g;
+    const char *Format = StatFiles[f].Format;
+    for(g=0; g < f; g++) { if (!strcmp(StatFiles[g].Format,Format)) { break; } }
+    if (g < f) { continue; } // already shown
+
+    Ns=Bytes=0;
+    for(g=f,v=0; g < StatFilesLen; g++)
+      {
+      if (strcmp(StatFiles[g].Format,Format)) { continue; }
+      Values[v++] = StatFiles[g].Ns;
+      Ns += StatFiles[g].Ns;
+      Bytes += StatFiles[g].Bytes[StatMmap];
+      }
+    _StatRow(Format,v,Ns,Bytes,Values,v);
+    }
+
+  getrusage(RUSAGE_SELF,&ru);
+  printf(" Page faults: %ld minor, %ld major (in files)\n",MinFlt,MajFlt);
+  printf(" Peak RSS: %ld KB\n",ru.ru_maxrss);
+  free(Values);
+} /* StatReport() */
+
+/**************************************
+ StatFileLast(): Get the results for the most recent file.
+ For benchmarks. Returns false if there are no files.
+ **************************************/
+bool	StatFileLast	(uint64_t *Ns, uint64_t PhaseNs[StatPhases], uint64_t Bytes[StatPhases])
+{
+  if (!StatHasLast) { return(false); }
+  statfile *F = &StatLast;
+  *Ns = F->Ns;
+  memcpy(PhaseNs,F->PhaseNs,sizeof(F->PhaseNs));
+  memcpy(Bytes,F->Bytes,sizeof(F->Bytes));
+  return(true);
+} /* StatFileLast() */
@@ -0,0 +1,58 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Per-phase timing and resource statistics (--stats).
+ ************************************************/
+#ifndef STATS_HPP
+#define STATS_HPP
+
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "seal.hpp"
+
+// Processing phases; order matches the report
+enum
+  {
+  StatMmap=0,	// MmapFile()
+  StatDetect,	// Seal_is*()
+  StatWalk,	// format walker (minus nested phases)
+  StatParse,	// SealParse()
+  StatDNS,	// SealGetDNS()
+  StatDigest,	// SealDigest()
+  StatVerify,	// SealValidateSig()
+  StatSign,	// SealSignLocal(), SealSignURL()
+  StatWrite,	// SealInsert()
+  StatPhases	// number of phases
+  };
+
+extern bool StatsEnabled; // timing hooks are active (--stats or --trace)
+extern bool StatsShow; // print statistics (--stats)
+
+uint64_t	StatNow	();
+void	StatBegin	(int Phase);
+void	StatEnd	(int Phase, uint64_t Bytes);
+void	StatThreadIgnore	();
+void	StatFileBegin	(const char *Filename);
+void	StatFileEnd	(const char *Format);
+void	StatReport	();
+const char *	StatName	(int Phase);
+bool	StatFileLast	(uint64_t *Ns, uint64_t PhaseNs[StatPhases], uint64_t Bytes[StatPhases]);
+
+/**************************************
+ statscope: Time a phase until the end of the scope.
+ Add to Bytes for the phase's byte count.
+ **************************************/
+struct statscope
+  {
+  int Phase;
+  uint64_t Bytes;
+  statscope(int P) : Phase(P), Bytes(0) { if (StatsEnabled) { StatBegin(Phase); } }
+  ~statscope() { if (StatsEnabled) { StatEnd(Phase,Bytes); } }
+  };
+
+#endif
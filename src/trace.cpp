@@ -0,0 +1,246 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Chrome/Perfetto trace-event output (--trace).
+
+ Every phase timed by statscope (see stats.cpp) becomes a span,
+ along with one span per file and one per digest range.
+ Load the output in chrome://tracing or https://ui.perfetto.dev/
+
+ Each thread appends to its own buffer, so recording never locks.
+ Buffers are linked into a global list (atomic push) the first
+ time a thread records. The JSON is written when the program ends.
+ ************************************************/
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/syscall.h> // SYS_gettid
+#include <atomic>
+
+#include "seal.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+
+bool TraceEnabled=false;
+
+#pragma GCC visibility push(hidden)
+
+typedef struct
+  {
+  const char *Name;
+  const char *File;
+  const char *Format;
+  long Record;
+  uint64_t Start, Dur;
+  uint64_t Bytes;
+  uint64_t RangeStart, RangeEnd;
+  bool IsRange;
+  } traceevent;
+
+#define TRACECHUNK 4096
+typedef struct tracechunk
+  {
+  struct tracechunk *Next;
+  size_t Len;
+  traceevent Event[TRACECHUNK];
+  } tracechunk;
+
+typedef struct tracebuf
+  {
+  struct tracebuf *Next; // list of all threads
+  long Tid;
+  // Context for new spans
+  const char *File;
+  const char *Format;
+  long Record;
+  tracechunk *Head, *Tail;
+  } tracebuf;
+
+static std::atomic<tracebuf*> TraceBufs(NULL);
+static thread_local tracebuf *TraceLocal=NULL;
+static FILE *TraceFout=NULL;
+static uint64_t TraceEpoch=0;
+
+/**************************************
+ _TraceBuf(): Get this thread's buffer.
+ **************************************/
+static tracebuf *	_TraceBuf	()
+{
+  if (TraceLocal) { return(TraceLocal); }
+  TraceLocal = (tracebuf*)calloc(1,sizeof(tracebuf));
+  TraceLocal->Tid = syscall(SYS_gettid);
+  TraceLocal->Next = TraceBufs.load(std::memory_order_relaxed);
+  while(!TraceBufs.compare_exchange_weak(TraceLocal->Next,TraceLocal,
+	std::memory_order_release,std::memory_order_relaxed)) { ; }
+  return(TraceLocal);
+} /* _TraceBuf() */
+
+/**************************************
+ _TraceAdd(): Append an event with the current context.
+ **************************************/
+static traceevent *	_TraceAdd	(const char *Name, uint64_t Start)
+{
+  tracebuf *B = _TraceBuf();
+  traceevent *E;
+
+  if (!B->Tail || (B->Tail->Len >= TRACECHUNK))
+    {
+    tracechunk *C = (tracechunk*)malloc(sizeof(tracechunk));
+    C->Next=NULL;
+    C->Len=0;
+    if (B->Tail) { B->Tail->Next = C; } else { B->Head = C; }
+    B->Tail = C;
+    }
+  E = B->Tail->Event + B->Tail->Len;
+  B->Tail->Len++;
+  memset(E,0,sizeof(traceevent));
+  E->Name = Name;
+  E->File = B->File;
+  E->Format = B->Format;
+  E->Record = B->Record;
+  E->Start = Start;
+  E->Dur = StatNow() - Start;
+  return(E);
+} /* _TraceAdd() */
+
+/**************************************
+ _TraceString(): Write a JSON string.
+ **************************************/
+static void	_TraceString	(FILE *Fout, const char *Str)
+{
+  fputc('"',Fout);
+  for( ; Str && *Str; Str++)
+    {
+    unsigned char c = *Str;
+    if ((c=='"') || (c=='\\')) { fputc('\\',Fout); fputc(c,Fout); }
+    else if (c < 0x20) { fprintf(Fout,"\\u%04x",c); }
+    else { fputc(c,Fout); }
+    }
+  fputc('"',Fout);
+} /* _TraceString() */
+
+#pragma GCC visibility pop
+
+/**************************************
+ TraceOpen(): Start tracing to a file.
+ The file is created now so errors are found early.
+ **************************************/
+bool	TraceOpen	(const char *Filename)
+{
+  if (!Filename || !Filename[0]) { return(false); }
+  TraceFout = fopen(Filename,"wb");
+  if (!TraceFout)
+	{
+	fprintf(stderr,"ERROR: Cannot create trace file (%s). Aborting.\n",Filename);
+	exit(0x80);
+	}
+  TraceEpoch = StatNow();
+  TraceEnabled = true;
+  atexit(TraceClose); // write even after an error
+  return(true);
+} /* TraceOpen() */
+
+/**************************************
+ TraceClose(): Write the trace and free buffers.
+ Call after all other threads have finished.
+ **************************************/
+void	TraceClose	()
+{
+  tracebuf *B, *Bnext;
+  tracechunk *C, *Cnext;
+  size_t i;
+
+  if (!TraceEnabled || !TraceFout) { return; }
+  TraceEnabled=false;
+
+  fprintf(TraceFout,"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(TraceFout,"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,\"args\":{\"name\":\"sealtool\"}}",(long)getpid());
+  for(B=TraceBufs.exchange(NULL); B; B=Bnext)
+    {
+    Bnext = B->Next;
+    for(C=B->Head; C; C=Cnext)
+      {
+      Cnext = C->Next;
+      for(i=0; i < C->Len; i++)
+	{
+	traceevent *E = C->Event+i;
+	fprintf(TraceFout,",\n{\"name\":\"%s\",\"cat\":\"seal\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%ld,\"args\":{",
+		E->Name,(double)(E->Start-TraceEpoch)/1000.0,(double)E->Dur/1000.0,
+		(long)getpid(),B->Tid);
+	fprintf(TraceFout,"\"file\":");
+	_TraceString(TraceFout,E->File);
+	fprintf(TraceFout,",\"format\":");
+	_TraceString(TraceFout,E->Format);
+	fprintf(TraceFout,",\"record\":%ld",E->Record);
+	if (E->IsRange) { fprintf(TraceFout,",\"start\":%lu,\"end\":%lu",(unsigned long)E->RangeStart,(unsigned long)E->RangeEnd); }
+	if (E->Bytes) { fprintf(TraceFout,",\"bytes\":%lu",(unsigned long)E->Bytes); }
+	fprintf(TraceFout,"}}");
+	}
+      free(C);
+      }
+    if (B == TraceLocal) { TraceLocal=NULL; }
+    free(B);
+    }
+  fprintf(TraceFout,"\n]}\n");
+  fclose(TraceFout);
+  TraceFout=NULL;
+} /* TraceClose() */
+
+/**************************************
+ TraceSetFile(): Set the file for new spans.
+ Resets the format and record number.
+ Filename must remain allocated until TraceClose().
+ **************************************/
+void	TraceSetFile	(const char *Filename)
+{
+  if (!TraceEnabled) { return; }
+  tracebuf *B = _TraceBuf();
+  B->File = Filename;
+  B->Format = NULL;
+  B->Record = 0;
+} /* TraceSetFile() */
+
+/**************************************
+ TraceSetFormat(): Set the format for new spans.
+ Format must be a constant string.
+ **************************************/
+void	TraceSetFormat	(const char *Format)
+{
+  if (!TraceEnabled) { return; }
+  _TraceBuf()->Format = Format;
+} /* TraceSetFormat() */
+
+/**************************************
+ TraceSetRecord(): Set the SEAL record number for new spans.
+ **************************************/
+void	TraceSetRecord	(long Record)
+{
+  if (!TraceEnabled) { return; }
+  _TraceBuf()->Record = Record;
+} /* TraceSetRecord() */
+
+/**************************************
+ TraceSpan(): Record a span that started at Start and ends now.
+ Name must be a constant string.
+ **************************************/
+void	TraceSpan	(const char *Name, uint64_t Start, uint64_t Bytes)
+{
+  if (!TraceEnabled) { return; }
+  _TraceAdd(Name,Start)->Bytes = Bytes;
+} /* TraceSpan() */
+
+/**************************************
+ TraceRange(): Record a span for a byte range in the file.
+ **************************************/
+void	TraceRange	(const char *Name, uint64_t Start, uint64_t RangeStart, uint64_t RangeEnd)
+{
+  if (!TraceEnabled) { return; }
+  traceevent *E = _TraceAdd(Name,Start);
+  E->IsRange = true;
+  E->RangeStart = RangeStart;
+  E->RangeEnd = RangeEnd;
+  E->Bytes = RangeEnd-RangeStart;
+} /* TraceRange() */
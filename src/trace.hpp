@@ -0,0 +1,32 @@
+/************************************************
+ SEAL: implemented in C
+ See LICENSE
+
+ Chrome/Perfetto trace-event output (--trace).
+ ************************************************/
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+// C headers
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "seal.hpp"
+
+extern bool TraceEnabled;
+
+bool	TraceOpen	(const char *Filename);
+void	TraceClose	();
+
+// Context attached to every span from this thread
+void	TraceSetFile	(const char *Filename);
+void	TraceSetFormat	(const char *Format);
+void	TraceSetRecord	(long Record);
+
+// Start is from StatNow(); a range is [RangeStart,RangeEnd) in the file
+void	TraceSpan	(const char *Name, uint64_t Start, uint64_t Bytes);
+void	TraceRange	(const char *Name, uint64_t Start, uint64_t RangeStart, uint64_t RangeEnd);
+
+#endif